@@ -0,0 +1,305 @@
+/**
+ * @file allocs.h
+ * @brief Allocation counting by compiler phase (make allocs)
+ *
+ * AllocPhase marks the phase or optimizer pass that is running; markers
+ * nest, so passes are counted under "optimize". In a normal build the
+ * marker is empty and costs nothing. Built with LAB3_ALLOC_STATS the
+ * header also replaces the global operator new and delete: every
+ * allocation is counted with its size against the current phase, and its
+ * call stack against an allocation site. At exit a table of allocations
+ * per phase and the top sites go to stderr.
+ *
+ * A site is the first function up the stack that is not part of the
+ * standard library, so the vector growth in Lexer::tokenize() is charged
+ * to the lexer, not to std::vector. Names come from dladdr, which sees
+ * the functions of the executable only when it is linked with -rdynamic.
+ * The hooks never allocate themselves: the phase and site tables are
+ * fixed arrays, shared by all threads under a spin lock. Worker threads
+ * count against the phase of the main thread, which started them.
+ */
+
+#pragma once
+
+#ifdef LAB3_ALLOC_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+class AllocPhase {
+public:
+    static constexpr int MAX_PHASES = 64;
+    static constexpr int MAX_SITES = 1 << 15;  // distinct stacks kept; the rest are only counted
+    static constexpr int STACK_DEPTH = 10;
+    static constexpr int TOP_SITES = 20;
+
+private:
+    struct Phase {
+        const char* name;
+        int parent;
+        long allocs, bytes, frees;
+    };
+    struct Site {
+        unsigned long hash;  // 0: empty
+        int phase;
+        int depth;
+        void* stack[STACK_DEPTH];
+        long allocs, bytes;
+    };
+
+    // Phase 0 is everything outside a marker
+    static inline Phase phases[MAX_PHASES] = {{"other", -1, 0, 0, 0}};
+    static inline int phaseCount = 1;
+    static inline std::atomic<int> current{0};
+    static inline Site sites[MAX_SITES];
+    static inline long lostAllocs = 0, lostBytes = 0;
+    static inline std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    static inline thread_local bool busy = false;  // the hook itself is running
+
+    int saved;
+
+    struct Guard {
+        Guard() {
+            while(lock.test_and_set(std::memory_order_acquire)) {
+            }
+        }
+        ~Guard() { lock.clear(std::memory_order_release); }
+    };
+
+    // Index of `name` under the current phase, created on first use
+    static int find(const char* name) {
+        Guard guard;
+        int parent = current.load(std::memory_order_relaxed);
+        for(int i = 1; i < phaseCount; i++) {
+            if(phases[i].parent == parent && strcmp(phases[i].name, name) == 0) return i;
+        }
+        if(phaseCount == MAX_PHASES) return parent;
+        phases[phaseCount] = {name, parent, 0, 0, 0};
+        return phaseCount++;
+    }
+
+public:
+    // `name` must outlive the program (a string literal)
+    explicit AllocPhase(const char* name) : saved(current.load(std::memory_order_relaxed)) {
+        current.store(find(name), std::memory_order_relaxed);
+    }
+    ~AllocPhase() { current.store(saved, std::memory_order_relaxed); }
+    AllocPhase(const AllocPhase&) = delete;
+    AllocPhase& operator=(const AllocPhase&) = delete;
+
+    // Ends this phase and starts the next one at the same level
+    void enter(const char* name) {
+        current.store(saved, std::memory_order_relaxed);
+        current.store(find(name), std::memory_order_relaxed);
+    }
+
+    static void recordAlloc(size_t size) {
+        if(busy) return;
+        busy = true;
+        void* stack[STACK_DEPTH + 2];
+        int depth = backtrace(stack, STACK_DEPTH + 2) - 2;  // without this hook and operator new
+        unsigned long hash = 1469598103934665603ul;
+        for(int i = 0; i < depth; i++) hash = (hash ^ reinterpret_cast<unsigned long>(stack[i + 2])) * 1099511628211ul;
+        {
+            Guard guard;
+            int phase = current.load(std::memory_order_relaxed);
+            phases[phase].allocs++;
+            phases[phase].bytes += static_cast<long>(size);
+            hash = (hash ^ static_cast<unsigned long>(phase)) * 1099511628211ul | 1;
+            Site* site = nullptr;
+            for(int probe = 0; probe < 64; probe++) {
+                Site& s = sites[(hash + probe) & (MAX_SITES - 1)];
+                if(s.hash == hash || s.hash == 0) {
+                    site = &s;
+                    break;
+                }
+            }
+            if(!site) {
+                lostAllocs++;
+                lostBytes += static_cast<long>(size);
+            } else {
+                if(site->hash == 0) {
+                    site->hash = hash;
+                    site->phase = phase;
+                    site->depth = depth > 0 ? depth : 0;
+                    for(int i = 0; i < site->depth; i++) site->stack[i] = stack[i + 2];
+                }
+                site->allocs++;
+                site->bytes += static_cast<long>(size);
+            }
+        }
+        busy = false;
+    }
+
+    static void recordFree() {
+        if(busy) return;
+        Guard guard;
+        phases[current.load(std::memory_order_relaxed)].frees++;
+    }
+
+    // Prints the tables; called once at exit
+    static void report() {
+        busy = true;
+        std::string path[MAX_PHASES];
+        for(int i = 0; i < phaseCount; i++) {
+            path[i] = (phases[i].parent > 0 ? path[phases[i].parent] + "/" : "") + phases[i].name;
+        }
+        long allocs = 0, bytes = 0;
+        fprintf(stderr, "\nAllocations by phase:\n  %-28s %12s %14s %12s %10s\n", "phase", "allocs", "bytes", "frees",
+                "avg bytes");
+        for(int i = 0; i < phaseCount; i++) {
+            const Phase& p = phases[i];
+            if(p.allocs == 0 && p.frees == 0) continue;
+            fprintf(stderr, "  %-28s %12ld %14ld %12ld %10.1f\n", path[i].c_str(), p.allocs, p.bytes, p.frees,
+                    p.allocs ? double(p.bytes) / p.allocs : 0.0);
+            allocs += p.allocs;
+            bytes += p.bytes;
+        }
+        fprintf(stderr, "  %-28s %12ld %14ld\n", "total", allocs, bytes);
+
+        // Stacks that end in the same function of the same phase are one site
+        struct Top {
+            std::string where;
+            int phase;
+            long allocs, bytes;
+        };
+        std::vector<Top> top;
+        std::unordered_map<std::string, size_t> index;
+        for(int i = 0; i < MAX_SITES; i++) {
+            const Site& s = sites[i];
+            if(s.hash == 0) continue;
+            std::string where = siteName(s.stack, s.depth);
+            auto [it, added] = index.emplace(std::to_string(s.phase) + " " + where, top.size());
+            if(added) top.push_back({where, s.phase, 0, 0});
+            top[it->second].allocs += s.allocs;
+            top[it->second].bytes += s.bytes;
+        }
+        std::sort(top.begin(), top.end(), [](const Top& a, const Top& b) { return a.allocs > b.allocs; });
+        fprintf(stderr, "Top allocation sites:\n  %12s %14s  %-24s %s\n", "allocs", "bytes", "phase", "site");
+        for(size_t t = 0; t < top.size() && t < TOP_SITES; t++) {
+            fprintf(stderr, "  %12ld %14ld  %-24s %s\n", top[t].allocs, top[t].bytes, path[top[t].phase].c_str(),
+                    top[t].where.c_str());
+        }
+        if(lostAllocs > 0) {
+            fprintf(stderr, "  %12ld %14ld  (site table full)\n", lostAllocs, lostBytes);
+        }
+    }
+
+private:
+    // Demangled name of the function at `address`, "" if unknown
+    static std::string symbol(void* address) {
+        Dl_info info;
+        if(!dladdr(address, &info) || !info.dli_sname) return "";
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+        free(demangled);
+        return name;
+    }
+
+    // std::, __gnu_cxx:: and operator new frames are skipped; the return
+    // type in front of a template function name is ignored
+    static bool library(const std::string& name) {
+        size_t start = 0;
+        int angles = 0;
+        for(size_t i = 0; i < name.size() && name[i] != '('; i++) {
+            if(name[i] == '<') angles++;
+            else if(name[i] == '>') angles--;
+            else if(name[i] == ' ' && angles == 0) start = i + 1;
+        }
+        for(const char* prefix : {"std::", "__gnu_cxx::", "operator new", "__"}) {
+            if(name.compare(start, strlen(prefix), prefix) == 0) return true;
+        }
+        return false;
+    }
+
+    static std::string siteName(void* const* stack, int depth) {
+        std::string fallback;
+        for(int i = 0; i < depth; i++) {
+            std::string name = symbol(stack[i]);
+            if(name.empty()) {
+                if(fallback.empty()) {
+                    char text[32];
+                    snprintf(text, sizeof(text), "?? %p", stack[i]);
+                    fallback = text;
+                }
+                continue;
+            }
+            if(library(name)) {
+                if(fallback.empty()) fallback = name;
+                continue;
+            }
+            if(name.size() > 90) name = name.substr(0, 87) + "...";
+            return name;
+        }
+        if(fallback.size() > 90) fallback = fallback.substr(0, 87) + "...";
+        return fallback.empty() ? "??" : fallback;
+    }
+
+    struct Reporter {
+        ~Reporter() { report(); }
+    };
+    static inline Reporter reporter;
+};
+
+// Replacements of the global allocation functions, one copy per program.
+// Not inlined: GCC would pair the malloc inside with a library delete and
+// warn about a mismatch.
+#define LAB3_ALLOC_HOOK __attribute__((noinline))
+
+LAB3_ALLOC_HOOK void* operator new(size_t size) {
+    AllocPhase::recordAlloc(size);
+    if(void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+LAB3_ALLOC_HOOK void* operator new[](size_t size) {
+    AllocPhase::recordAlloc(size);
+    if(void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+LAB3_ALLOC_HOOK void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    AllocPhase::recordAlloc(size);
+    return malloc(size ? size : 1);
+}
+LAB3_ALLOC_HOOK void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    AllocPhase::recordAlloc(size);
+    return malloc(size ? size : 1);
+}
+LAB3_ALLOC_HOOK void operator delete(void* p) noexcept {
+    if(p) AllocPhase::recordFree();
+    free(p);
+}
+LAB3_ALLOC_HOOK void operator delete[](void* p) noexcept {
+    if(p) AllocPhase::recordFree();
+    free(p);
+}
+LAB3_ALLOC_HOOK void operator delete(void* p, size_t) noexcept {
+    if(p) AllocPhase::recordFree();
+    free(p);
+}
+LAB3_ALLOC_HOOK void operator delete[](void* p, size_t) noexcept {
+    if(p) AllocPhase::recordFree();
+    free(p);
+}
+
+#else
+
+class AllocPhase {
+public:
+    explicit AllocPhase(const char*) {}
+    AllocPhase(const AllocPhase&) = delete;
+    AllocPhase& operator=(const AllocPhase&) = delete;
+    void enter(const char*) {}
+};
+
+#endif
@@ -0,0 +1,369 @@
+/**
+ * @file baseline.h
+ * @brief Stored benchmark results and their comparison
+ *
+ * A BenchReport is what one bin/bench invocation measured: every sample
+ * of every phase of every program, plus the machine and commit it ran on.
+ * It is saved as JSON and read back to compare a change with a baseline.
+ *
+ * compare() pairs benchmarks by program and phase. The delta is the
+ * Hodges-Lehmann estimate of the relative change, the median ratio over
+ * all (current, baseline) sample pairs, with the distribution-free 95%
+ * confidence interval of the Mann-Whitney test: timings are skewed by
+ * outliers, so no normality is assumed. A regression is a phase whose
+ * whole interval lies above the threshold, i.e. slower by more than the
+ * threshold with 95% confidence. Noise alone is not flagged; more runs
+ * narrow the intervals; with four runs or fewer per side the interval is
+ * the whole range of ratios.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+struct BenchPhase {
+    std::string name;             // "lex", ..., "optimize/inlining", "interpret"
+    std::vector<double> millis;   // one per measured run
+};
+
+struct Benchmark {
+    std::string name;             // "mixed 1K (seed 1)" or the source file
+    long bytes = 0;
+    long tokens = 0;
+    long nodes = 0;
+    long instructions = 0;
+    long steps = 0;
+    std::vector<BenchPhase> phases;
+};
+
+class BenchReport {
+public:
+    std::vector<std::pair<std::string, std::string>> metadata;
+    std::vector<Benchmark> benchmarks;
+
+    // Commit, machine and compiler of this process
+    void describeEnvironment() {
+#ifdef LAB3_COMMIT
+        metadata.push_back({"commit", LAB3_COMMIT});  // of the sources, set by make
+#else
+        metadata.push_back({"commit", command("git rev-parse HEAD")});
+#endif
+        char date[32];
+        time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        metadata.push_back({"date", date});
+        metadata.push_back({"cpu", cpuModel()});
+        metadata.push_back({"cores", std::to_string(std::thread::hardware_concurrency())});
+#if defined(__unix__) || defined(__APPLE__)
+        struct utsname system;
+        if(uname(&system) == 0) {
+            metadata.push_back({"host", system.nodename});
+            metadata.push_back({"os", std::string(system.sysname) + " " + system.release + " " + system.machine});
+        }
+#endif
+#ifdef __VERSION__
+        metadata.push_back({"compiler", __VERSION__});
+#endif
+    }
+
+    std::string get(const std::string& key) const {
+        for(const auto& [k, v] : metadata) {
+            if(k == key) return v;
+        }
+        return "";
+    }
+
+    bool save(const std::string& file) const {
+        std::ofstream out(file);
+        out << "{\n  \"format\": \"lab3-bench-1\",\n  \"metadata\": {";
+        for(size_t i = 0; i < metadata.size(); i++) {
+            out << (i ? ",\n    " : "\n    ") << quote(metadata[i].first) << ": " << quote(metadata[i].second);
+        }
+        out << "\n  },\n  \"benchmarks\": [";
+        for(size_t b = 0; b < benchmarks.size(); b++) {
+            const Benchmark& bench = benchmarks[b];
+            out << (b ? ",\n" : "\n") << "    {\"name\": " << quote(bench.name) << ", \"bytes\": " << bench.bytes
+                << ", \"tokens\": " << bench.tokens << ", \"nodes\": " << bench.nodes
+                << ", \"instructions\": " << bench.instructions << ", \"steps\": " << bench.steps
+                << ",\n     \"phases\": [";
+            for(size_t p = 0; p < bench.phases.size(); p++) {
+                out << (p ? ",\n" : "\n") << "       {\"name\": " << quote(bench.phases[p].name) << ", \"millis\": [";
+                for(size_t s = 0; s < bench.phases[p].millis.size(); s++) {
+                    char number[32];
+                    snprintf(number, sizeof(number), "%.6g", bench.phases[p].millis[s]);
+                    out << (s ? ", " : "") << number;
+                }
+                out << "]}";
+            }
+            out << "]}";
+        }
+        out << "\n  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+    // False with `error` set if the file is missing or not a bench report
+    bool load(const std::string& file, std::string& error) {
+        std::ifstream in(file);
+        if(!in.is_open()) {
+            error = "Cannot open file '" + file + "'";
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        std::string text = buffer.str();
+        Json root;
+        JsonReader reader(text);
+        if(!reader.read(root) || root.kind != Json::OBJECT || root.field("format").text != "lab3-bench-1") {
+            error = "'" + file + "' is not a bench report";
+            return false;
+        }
+        for(const auto& [key, value] : root.field("metadata").fields) metadata.push_back({key, value.text});
+        for(const auto& item : root.field("benchmarks").items) {
+            Benchmark bench;
+            bench.name = item.field("name").text;
+            bench.bytes = static_cast<long>(item.field("bytes").number);
+            bench.tokens = static_cast<long>(item.field("tokens").number);
+            bench.nodes = static_cast<long>(item.field("nodes").number);
+            bench.instructions = static_cast<long>(item.field("instructions").number);
+            bench.steps = static_cast<long>(item.field("steps").number);
+            for(const auto& phase : item.field("phases").items) {
+                BenchPhase p;
+                p.name = phase.field("name").text;
+                for(const auto& sample : phase.field("millis").items) p.millis.push_back(sample.number);
+                if(!p.millis.empty()) bench.phases.push_back(std::move(p));
+            }
+            benchmarks.push_back(std::move(bench));
+        }
+        return true;
+    }
+
+private:
+    static std::string quote(const std::string& text) {
+        std::string out = "\"";
+        for(char c : text) {
+            if(c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if(static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    // First line of a shell command's output, "" if it fails
+    static std::string command(const char* line) {
+#if defined(__unix__) || defined(__APPLE__)
+        std::string full = std::string(line) + " 2>/dev/null";
+        FILE* pipe = popen(full.c_str(), "r");
+        if(!pipe) return "";
+        char buffer[256] = "";
+        if(!fgets(buffer, sizeof(buffer), pipe)) buffer[0] = '\0';
+        pclose(pipe);
+        std::string text = buffer;
+        while(!text.empty() && isspace(static_cast<unsigned char>(text.back()))) text.pop_back();
+        return text;
+#else
+        (void)line;
+        return "";
+#endif
+    }
+
+    static std::string cpuModel() {
+        std::ifstream in("/proc/cpuinfo");
+        std::string line;
+        while(std::getline(in, line)) {
+            if(line.compare(0, 10, "model name") == 0) {
+                size_t colon = line.find(':');
+                if(colon != std::string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+            }
+        }
+        return "unknown";
+    }
+
+    // Just enough JSON for the reports written above
+    struct Json {
+        enum Kind { NONE, NUMBER, STRING, ARRAY, OBJECT } kind = NONE;
+        double number = 0;
+        std::string text;
+        std::vector<Json> items;
+        std::vector<std::pair<std::string, Json>> fields;
+
+        const Json& field(const std::string& key) const {
+            static const Json missing;
+            for(const auto& [k, v] : fields) {
+                if(k == key) return v;
+            }
+            return missing;
+        }
+    };
+
+    class JsonReader {
+        const std::string& text;
+        size_t pos = 0;
+
+        void skip() {
+            while(pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) pos++;
+        }
+        bool eat(char c) {
+            skip();
+            if(pos < text.size() && text[pos] == c) {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+        bool string(std::string& out) {
+            if(!eat('"')) return false;
+            while(pos < text.size() && text[pos] != '"') {
+                char c = text[pos++];
+                if(c == '\\' && pos < text.size()) {
+                    c = text[pos++];
+                    if(c == 'n') c = '\n';
+                    else if(c == 't') c = '\t';
+                    else if(c == 'u' && pos + 4 <= text.size()) {
+                        c = static_cast<char>(std::stoi(text.substr(pos, 4), nullptr, 16));
+                        pos += 4;
+                    }
+                }
+                out += c;
+            }
+            return eat('"');
+        }
+
+    public:
+        explicit JsonReader(const std::string& text) : text(text) {}
+
+        bool read(Json& value) {
+            skip();
+            if(pos >= text.size()) return false;
+            char c = text[pos];
+            if(c == '"') {
+                value.kind = Json::STRING;
+                return string(value.text);
+            }
+            if(c == '[') {
+                pos++;
+                value.kind = Json::ARRAY;
+                if(eat(']')) return true;
+                do {
+                    value.items.emplace_back();
+                    if(!read(value.items.back())) return false;
+                } while(eat(','));
+                return eat(']');
+            }
+            if(c == '{') {
+                pos++;
+                value.kind = Json::OBJECT;
+                if(eat('}')) return true;
+                do {
+                    std::string key;
+                    if(!string(key) || !eat(':')) return false;
+                    value.fields.push_back({key, Json()});
+                    if(!read(value.fields.back().second)) return false;
+                } while(eat(','));
+                return eat('}');
+            }
+            char* end = nullptr;
+            value.kind = Json::NUMBER;
+            value.number = strtod(text.c_str() + pos, &end);
+            if(end == text.c_str() + pos) return false;
+            pos = static_cast<size_t>(end - text.c_str());
+            return true;
+        }
+    };
+};
+
+// One benchmark phase present in both reports
+struct PhaseDelta {
+    std::string benchmark, phase;
+    double baseline = 0, current = 0;  // median milliseconds
+    double delta = 0, low = 0, high = 0;  // estimated relative change, 95% interval
+    int verdict = 0;                      // +1 regression, -1 improvement, 0 within noise
+};
+
+struct Comparison {
+    std::vector<PhaseDelta> deltas;
+    std::vector<std::string> unmatched;  // benchmarks in only one report
+    int regressions = 0, improvements = 0;
+};
+
+inline double medianOf(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+// `threshold` is relative: 0.05 flags phases more than 5% slower
+inline Comparison compare(const BenchReport& baseline, const BenchReport& current, double threshold) {
+    Comparison result;
+    for(const auto& bench : current.benchmarks) {
+        const Benchmark* old = nullptr;
+        for(const auto& candidate : baseline.benchmarks) {
+            if(candidate.name == bench.name) old = &candidate;
+        }
+        if(!old) {
+            result.unmatched.push_back(bench.name + " (new)");
+            continue;
+        }
+        for(const auto& phase : bench.phases) {
+            const BenchPhase* before = nullptr;
+            for(const auto& candidate : old->phases) {
+                if(candidate.name == phase.name) before = &candidate;
+            }
+            if(!before) continue;
+            PhaseDelta d;
+            d.benchmark = bench.name;
+            d.phase = phase.name;
+            d.baseline = medianOf(before->millis);
+            d.current = medianOf(phase.millis);
+
+            // Log-ratios of every (current, baseline) pair: their median
+            // estimates the change, their order statistics at the
+            // Mann-Whitney critical rank bound it
+            std::vector<double> ratios;
+            for(double a : before->millis) {
+                for(double b : phase.millis) {
+                    if(a > 0 && b > 0) ratios.push_back(std::log(b / a));
+                }
+            }
+            if(ratios.empty()) continue;
+            std::sort(ratios.begin(), ratios.end());
+            double n = static_cast<double>(before->millis.size()), m = static_cast<double>(phase.millis.size());
+            double rank = n * m / 2 - 1.96 * std::sqrt(n * m * (n + m + 1) / 12);
+            size_t k = rank < 1 ? 0 : static_cast<size_t>(rank) - 1;
+            d.delta = std::exp(medianOf(ratios)) - 1;
+            d.low = std::exp(ratios[k]) - 1;
+            d.high = std::exp(ratios[ratios.size() - 1 - k]) - 1;
+            if(d.low > threshold) d.verdict = 1, result.regressions++;
+            else if(d.high < -threshold) d.verdict = -1, result.improvements++;
+            result.deltas.push_back(d);
+        }
+    }
+    for(const auto& old : baseline.benchmarks) {
+        bool found = false;
+        for(const auto& bench : current.benchmarks) found = found || bench.name == old.name;
+        if(!found) result.unmatched.push_back(old.name + " (removed)");
+    }
+    return result;
+}
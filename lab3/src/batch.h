@@ -0,0 +1,666 @@
+/**
+ * @file batch.h
+ * @brief Batch interpreter - runs one program over many input records
+ *
+ * Records are processed LANES at a time, one record per lane. Every slot
+ * of the main program (global, temporary, array element, constant) is a
+ * lane array of LANES ints, slot after slot (structure of arrays), and
+ * each IR instruction executes for all lanes of the batch at once;
+ * input() in lane l reads the next value of record l.
+ *
+ * Lanes follow their own control flow. While all live lanes wait at the
+ * same instruction the batch runs converged and arithmetic is a plain
+ * loop over lane arrays. A branch that splits the lanes switches to
+ * masked execution: each step runs the lowest pc some live lane waits at,
+ * for the lanes at that pc only (blends for arithmetic). Code is laid out
+ * in source order, so lanes that skipped a block or left a loop wait at a
+ * higher pc until the others catch up and the batch reconverges.
+ *
+ * Calls to user functions run per lane on the scalar Interpreter; impure
+ * callees get the lane's globals copied in and back out. A runtime error
+ * stops only the lane that raised it.
+ */
+
+#pragma once
+
+#include "ir.h"
+#include "interpreter.h"
+#include "simd.h"
+#include <climits>
+#include <cstdio>
+#include <istream>
+#include <sstream>
+
+// Lane loops touch slot l of distinct (or identical) lane arrays only, so
+// they carry no dependences between iterations
+#if defined(__clang__)
+#define LANE_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define LANE_LOOP _Pragma("GCC ivdep")
+#else
+#define LANE_LOOP
+#endif
+
+struct BatchStats {
+    long records = 0;
+    long batches = 0;
+    long failed = 0;        // records stopped by a runtime error
+    long steps = 0;         // instructions issued to a group of lanes
+    long maskedSteps = 0;   // ... while the lanes were diverged
+    long laneSteps = 0;     // sum of active lanes over all steps
+    long laneSlots = 0;     // sum of the batch's lane count over all steps
+    long laneCalls = 0;     // calls run per lane on the scalar interpreter
+    long outputLines = 0;
+};
+
+class BatchInterpreter {
+public:
+    static constexpr int LANES = 128;
+
+private:
+    enum class OpCode : unsigned char {
+        BIN, UN, MOVE, JUMP, JUMP_IF_ZERO, LOAD, STORE, PRINT, INPUT, CALL,
+        VECTOR,      // target: kernel in vecPool
+        LOOP_BEGIN,  // parallel region run serially: dst iv, b hi, a saved hi, target past the end
+        LOOP_END,    // dst iv, a saved hi, target: first op of the body
+        HALT
+    };
+
+    // Slot operands are indices into the lane matrix
+    struct Op {
+        OpCode code = OpCode::HALT;
+        BinOp binOp = BinOp::ADD;
+        UnOp unOp = UnOp::NEG;
+        int dst = 0, a = 0, b = 0;
+        int target = 0;     // jump target, array size, kernel or scalar function index
+        int argBegin = 0;
+        int argCount = 0;
+        bool pure = false;  // CALL: callee does not touch globals
+    };
+
+    struct VecKernel {
+        bool reduce = false;
+        BinOp op = BinOp::ADD;
+        int dst = 0, dstSize = 0;
+        int src[2] = {0, 0};
+        bool array[2] = {false, false};
+        int offset[2] = {0, 0};
+        int size[2] = {0, 0};
+        int lo = 0, hi = 0;
+    };
+
+    std::vector<Op> code;
+    std::vector<int> argPool;
+    std::vector<VecKernel> vecPool;
+    std::vector<std::pair<int, int>> constants;  // slot, value
+    int globalCount = 0;
+    int slotCount = 0;
+
+    std::vector<int> lanes;  // slot s of lane l at s * LANES + l
+    int lanePc[LANES];
+    unsigned char alive[LANES];
+    unsigned char active[LANES];
+    int liveCount = 0;
+    std::vector<int> records[LANES];
+    size_t cursor[LANES];
+    std::vector<std::string> laneOutput[LANES];
+    std::string laneError[LANES];
+
+    Interpreter scalar;
+    std::vector<int> callArgs;
+    std::vector<std::string> output;
+    bool quiet = false;
+    BatchStats stats;
+
+public:
+    // Quiet runs record output instead of printing it
+    void setQuiet(bool value) { quiet = value; }
+
+    // Runs the program once per record of `in`: one line of integers per
+    // record (blank lines are skipped). Prints each record's output in
+    // record order; returns false if any record failed.
+    bool execute(const IRProgram& program, std::istream& in) {
+        output.clear();
+        stats = BatchStats();
+        try {
+            scalar.setQuiet(true);
+            scalar.prepare(program);
+            link(program);
+        } catch(const std::exception& e) {
+            fprintf(stderr, "Runtime error: %s\n", e.what());
+            return false;
+        }
+
+        std::string line;
+        int count = 0;
+        while(std::getline(in, line)) {
+            if(line.find_first_not_of(" \t\r,") == std::string::npos) continue;
+            parseRecord(line, records[count]);
+            if(++count == LANES) {
+                runBatch(count);
+                count = 0;
+            }
+        }
+        if(count > 0) runBatch(count);
+        return stats.failed == 0;
+    }
+
+    const std::vector<std::string>& getOutput() const { return output; }
+    const BatchStats& getStats() const { return stats; }
+
+    // Share of the batch's lanes doing useful work, over all issued steps
+    double utilization() const {
+        return stats.laneSlots ? 100.0 * stats.laneSteps / static_cast<double>(stats.laneSlots) : 0.0;
+    }
+
+private:
+    static void parseRecord(const std::string& line, std::vector<int>& values) {
+        values.clear();
+        std::string text = line;
+        std::replace(text.begin(), text.end(), ',', ' ');
+        std::istringstream fields(text);
+        long value;
+        while(fields >> value) values.push_back(static_cast<int>(value));
+    }
+
+    int* slot(int index) { return lanes.data() + static_cast<size_t>(index) * LANES; }
+
+    // ---------- Execution ----------
+
+    void runBatch(int count) {
+        std::fill(lanes.begin(), lanes.end(), 0);
+        for(const auto& [index, value] : constants) {
+            std::fill(slot(index), slot(index) + LANES, value);
+        }
+        for(int l = 0; l < LANES; l++) {
+            alive[l] = active[l] = (l < count);
+            lanePc[l] = 0;
+            cursor[l] = 0;
+            laneOutput[l].clear();
+            laneError[l].clear();
+        }
+        liveCount = count;
+
+        int pc = 0;
+        bool converged = true;
+        while(liveCount > 0) {
+            if(!converged) {
+                int low = INT_MAX, high = -1;
+                LANE_LOOP
+                for(int l = 0; l < LANES; l++) {
+                    int live = -static_cast<int>(alive[l]);  // all ones for live lanes
+                    low = std::min(low, (lanePc[l] & live) | (INT_MAX & ~live));
+                    high = std::max(high, (lanePc[l] & live) | ~live);
+                }
+                pc = low;
+                converged = (low == high);
+                int group = 0;
+                LANE_LOOP
+                for(int l = 0; l < LANES; l++) {
+                    active[l] = alive[l] & (lanePc[l] == pc);
+                    group += active[l];
+                }
+                if(!converged) {
+                    stats.maskedSteps++;
+                    stats.laneSteps += group;
+                } else {
+                    stats.laneSteps += liveCount;
+                }
+            } else {
+                stats.laneSteps += liveCount;
+            }
+            stats.steps++;
+            stats.laneSlots += count;
+            converged = step(pc, converged);
+        }
+
+        for(int l = 0; l < count; l++) {
+            for(const auto& text : laneOutput[l]) {
+                if(quiet) output.push_back(text);
+                else printf("%s\n", text.c_str());
+            }
+            stats.outputLines += static_cast<long>(laneOutput[l].size());
+            if(!laneError[l].empty()) {
+                fprintf(stderr, "Runtime error (record %ld): %s\n",
+                        stats.records + l + 1, laneError[l].c_str());
+                stats.failed++;
+            }
+        }
+        stats.records += count;
+        stats.batches++;
+    }
+
+    void fail(int lane, const std::string& message) {
+        laneError[lane] = message;
+        alive[lane] = active[lane] = 0;
+        liveCount--;
+    }
+
+    // Moves the active lanes on; in converged mode `pc` is shared
+    void advance(int& pc, bool converged, int next) {
+        if(converged) {
+            pc = next;
+            return;
+        }
+        LANE_LOOP
+        for(int l = 0; l < LANES; l++) lanePc[l] = active[l] ? next : lanePc[l];
+    }
+
+    // Lane loop over the whole batch while converged (dead lanes compute
+    // harmless garbage), or blended over the active lanes
+    template<typename F>
+    void map(const Op& op, bool converged, F f) {
+        int* d = slot(op.dst);
+        const int* a = slot(op.a);
+        const int* b = slot(op.b);
+        if(converged) {
+            LANE_LOOP
+            for(int l = 0; l < LANES; l++) d[l] = f(a[l], b[l]);
+        } else {
+            LANE_LOOP
+            for(int l = 0; l < LANES; l++) {
+                int keep = static_cast<int>(active[l]) - 1;  // 0 for active lanes, else all ones
+                d[l] = (f(a[l], b[l]) & ~keep) | (d[l] & keep);
+            }
+        }
+    }
+
+    void binary(const Op& op, bool converged) {
+        switch(op.binOp) {
+            case BinOp::ADD: map(op, converged, [](int x, int y) { return simd::scalarOp(BinOp::ADD, x, y); }); break;
+            case BinOp::SUB: map(op, converged, [](int x, int y) { return simd::scalarOp(BinOp::SUB, x, y); }); break;
+            case BinOp::MUL: map(op, converged, [](int x, int y) { return simd::scalarOp(BinOp::MUL, x, y); }); break;
+            case BinOp::EQ:  map(op, converged, [](int x, int y) { return static_cast<int>(x == y); }); break;
+            case BinOp::NE:  map(op, converged, [](int x, int y) { return static_cast<int>(x != y); }); break;
+            case BinOp::LT:  map(op, converged, [](int x, int y) { return static_cast<int>(x < y); }); break;
+            case BinOp::GT:  map(op, converged, [](int x, int y) { return static_cast<int>(x > y); }); break;
+            case BinOp::LE:  map(op, converged, [](int x, int y) { return static_cast<int>(x <= y); }); break;
+            case BinOp::GE:  map(op, converged, [](int x, int y) { return static_cast<int>(x >= y); }); break;
+            case BinOp::AND: map(op, converged, [](int x, int y) { return static_cast<int>(x && y); }); break;
+            case BinOp::OR:  map(op, converged, [](int x, int y) { return static_cast<int>(x || y); }); break;
+            case BinOp::DIV:
+            case BinOp::MOD: {
+                // Active lanes dividing by zero fail; the rest divide in
+                // double precision, which is exact for 32-bit operands and
+                // vectorizes (there is no SIMD integer division). The one
+                // quotient out of int range, INT_MIN / -1 = 2^31, wraps.
+                const int* b = slot(op.b);
+                int zero = 0;
+                LANE_LOOP
+                for(int l = 0; l < LANES; l++) zero |= active[l] & (b[l] == 0);
+                for(int l = 0; zero && l < LANES; l++) {
+                    if(active[l] && b[l] == 0) {
+                        fail(l, (op.binOp == BinOp::DIV) ? "Division by zero" : "Modulo by zero");
+                    }
+                }
+                auto quotient = [](int x, int y) {
+                    double q = static_cast<double>(x) / static_cast<double>(y | (y == 0));
+                    return static_cast<int>(q >= 2147483648.0 ? q - 4294967296.0 : q);
+                };
+                if(op.binOp == BinOp::DIV) {
+                    map(op, converged, quotient);
+                } else {
+                    map(op, converged, [&](int x, int y) {
+                        return simd::scalarOp(BinOp::SUB, x, simd::scalarOp(BinOp::MUL, quotient(x, y), y));
+                    });
+                }
+                break;
+            }
+        }
+    }
+
+    // Executes code[pc] for the active lanes; returns whether the lanes
+    // are still converged
+    bool step(int& pc, bool converged) {
+        const Op& op = code[pc];
+        switch(op.code) {
+            case OpCode::BIN:
+                binary(op, converged);
+                break;
+            case OpCode::UN:
+                if(op.unOp == UnOp::NEG) {
+                    map(op, converged, [](int x, int) { return simd::scalarOp(BinOp::SUB, 0, x); });
+                } else {
+                    map(op, converged, [](int x, int) { return static_cast<int>(x == 0); });
+                }
+                break;
+            case OpCode::MOVE:
+                map(op, converged, [](int x, int) { return x; });
+                break;
+            case OpCode::LOAD:
+            case OpCode::STORE: {
+                const int* index = slot(op.code == OpCode::LOAD ? op.b : op.a);
+                int base = (op.code == OpCode::LOAD) ? op.a : op.dst;
+                for(int l = 0; l < LANES; l++) {
+                    if(!active[l]) continue;
+                    if(static_cast<unsigned>(index[l]) >= static_cast<unsigned>(op.target)) {
+                        fail(l, "Array index " + std::to_string(index[l]) + " out of bounds [0, " +
+                                std::to_string(op.target) + ")");
+                        continue;
+                    }
+                    int& cell = slot(base + index[l])[l];
+                    if(op.code == OpCode::LOAD) slot(op.dst)[l] = cell;
+                    else cell = slot(op.b)[l];
+                }
+                break;
+            }
+            case OpCode::PRINT: {
+                const int* value = slot(op.a);
+                for(int l = 0; l < LANES; l++) {
+                    if(active[l]) laneOutput[l].push_back(std::to_string(value[l]));
+                }
+                break;
+            }
+            case OpCode::INPUT: {
+                int* d = slot(op.dst);
+                for(int l = 0; l < LANES; l++) {
+                    if(!active[l]) continue;
+                    if(cursor[l] >= records[l].size()) {
+                        fail(l, "input(): no more input values");
+                        continue;
+                    }
+                    d[l] = records[l][cursor[l]++];
+                }
+                break;
+            }
+            case OpCode::CALL:
+                callPerLane(op);
+                break;
+            case OpCode::VECTOR:
+                vectorPerLane(vecPool[op.target]);
+                break;
+            case OpCode::JUMP:
+                advance(pc, converged, op.target);
+                return converged;
+            case OpCode::JUMP_IF_ZERO:
+            case OpCode::LOOP_BEGIN:
+            case OpCode::LOOP_END:
+                return branch(pc, converged, op);
+            case OpCode::HALT:
+                for(int l = 0; l < LANES; l++) {
+                    if(active[l]) {
+                        alive[l] = active[l] = 0;
+                        liveCount--;
+                    }
+                }
+                return converged;
+        }
+        advance(pc, converged, pc + 1);
+        return converged;
+    }
+
+    // Conditional control flow: each active lane jumps to op.target when
+    // `taken`, else falls through. Splits converged lanes if they disagree.
+    bool branch(int& pc, bool converged, const Op& op) {
+        int* iv = slot(op.dst);
+        int* saved = slot(op.a);
+        const int* value = slot(op.code == OpCode::LOOP_BEGIN ? op.b : op.a);
+        int takenCount = 0, group = 0;
+        unsigned char taken[LANES];
+        for(int l = 0; l < LANES; l++) {
+            if(!active[l]) {
+                taken[l] = 0;
+                continue;
+            }
+            group++;
+            switch(op.code) {
+                case OpCode::JUMP_IF_ZERO:
+                    taken[l] = value[l] == 0;
+                    break;
+                case OpCode::LOOP_BEGIN:  // skip an empty range, else keep hi
+                    saved[l] = value[l];
+                    taken[l] = iv[l] >= value[l];
+                    break;
+                default:                  // LOOP_END: next iteration
+                    taken[l] = ++iv[l] < saved[l];
+                    break;
+            }
+            takenCount += taken[l];
+        }
+
+        if(converged && (takenCount == 0 || takenCount == group)) {
+            pc = takenCount ? op.target : pc + 1;
+            return true;
+        }
+        for(int l = 0; l < LANES; l++) {
+            if(active[l]) lanePc[l] = taken[l] ? op.target : pc + 1;
+        }
+        return false;
+    }
+
+    void callPerLane(const Op& op) {
+        std::vector<int>& globals = scalar.globalState();
+        callArgs.resize(op.argCount);
+        for(int l = 0; l < LANES; l++) {
+            if(!active[l]) continue;
+            stats.laneCalls++;
+            for(int i = 0; i < op.argCount; i++) callArgs[i] = slot(argPool[op.argBegin + i])[l];
+            if(!op.pure) {
+                for(int g = 0; g < globalCount; g++) globals[g] = slot(g)[l];
+            }
+            const std::vector<int>& record = records[l];
+            scalar.setInput(record.data() + cursor[l], record.size() - cursor[l]);
+            try {
+                int value = scalar.call(op.target, callArgs.data(), op.argCount);
+                slot(op.dst)[l] = value;
+            } catch(const std::exception& e) {
+                fail(l, e.what());
+            }
+            cursor[l] += scalar.getInputPosition();
+            const auto& printed = scalar.getOutput();
+            laneOutput[l].insert(laneOutput[l].end(), printed.begin(), printed.end());
+            if(!op.pure) {
+                for(int g = 0; g < globalCount; g++) slot(g)[l] = globals[g];
+            }
+        }
+    }
+
+    // A vectorized loop runs as a scalar loop in each lane; range errors
+    // match the scalar interpreter's
+    void vectorPerLane(const VecKernel& k) {
+        for(int l = 0; l < LANES; l++) {
+            if(!active[l]) continue;
+            int lo = slot(k.lo)[l], hi = slot(k.hi)[l];
+            if(hi <= lo) continue;
+
+            std::string error;
+            auto check = [&](int offset, int size) {
+                int first = lo + offset, last = hi - 1 + offset;
+                if(!error.empty()) return;
+                if(first < 0 || first >= size) error = std::to_string(first);
+                else if(last >= size) error = std::to_string(size);
+                if(!error.empty()) {
+                    error = "Array index " + error + " out of bounds [0, " + std::to_string(size) + ")";
+                }
+            };
+            for(int i = 0; i < 2; i++) {
+                if(k.array[i]) check(k.offset[i], k.size[i]);
+            }
+            if(!k.reduce) check(0, k.dstSize);
+            if(!error.empty()) {
+                fail(l, error);
+                continue;
+            }
+
+            auto source = [&](int i, int at) {
+                return k.array[i] ? slot(k.src[i] + at + k.offset[i])[l] : slot(k.src[i])[l];
+            };
+            int sum = 0;
+            for(int at = lo; at < hi; at++) {
+                int value = simd::scalarOp(k.op, source(0, at), source(1, at));
+                if(k.reduce) sum = simd::scalarOp(BinOp::ADD, sum, value);
+                else slot(k.dst + at)[l] = value;
+            }
+            if(k.reduce) slot(k.dst)[l] = simd::scalarOp(BinOp::ADD, slot(k.dst)[l], sum);
+        }
+    }
+
+    // ---------- Linking: main program -> lane ops ----------
+
+    void link(const IRProgram& program) {
+        code.clear();
+        argPool.clear();
+        vecPool.clear();
+        constants.clear();
+        globalCount = program.globalCount;
+        slotCount = globalCount;
+
+        std::unordered_map<int, int> constantSlots;
+        auto resolve = [&](const Operand& op) -> int {
+            if(op.isConst()) {
+                auto it = constantSlots.find(op.value);
+                if(it != constantSlots.end()) return it->second;
+                constantSlots[op.value] = slotCount;
+                constants.push_back({slotCount, op.value});
+                return slotCount++;
+            }
+            auto it = program.globalSlots.find(op.name);
+            if(it == program.globalSlots.end()) {
+                throw std::runtime_error("Undefined variable: " + op.str());
+            }
+            return it->second;
+        };
+        auto arraySize = [&](const Operand& op) -> int {
+            auto it = program.arraySizes.find(op.name);
+            if(it == program.arraySizes.end()) throw std::runtime_error("Not an array: " + op.str());
+            return it->second;
+        };
+
+        const auto& body = program.instructions;
+        std::unordered_map<std::string, int> labels;
+        int offset = 0;
+        for(const auto& instr : body) {
+            if(instr.type == InstrType::LABEL) labels[instr.label] = offset;
+            else if(instr.type != InstrType::NOP && instr.type != InstrType::CONST &&
+                    instr.type != InstrType::PAR_REDUCE) offset++;
+        }
+        auto target = [&](const std::string& label) -> int {
+            auto it = labels.find(label);
+            if(it == labels.end()) throw std::runtime_error("Label not found: " + label);
+            return it->second;
+        };
+
+        std::vector<size_t> openLoops;  // LOOP_BEGIN ops awaiting their end
+        for(const auto& instr : body) {
+            Op op;
+            switch(instr.type) {
+                case InstrType::BIN_OP:
+                    op.code = OpCode::BIN;
+                    op.binOp = instr.binOp;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    break;
+                case InstrType::UN_OP:
+                    op.code = OpCode::UN;
+                    op.unOp = instr.unOp;
+                    op.dst = resolve(instr.result);
+                    op.a = op.b = resolve(instr.op1);
+                    break;
+                case InstrType::ASSIGN:
+                    op.code = OpCode::MOVE;
+                    op.dst = resolve(instr.result);
+                    op.a = op.b = resolve(instr.op1);
+                    break;
+                case InstrType::LOAD_IDX:
+                    op.code = OpCode::LOAD;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.target = arraySize(instr.op1);
+                    break;
+                case InstrType::STORE_IDX:
+                    op.code = OpCode::STORE;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.target = arraySize(instr.result);
+                    break;
+                case InstrType::GOTO:
+                    op.code = OpCode::JUMP;
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::IF_GOTO:
+                    op.code = OpCode::JUMP_IF_ZERO;
+                    op.a = resolve(instr.op1);
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::PRINT:
+                    op.code = OpCode::PRINT;
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::INPUT:
+                    op.code = OpCode::INPUT;
+                    op.dst = resolve(instr.result);
+                    break;
+                case InstrType::RETURN:
+                    op.code = OpCode::HALT;
+                    break;
+                case InstrType::CALL: {
+                    const IRFunction* callee = program.findFunction(instr.funcName);
+                    int index = scalar.functionIndex(instr.funcName);
+                    if(!callee || index < 0) throw std::runtime_error("Undefined function: " + instr.funcName);
+                    op.code = OpCode::CALL;
+                    op.dst = resolve(instr.result);
+                    op.target = index;
+                    op.pure = callee->pure;
+                    op.argBegin = static_cast<int>(argPool.size());
+                    op.argCount = static_cast<int>(instr.args.size());
+                    for(const auto& arg : instr.args) argPool.push_back(resolve(arg));
+                    break;
+                }
+                case InstrType::VEC_MAP:
+                case InstrType::VEC_REDUCE: {
+                    VecKernel k;
+                    k.reduce = instr.type == InstrType::VEC_REDUCE;
+                    k.op = instr.binOp;
+                    k.dst = resolve(instr.result);
+                    if(!k.reduce) k.dstSize = arraySize(instr.result);
+                    const Operand* sources[2] = {&instr.op1, &instr.op2};
+                    for(int i = 0; i < 2; i++) {
+                        k.src[i] = resolve(*sources[i]);
+                        k.array[i] = !instr.args[2 + i].name.empty();
+                        if(k.array[i]) {
+                            k.offset[i] = instr.args[2 + i].value;
+                            k.size[i] = arraySize(*sources[i]);
+                        }
+                    }
+                    k.lo = resolve(instr.args[0]);
+                    k.hi = resolve(instr.args[1]);
+                    op.code = OpCode::VECTOR;
+                    op.target = static_cast<int>(vecPool.size());
+                    vecPool.push_back(k);
+                    break;
+                }
+                case InstrType::PAR_BEGIN:
+                    // Lanes are the parallelism here: the region runs as a
+                    // serial loop, which `parallel for` guarantees equivalent
+                    op.code = OpCode::LOOP_BEGIN;
+                    op.dst = resolve(instr.result);
+                    op.b = resolve(instr.op2);
+                    op.a = slotCount++;  // hi, saved per lane
+                    openLoops.push_back(code.size());
+                    break;
+                case InstrType::PAR_END: {
+                    if(openLoops.empty()) throw std::runtime_error("Parallel loop without begin");
+                    Op& begin = code[openLoops.back()];
+                    openLoops.pop_back();
+                    op.code = OpCode::LOOP_END;
+                    op.dst = begin.dst;
+                    op.a = begin.a;
+                    op.target = static_cast<int>(&begin - code.data()) + 1;
+                    begin.target = static_cast<int>(code.size()) + 1;
+                    break;
+                }
+                case InstrType::LABEL:
+                case InstrType::NOP:
+                case InstrType::CONST:
+                case InstrType::PAR_REDUCE:
+                    continue;
+            }
+            code.push_back(op);
+        }
+        code.push_back(Op());  // HALT
+        lanes.assign(static_cast<size_t>(slotCount) * LANES, 0);
+    }
+};
@@ -0,0 +1,747 @@
+/**
+ * @file bench.cpp
+ * @brief Benchmark harness - throughput of every compiler phase
+ *
+ * Runs the whole pipeline (lexer, parser, semantic analysis, code
+ * generation, each optimizer pass, interpreter) in process on programs
+ * from the seeded ProgramGenerator, or on a given source file. Every
+ * measurement is preceded by warmup runs and repeated; the report gives
+ * the median and the fastest run of each phase and the median throughput:
+ * tokens/s, AST nodes/s, IR instructions/s and executed IR ops/s.
+ *
+ * `-generate <size> -o <file>` only writes a program; sizes from 1K to
+ * 500M are streamed without holding the text in memory.
+ */
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "optimizer.h"
+#include "interpreter.h"
+#include "closure.h"
+#include "scheduler.h"
+#include "batch.h"
+#include "generator.h"
+#include "baseline.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+void printUsage(const char* programName) {
+    fprintf(stderr, "Usage: %s [options]\n", programName);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -sizes <list>     Program sizes, e.g. 1K,64K,1M (default: 1K,64K)\n");
+    fprintf(stderr, "  -mix <list>       mixed, expressions, straight, loops, variables or all\n");
+    fprintf(stderr, "                    (default: all)\n");
+    fprintf(stderr, "  -seed <n>         Generator seed (default: 1)\n");
+    fprintf(stderr, "  -warmup <n>       Unmeasured runs before each measurement (default: 1)\n");
+    fprintf(stderr, "  -runs <n>         Measured runs (default: 5)\n");
+    fprintf(stderr, "  -file <path>      Measure a source file instead of generated programs\n");
+    fprintf(stderr, "  -noexec           Skip the interpreter\n");
+    fprintf(stderr, "  -generate <size>  Write one generated program and exit\n");
+    fprintf(stderr, "  -o <file>         Output file for -generate (default: stdout)\n");
+    fprintf(stderr, "  -inputs <n>       The generated program reads n values with input()\n");
+    fprintf(stderr, "  -json <file>      Save all samples with commit and machine details\n");
+    fprintf(stderr, "  -baseline <file>  Compare the results with a saved report\n");
+    fprintf(stderr, "  -compare <old> <new>  Compare two saved reports and exit\n");
+    fprintf(stderr, "  -threshold <pct>  Flag phases slower by more than pct%% (default: 5)\n");
+    fprintf(stderr, "  -diff <n>         Run n generated programs on every engine at every\n");
+    fprintf(stderr, "                    optimization level and compare their outputs\n");
+    fprintf(stderr, "  -slowdown <x>     With -diff, flag runs x times slower than the median\n");
+    fprintf(stderr, "                    configuration of their program (default: 4)\n");
+}
+
+// "64K", "1M", "500M": binary multiples of a byte
+bool parseSize(const std::string& text, size_t& bytes) {
+    char* end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if(end == text.c_str() || value <= 0) return false;
+    double scale = 1;
+    if(*end == 'K' || *end == 'k') scale = 1024.0, end++;
+    else if(*end == 'M' || *end == 'm') scale = 1024.0 * 1024, end++;
+    else if(*end == 'G' || *end == 'g') scale = 1024.0 * 1024 * 1024, end++;
+    if(*end != '\0') return false;
+    bytes = static_cast<size_t>(value * scale);
+    return true;
+}
+
+std::string formatSize(size_t bytes) {
+    char text[32];
+    if(bytes >= (1u << 20)) snprintf(text, sizeof(text), "%.4g MB", bytes / (1024.0 * 1024));
+    else if(bytes >= 1024) snprintf(text, sizeof(text), "%.4g KB", bytes / 1024.0);
+    else snprintf(text, sizeof(text), "%zu B", bytes);
+    return text;
+}
+
+std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> parts;
+    std::stringstream in(text);
+    std::string part;
+    while(std::getline(in, part, ',')) {
+        if(!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+long countNodes(const ExpressionPtr& expr) {
+    if(!expr) return 0;
+    switch(expr->type) {
+        case ASTNodeType::BIN_EXPR: {
+            auto bin = std::static_pointer_cast<BinExpr>(expr);
+            return 1 + countNodes(bin->left) + countNodes(bin->right);
+        }
+        case ASTNodeType::UN_EXPR:
+            return 1 + countNodes(std::static_pointer_cast<UnExpr>(expr)->operand);
+        case ASTNodeType::INDEX_EXPR:
+            return 1 + countNodes(std::static_pointer_cast<IndexExpr>(expr)->index);
+        case ASTNodeType::CALL_EXPR: {
+            long count = 1;
+            for(const auto& arg : std::static_pointer_cast<CallExpr>(expr)->args) count += countNodes(arg);
+            return count;
+        }
+        default:
+            return 1;
+    }
+}
+
+long countNodes(const std::vector<StatementPtr>& statements);
+
+long countNodes(const StatementPtr& stmt) {
+    if(!stmt) return 0;
+    switch(stmt->type) {
+        case ASTNodeType::DECL:
+            return 1 + countNodes(std::static_pointer_cast<DeclStmt>(stmt)->initializer);
+        case ASTNodeType::ASSIGN: {
+            auto assign = std::static_pointer_cast<AssignStmt>(stmt);
+            return 1 + countNodes(assign->index) + countNodes(assign->value);
+        }
+        case ASTNodeType::IF_STMT: {
+            auto branch = std::static_pointer_cast<IfStmt>(stmt);
+            return 1 + countNodes(branch->condition) + countNodes(branch->thenBranch) +
+                   countNodes(branch->elseBranch);
+        }
+        case ASTNodeType::WHILE_STMT: {
+            auto loop = std::static_pointer_cast<WhileStmt>(stmt);
+            return 1 + countNodes(loop->condition) + countNodes(loop->body);
+        }
+        case ASTNodeType::FOR_STMT: {
+            auto loop = std::static_pointer_cast<ForStmt>(stmt);
+            return 1 + countNodes(loop->init) + countNodes(loop->condition) + countNodes(loop->update) +
+                   countNodes(loop->body);
+        }
+        case ASTNodeType::BLOCK:
+            return 1 + countNodes(std::static_pointer_cast<BlockStmt>(stmt)->statements);
+        case ASTNodeType::RETURN_STMT:
+            return 1 + countNodes(std::static_pointer_cast<ReturnStmt>(stmt)->value);
+        case ASTNodeType::PRINT_STMT:
+            return 1 + countNodes(std::static_pointer_cast<PrintStmt>(stmt)->value);
+        case ASTNodeType::EXPR_STMT:
+            return 1 + countNodes(std::static_pointer_cast<ExprStmt>(stmt)->expr);
+        case ASTNodeType::FUNC_DECL:
+            return 1 + countNodes(std::static_pointer_cast<FuncDecl>(stmt)->body);
+        default:
+            return 1;
+    }
+}
+
+long countNodes(const std::vector<StatementPtr>& statements) {
+    long count = 0;
+    for(const auto& stmt : statements) count += countNodes(stmt);
+    return count;
+}
+
+long countInstructions(const IRProgram& ir) {
+    long count = static_cast<long>(ir.instructions.size());
+    for(const auto& func : ir.functions) count += static_cast<long>(func.instructions.size());
+    return count;
+}
+
+// One pass through the pipeline: milliseconds per phase plus what each
+// phase produced
+struct Run {
+    std::vector<std::pair<std::string, double>> millis;
+    long tokens = 0;
+    long nodes = 0;
+    long instructions = 0;  // IR from code generation
+    long steps = 0;         // IR ops executed
+};
+
+class Stopwatch {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+    double lap() {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::milli> spent = now - start;
+        start = now;
+        return spent.count();
+    }
+};
+
+bool runPipeline(const std::string& source, bool execute, Run& run) {
+    Stopwatch watch;
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    run.millis.push_back({"lex", watch.lap()});
+    run.tokens = static_cast<long>(tokens.size()) - 1;
+
+    Parser parser(tokens);
+    auto ast = parser.parse();
+    run.millis.push_back({"parse", watch.lap()});
+    if(!ast) return false;
+    run.nodes = 1 + countNodes(ast->statements);
+    watch.lap();
+
+    SemanticAnalyzer analyzer;
+    bool ok = analyzer.analyze(ast);
+    run.millis.push_back({"semantic", watch.lap()});
+    if(!ok) {
+        for(const auto& error : analyzer.getErrors()) fprintf(stderr, "Error: %s\n", error.c_str());
+        return false;
+    }
+
+    CodeGenerator codegen(analyzer);
+    auto ir = codegen.generate(ast);
+    run.millis.push_back({"codegen", watch.lap()});
+    run.instructions = countInstructions(ir);
+
+    Optimizer optimizer;
+    auto optimized = optimizer.optimize(ir);
+    run.millis.push_back({"optimize", watch.lap()});
+    for(const auto& [pass, millis] : optimizer.getStats().passMillis) {
+        run.millis.push_back({"optimize/" + pass, millis});
+    }
+
+    if(execute) {
+        Interpreter interpreter;
+        interpreter.setQuiet(true);
+        watch.lap();
+        if(!interpreter.execute(optimized)) return false;
+        run.millis.push_back({"interpret", watch.lap()});
+        run.steps = interpreter.getBudgetStats().steps;
+    }
+    return true;
+}
+
+// Phase table of one benchmark
+void report(const Benchmark& bench) {
+    printf("\n%s: %s, %ld tokens, %ld AST nodes, %ld IR instructions, %ld ops executed\n", bench.name.c_str(),
+           formatSize(bench.bytes).c_str(), bench.tokens, bench.nodes, bench.instructions, bench.steps);
+    printf("  %-18s %12s %12s   %s\n", "phase", "median", "fastest", "throughput (median)");
+    for(const auto& phase : bench.phases) {
+        double mid = medianOf(phase.millis);
+        double fastest = *std::min_element(phase.millis.begin(), phase.millis.end());
+        long count = 0;
+        const char* unit = "";
+        if(phase.name == "lex") count = bench.tokens, unit = "tokens/s";
+        else if(phase.name == "parse" || phase.name == "semantic") count = bench.nodes, unit = "AST nodes/s";
+        else if(phase.name == "codegen" || phase.name == "optimize") count = bench.instructions, unit = "IR instructions/s";
+        else if(phase.name == "interpret") count = bench.steps, unit = "IR ops/s";
+        // optimizer passes are indented under "optimize"
+        std::string label = phase.name.compare(0, 9, "optimize/") == 0 ? "  " + phase.name.substr(9) : phase.name;
+        printf("  %-18s %9.3f ms %9.3f ms", label.c_str(), mid, fastest);
+        if(count > 0 && mid > 0) {
+            double perSecond = count / mid * 1000.0;
+            if(perSecond >= 1e6) printf("   %8.2f M %s", perSecond / 1e6, unit);
+            else printf("   %8.2f K %s", perSecond / 1e3, unit);
+        }
+        printf("\n");
+    }
+}
+
+bool measure(const std::string& title, const std::string& source, int warmup, int repeats, bool execute,
+             BenchReport& results) {
+    Benchmark bench;
+    bench.name = title;
+    bench.bytes = static_cast<long>(source.size());
+    for(int i = 0; i < warmup + repeats; i++) {
+        Run run;
+        if(!runPipeline(source, execute, run)) {
+            fprintf(stderr, "Error: %s does not compile and run\n", title.c_str());
+            return false;
+        }
+        if(i < warmup) continue;
+        if(bench.phases.empty()) {
+            bench.tokens = run.tokens;
+            bench.nodes = run.nodes;
+            bench.instructions = run.instructions;
+            bench.steps = run.steps;
+            for(const auto& [phase, millis] : run.millis) bench.phases.push_back({phase, {}});
+        }
+        for(size_t p = 0; p < run.millis.size() && p < bench.phases.size(); p++) {
+            bench.phases[p].millis.push_back(run.millis[p].second);
+        }
+    }
+    report(bench);
+    results.benchmarks.push_back(std::move(bench));
+    return true;
+}
+
+// Differential mode: every program compiled at every optimization level
+// and run on every engine must print the same lines
+struct Level {
+    const char* name;
+    bool optimize, inlining, vectorize, autoParallel;
+};
+const Level LEVELS[] = {
+    {"O0", false, false, false, false},  // as generated
+    {"O1", true, false, false, false},   // scalar passes only
+    {"O2", true, true, true, false},     // the compiler's default
+    {"O3", true, true, true, true},      // plus auto-parallelization
+};
+
+enum class Engine { SWITCH, SWITCH_NOTRACE, SWITCH_NOSUPER, CLOSURE, INSTANCE, BATCH };
+const Engine ENGINES[] = {Engine::SWITCH, Engine::SWITCH_NOTRACE, Engine::SWITCH_NOSUPER,
+                          Engine::CLOSURE, Engine::INSTANCE, Engine::BATCH};
+
+const char* engineName(Engine engine) {
+    static const char* const names[] = {"switch", "switch-notrace", "switch-nosuper", "closure", "instance", "batch"};
+    return names[static_cast<int>(engine)];
+}
+
+constexpr size_t LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+constexpr size_t ENGINE_COUNT = sizeof(ENGINES) / sizeof(ENGINES[0]);
+constexpr size_t REFERENCE = 1;                     // O0 on switch-notrace: output every other run must match
+constexpr size_t BASELINE = 2 * ENGINE_COUNT;       // O2 on switch: the time others are relative to
+constexpr double NOISE_MILLIS = 0.2;                // runs this short are never flagged as slow
+
+constexpr int DIFF_INPUTS = 3;    // values each generated program reads with input()
+constexpr int DIFF_RECORDS = 16;  // input records per program
+
+using Record = std::vector<int>;
+
+struct Outcome {
+    bool ok = false;
+    std::string error;
+    std::vector<std::string> output;  // of every record, in record order
+    std::vector<size_t> recordEnds;   // per record: end of its lines in output (not for batch)
+    double millis = 0;  // median execution time
+};
+
+bool frontEnd(const std::string& source, IRProgram& ir) {
+    Lexer lexer(source);
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parse();
+    if(!ast) return false;
+    SemanticAnalyzer analyzer;
+    if(!analyzer.analyze(ast)) return false;
+    CodeGenerator codegen(analyzer);
+    ir = codegen.generate(ast);
+    return true;
+}
+
+// Runs `ir` once per record; the batch engine takes all records in one
+// execute(). Only the execution is timed, not constructing or linking.
+Outcome runOn(Engine engine, const IRProgram& ir, const std::vector<Record>& records) {
+    Outcome outcome;
+    outcome.ok = true;
+    auto append = [&](size_t r, bool ok, const std::string& error, const std::vector<std::string>& output) {
+        outcome.output.insert(outcome.output.end(), output.begin(), output.end());
+        outcome.recordEnds.push_back(outcome.output.size());
+        if(!ok && outcome.ok) {
+            outcome.ok = false;
+            outcome.error = "record " + std::to_string(r + 1) + ": " + (error.empty() ? "runtime error" : error);
+        }
+    };
+    switch(engine) {
+        case Engine::CLOSURE: {
+            ClosureInterpreter closure;
+            closure.setQuiet(true);
+            for(size_t r = 0; r < records.size(); r++) {
+                closure.setInput(records[r].data(), records[r].size());
+                Stopwatch watch;
+                bool ok = closure.execute(ir);
+                outcome.millis += watch.lap();
+                append(r, ok, "", closure.getOutput());
+            }
+            break;
+        }
+        case Engine::INSTANCE: {
+            Scheduler scheduler;
+            scheduler.setThreads(1);
+            try {
+                int program = scheduler.addProgram(ir);
+                for(const auto& record : records) scheduler.spawn(program, record);
+                Stopwatch watch;
+                scheduler.run();
+                outcome.millis = watch.lap();
+            } catch(const std::exception& e) {
+                outcome.ok = false;
+                outcome.error = e.what();
+                break;
+            }
+            for(size_t r = 0; r < records.size(); r++) {
+                const auto& result = scheduler.result(static_cast<int>(r));
+                append(r, result.ok, result.error, result.output);
+            }
+            break;
+        }
+        case Engine::BATCH: {
+            BatchInterpreter batch;
+            batch.setQuiet(true);
+            std::string text;
+            for(const auto& record : records) {
+                for(int value : record) text += std::to_string(value) + " ";
+                text += "\n";
+            }
+            std::istringstream in(text);
+            Stopwatch watch;
+            outcome.ok = batch.execute(ir, in);
+            outcome.millis = watch.lap();
+            outcome.output = batch.getOutput();
+            if(!outcome.ok) outcome.error = std::to_string(batch.getStats().failed) + " records failed";
+            break;
+        }
+        default: {
+            Interpreter interpreter;
+            interpreter.setQuiet(true);
+            interpreter.setTracing(engine != Engine::SWITCH_NOTRACE);
+            interpreter.setSuperinstructions(engine != Engine::SWITCH_NOSUPER);
+            for(size_t r = 0; r < records.size(); r++) {
+                interpreter.setInput(records[r].data(), records[r].size());
+                Stopwatch watch;
+                bool ok = interpreter.execute(ir);
+                outcome.millis += watch.lap();
+                append(r, ok, interpreter.getError(), interpreter.getOutput());
+            }
+            break;
+        }
+    }
+    return outcome;
+}
+
+std::string configName(size_t config) {
+    return std::string(LEVELS[config / ENGINE_COUNT].name) + "/" + engineName(ENGINES[config % ENGINE_COUNT]);
+}
+
+// First difference of `outcome` from `reference`, by record of the
+// reference's scalar runs
+std::string difference(const Outcome& reference, const Outcome& outcome, const std::vector<Record>& records) {
+    if(reference.ok != outcome.ok) {
+        return outcome.ok ? "succeeded, the reference failed" : "failed: " + outcome.error;
+    }
+    size_t lines = std::max(reference.output.size(), outcome.output.size());
+    for(size_t i = 0; i < lines; i++) {
+        std::string want = i < reference.output.size() ? reference.output[i] : "(none)";
+        std::string got = i < outcome.output.size() ? outcome.output[i] : "(none)";
+        if(want == got) continue;
+        size_t record = 0, first = 0;
+        while(record + 1 < reference.recordEnds.size() && reference.recordEnds[record] <= i) {
+            first = reference.recordEnds[record++];
+        }
+        std::string input;
+        for(int value : records[record]) input += (input.empty() ? "" : " ") + std::to_string(value);
+        return "record " + std::to_string(record + 1) + " (input " + input + "), line " +
+               std::to_string(i - first + 1) + ": " + got + ", expected " + want;
+    }
+    return "";
+}
+
+// Runs `count` generated programs through every level and engine; false
+// if any output differs from the reference
+bool differential(int count, const std::vector<std::string>& sizes, const std::vector<ProgramGenerator::Mix>& mixes,
+                  uint64_t seed, int warmup, int repeats, double slowdown) {
+    constexpr size_t CONFIGS = LEVEL_COUNT * ENGINE_COUNT;
+    std::vector<std::vector<double>> ratios(CONFIGS);  // run time / baseline, per program
+    std::vector<int> mismatches(CONFIGS), slow(CONFIGS);
+    std::vector<std::vector<double>> optimizeMillis(LEVEL_COUNT);
+    std::vector<std::string> problems;
+    int programs = 0;
+
+    printf("lab3 differential run: %d programs x %d input records x %zu levels x %zu engines, "
+           "%d warmup + %d measured runs each\n",
+           count, DIFF_RECORDS, LEVEL_COUNT, ENGINE_COUNT, warmup, repeats);
+    for(int p = 0; p < count; p++) {
+        const std::string& size = sizes[p % sizes.size()];
+        ProgramGenerator::Mix mix = mixes[p % mixes.size()];
+        uint64_t programSeed = seed + static_cast<uint64_t>(p);
+        size_t bytes = 0;
+        parseSize(size, bytes);
+        ProgramGenerator generator(programSeed, mix);
+        generator.setInputs(DIFF_INPUTS);
+        std::string source = generator.generate(bytes);
+        std::vector<Record> records(DIFF_RECORDS);
+        std::mt19937 values(static_cast<uint32_t>(programSeed));  // raw output is the same everywhere
+        for(auto& record : records) {
+            for(int i = 0; i < DIFF_INPUTS; i++) record.push_back(static_cast<int>(values() % 10007));
+        }
+        std::string title = std::string(ProgramGenerator::name(mix)) + " " + size + " seed " + std::to_string(programSeed);
+        std::string reproduce = "-generate " + size + " -mix " + ProgramGenerator::name(mix) + " -seed " +
+                                std::to_string(programSeed) + " -inputs " + std::to_string(DIFF_INPUTS);
+
+        IRProgram ir;
+        if(!frontEnd(source, ir)) {
+            problems.push_back(title + ": does not compile (" + reproduce + ")");
+            continue;
+        }
+        programs++;
+        std::vector<Outcome> outcomes(CONFIGS);
+        for(size_t l = 0; l < LEVEL_COUNT; l++) {
+            const Level& level = LEVELS[l];
+            IRProgram code = ir;
+            if(level.optimize) {
+                InlineConfig inlineConfig;
+                inlineConfig.enabled = level.inlining;
+                Optimizer optimizer(inlineConfig);
+                optimizer.setVectorize(level.vectorize);
+                optimizer.setAutoParallel(level.autoParallel);
+                Stopwatch watch;
+                code = optimizer.optimize(ir);
+                optimizeMillis[l].push_back(watch.lap());
+            }
+            for(size_t e = 0; e < ENGINE_COUNT; e++) {
+                std::vector<double> times;
+                Outcome& outcome = outcomes[l * ENGINE_COUNT + e];
+                for(int r = 0; r < warmup + repeats; r++) {
+                    outcome = runOn(ENGINES[e], code, records);
+                    if(r >= warmup) times.push_back(outcome.millis);
+                }
+                outcome.millis = medianOf(times);
+            }
+        }
+
+        double typical = 0;
+        {
+            std::vector<double> all;
+            for(const auto& outcome : outcomes) all.push_back(outcome.millis);
+            typical = medianOf(all);
+        }
+        const Outcome& reference = outcomes[REFERENCE];
+        if(!reference.ok) problems.push_back(title + ": reference run failed: " + reference.error);
+        for(size_t c = 0; c < CONFIGS; c++) {
+            std::string diff = difference(reference, outcomes[c], records);
+            if(!diff.empty()) {
+                mismatches[c]++;
+                problems.push_back(title + " on " + configName(c) + ": " + diff + " (" + reproduce + ")");
+            }
+            if(outcomes[BASELINE].millis > 0) ratios[c].push_back(outcomes[c].millis / outcomes[BASELINE].millis);
+            if(outcomes[c].millis > NOISE_MILLIS && outcomes[c].millis > slowdown * typical) {
+                slow[c]++;
+                char text[64];
+                snprintf(text, sizeof(text), "%.2f ms, %.1fx the median configuration", outcomes[c].millis,
+                         outcomes[c].millis / typical);
+                problems.push_back(title + " on " + configName(c) + ": slow, " + text + " (" + reproduce + ")");
+            }
+        }
+    }
+
+    printf("\n  %-24s %10s %14s %10s %6s\n", "configuration", "mismatches", "time vs O2/switch", "worst", "slow");
+    bool ok = true;
+    for(size_t c = 0; c < CONFIGS; c++) {
+        double logSum = 0, worst = 0;
+        for(double ratio : ratios[c]) {
+            logSum += std::log(std::max(ratio, 1e-9));
+            worst = std::max(worst, ratio);
+        }
+        double geomean = ratios[c].empty() ? 0 : std::exp(logSum / ratios[c].size());
+        printf("  %-24s %10d %13.2fx %9.2fx %6d%s\n", configName(c).c_str(), mismatches[c], geomean, worst, slow[c],
+               c == REFERENCE ? "  (reference output)" : "");
+        ok = ok && mismatches[c] == 0;
+    }
+    printf("\n  Optimizer time per program (median):");
+    for(size_t l = 0; l < LEVEL_COUNT; l++) {
+        if(!optimizeMillis[l].empty()) printf(" %s %.3f ms", LEVELS[l].name, medianOf(optimizeMillis[l]));
+    }
+    printf("\n");
+    for(const auto& problem : problems) printf("  %s\n", problem.c_str());
+    printf("\nDifferential: %d programs, %s\n", programs, ok ? "all outputs identical" : "OUTPUTS DIFFER");
+    return ok && programs == count;
+}
+
+// Prints the deltas of `current` against `baseline`; false on regressions
+bool printComparison(const BenchReport& baseline, const BenchReport& current, double threshold) {
+    printf("\nBaseline: commit %s, %s, %s\n", baseline.get("commit").c_str(), baseline.get("date").c_str(),
+           baseline.get("cpu").c_str());
+    printf("Current:  commit %s, %s, %s\n", current.get("commit").c_str(), current.get("date").c_str(),
+           current.get("cpu").c_str());
+    if(baseline.get("cpu") != current.get("cpu") || baseline.get("host") != current.get("host")) {
+        printf("Warning: reports come from different machines\n");
+    }
+
+    Comparison result = compare(baseline, current, threshold);
+    std::string benchmark;
+    for(const auto& d : result.deltas) {
+        if(d.benchmark != benchmark) {
+            benchmark = d.benchmark;
+            printf("\n%s\n  %-18s %12s %12s %9s   %s\n", benchmark.c_str(), "phase", "baseline", "current", "delta",
+                   "95% interval");
+        }
+        std::string label = d.phase.compare(0, 9, "optimize/") == 0 ? "  " + d.phase.substr(9) : d.phase;
+        const char* verdict = d.verdict > 0 ? "  REGRESSION" : d.verdict < 0 ? "  improvement" : "";
+        printf("  %-18s %9.3f ms %9.3f ms %+8.1f%%   [%+.1f%%, %+.1f%%]%s\n", label.c_str(), d.baseline, d.current,
+               d.delta * 100, d.low * 100, d.high * 100, verdict);
+    }
+    for(const auto& name : result.unmatched) printf("\nNot compared: %s\n", name.c_str());
+    printf("\nComparison: %d regressions, %d improvements beyond %.1f%% (95%% confidence), %zu phases\n",
+           result.regressions, result.improvements, threshold * 100, result.deltas.size());
+    return result.regressions == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> sizes = {"1K", "64K"};
+    std::vector<ProgramGenerator::Mix> mixes(std::begin(ProgramGenerator::MIXES), std::end(ProgramGenerator::MIXES));
+    uint64_t seed = 1;
+    int warmup = 1;
+    int repeats = 5;
+    bool execute = true;
+    double threshold = 0.05;
+    const char* sourceFile = nullptr;
+    const char* generateSize = nullptr;
+    const char* outputFile = nullptr;
+    int inputs = 0;
+    const char* jsonFile = nullptr;
+    const char* baselineFile = nullptr;
+    const char* compareFiles[2] = {nullptr, nullptr};
+    int diffPrograms = 0;
+    double slowdown = 4;
+    bool sizesGiven = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-sizes") == 0 && i + 1 < argc) {
+            sizes = split(argv[++i]);
+            sizesGiven = true;
+        } else if(strcmp(argv[i], "-mix") == 0 && i + 1 < argc) {
+            std::string list = argv[++i];
+            if(list != "all") {
+                mixes.clear();
+                for(const auto& name : split(list)) {
+                    ProgramGenerator::Mix mix;
+                    if(!ProgramGenerator::parse(name, mix)) {
+                        fprintf(stderr, "Error: Unknown mix '%s'\n", name.c_str());
+                        return 1;
+                    }
+                    mixes.push_back(mix);
+                }
+            }
+        } else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if(strcmp(argv[i], "-warmup") == 0 && i + 1 < argc) {
+            warmup = std::max(atoi(argv[++i]), 0);
+        } else if(strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+            repeats = std::max(atoi(argv[++i]), 1);
+        } else if(strcmp(argv[i], "-file") == 0 && i + 1 < argc) {
+            sourceFile = argv[++i];
+        } else if(strcmp(argv[i], "-noexec") == 0) {
+            execute = false;
+        } else if(strcmp(argv[i], "-generate") == 0 && i + 1 < argc) {
+            generateSize = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if(strcmp(argv[i], "-inputs") == 0 && i + 1 < argc) {
+            inputs = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if(strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if(strcmp(argv[i], "-compare") == 0 && i + 2 < argc) {
+            compareFiles[0] = argv[++i];
+            compareFiles[1] = argv[++i];
+        } else if(strcmp(argv[i], "-threshold") == 0 && i + 1 < argc) {
+            threshold = std::max(atof(argv[++i]), 0.0) / 100;
+        } else if(strcmp(argv[i], "-diff") == 0 && i + 1 < argc) {
+            diffPrograms = std::max(atoi(argv[++i]), 1);
+        } else if(strcmp(argv[i], "-slowdown") == 0 && i + 1 < argc) {
+            slowdown = std::max(atof(argv[++i]), 1.0);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(generateSize) {
+        size_t bytes = 0;
+        if(!parseSize(generateSize, bytes)) {
+            fprintf(stderr, "Error: Bad size '%s'\n", generateSize);
+            return 1;
+        }
+        ProgramGenerator generator(seed, mixes.size() == 1 ? mixes.front() : ProgramGenerator::Mix::MIXED);
+        generator.setInputs(inputs);
+        if(!outputFile) {
+            generator.generate(std::cout, bytes);
+            return 0;
+        }
+        std::ofstream out(outputFile);
+        generator.generate(out, bytes);
+        if(!out) {
+            fprintf(stderr, "Error: Cannot write file '%s'\n", outputFile);
+            return 1;
+        }
+        return 0;
+    }
+
+    for(const auto& size : sizes) {
+        size_t bytes = 0;
+        if(!parseSize(size, bytes)) {
+            fprintf(stderr, "Error: Bad size '%s'\n", size.c_str());
+            return 1;
+        }
+    }
+    if(diffPrograms > 0) {
+        if(!sizesGiven) sizes = {"4K"};
+        return differential(diffPrograms, sizes, mixes, seed, warmup, repeats, slowdown) ? 0 : 1;
+    }
+
+    std::string error;
+    if(compareFiles[0]) {
+        BenchReport baseline, current;
+        if(!baseline.load(compareFiles[0], error) || !current.load(compareFiles[1], error)) {
+            fprintf(stderr, "Error: %s\n", error.c_str());
+            return 1;
+        }
+        return printComparison(baseline, current, threshold) ? 0 : 1;
+    }
+    BenchReport baseline;
+    if(baselineFile && !baseline.load(baselineFile, error)) {
+        fprintf(stderr, "Error: %s\n", error.c_str());
+        return 1;
+    }
+
+    BenchReport results;
+    results.describeEnvironment();
+    results.metadata.push_back({"warmup", std::to_string(warmup)});
+    results.metadata.push_back({"runs", std::to_string(repeats)});
+    printf("lab3 benchmark: %d warmup + %d measured runs per program\n", warmup, repeats);
+    bool ok = true;
+    if(sourceFile) {
+        std::ifstream in(sourceFile);
+        if(!in.is_open()) {
+            fprintf(stderr, "Error: Cannot open file '%s'\n", sourceFile);
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        ok = measure(sourceFile, buffer.str(), warmup, repeats, execute, results);
+    } else {
+        results.metadata.push_back({"seed", std::to_string(seed)});
+        for(const auto& size : sizes) {
+            size_t bytes = 0;
+            if(!parseSize(size, bytes)) {
+                fprintf(stderr, "Error: Bad size '%s'\n", size.c_str());
+                return 1;
+            }
+            for(auto mix : mixes) {
+                std::string source = ProgramGenerator(seed, mix).generate(bytes);
+                std::string title = std::string(ProgramGenerator::name(mix)) + " " + size + " (seed " +
+                                    std::to_string(seed) + ")";
+                ok = measure(title, source, warmup, repeats, execute, results) && ok;
+            }
+        }
+    }
+
+    if(jsonFile) {
+        if(!results.save(jsonFile)) {
+            fprintf(stderr, "Error: Cannot write file '%s'\n", jsonFile);
+            return 1;
+        }
+        printf("\nResults written to %s\n", jsonFile);
+    }
+    if(baselineFile) ok = printComparison(baseline, results, threshold) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file cache.h
+ * @brief Result cache - output of input-free programs keyed by their IR
+ *
+ * A program that never calls input() prints the same lines and ends with
+ * the same status every time it runs, so its run can be replayed from a
+ * cache. The key is a 128-bit hash of the optimized IR in a canonical
+ * text form (instructions, function frames, array sizes, global slot
+ * count), the compiler version with its build stamp, and the execution
+ * limits that can change the outcome. Entries live in memory and,
+ * optionally, as one file per key in a cache directory.
+ *
+ * The directory records the version that wrote it; opening it from
+ * another compiler build deletes the old entries, and every entry file
+ * repeats its version and key, so a stale or foreign file is a miss.
+ */
+
+#pragma once
+
+#include "ir.h"
+#include "interpreter.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+// Bump when the language or interpreter semantics change
+#define LAB3_COMPILER_VERSION "1.0"
+
+struct CachedRun {
+    bool ok = true;
+    std::string error;                // runtime error message when !ok
+    std::vector<std::string> output;  // printed lines
+};
+
+struct CacheStats {
+    long hits = 0;
+    long diskHits = 0;  // hits loaded from the directory
+    long misses = 0;
+    long stores = 0;
+    long invalidated = 0;  // entry files removed for a version change
+};
+
+class ResultCache {
+    std::string directory;  // empty: memory only
+    std::unordered_map<std::string, CachedRun> entries;
+    CacheStats stats;
+
+    static constexpr const char* MAGIC = "lab3-result-cache 1";
+    static constexpr const char* SUFFIX = ".result";
+
+public:
+    // Compiler version and build stamp; entries of other builds never match
+    static std::string version() {
+        return std::string(LAB3_COMPILER_VERSION) + " " + __DATE__ + " " + __TIME__;
+    }
+
+    // Disk-backed when `dir` is not empty; the directory is created, and
+    // emptied if an older compiler wrote it
+    explicit ResultCache(std::string dir = "") : directory(std::move(dir)) {
+        if(directory.empty()) return;
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        fs::path stamp = fs::path(directory) / "VERSION";
+        std::ifstream in(stamp);
+        std::string written;
+        std::getline(in, written);
+        if(written == version()) return;
+        for(const auto& entry : fs::directory_iterator(directory, ec)) {
+            if(entry.path().extension() == SUFFIX && fs::remove(entry.path(), ec)) stats.invalidated++;
+        }
+        std::ofstream(stamp) << version() << "\n";
+    }
+
+    // Only programs without input() have a single possible run
+    static bool cacheable(const IRProgram& program) {
+        auto reads = [](const std::vector<Instruction>& body) {
+            return std::any_of(body.begin(), body.end(), [](const Instruction& instr) {
+                return instr.type == InstrType::INPUT;
+            });
+        };
+        if(reads(program.instructions)) return false;
+        for(const auto& func : program.functions) {
+            if(reads(func.instructions)) return false;
+        }
+        return true;
+    }
+
+    static std::string key(const IRProgram& program, const ExecutionLimits& limits) {
+        std::string text = version() + "\n" + canonical(program);
+        // Time limits only decide whether a run may be stored
+        text += "limits " + std::to_string(limits.steps) + " " + std::to_string(limits.outputBytes) +
+                " " + std::to_string(limits.frameBytes) + "\n";
+        return hash(text);
+    }
+
+    // 128 bits as 32 hex digits: two FNV-1a passes with different seeds
+    static std::string hash(const std::string& text) {
+        char hex[33];
+        snprintf(hex, sizeof(hex), "%016llx%016llx",
+                 static_cast<unsigned long long>(fnv1a(text, 0xcbf29ce484222325ull)),
+                 static_cast<unsigned long long>(fnv1a(text, 0x84222325cbf29ce4ull)));
+        return hex;
+    }
+
+    bool lookup(const std::string& key, CachedRun& run) {
+        auto it = entries.find(key);
+        if(it == entries.end() && load(key)) {
+            stats.diskHits++;
+            it = entries.find(key);
+        }
+        if(it == entries.end()) {
+            stats.misses++;
+            return false;
+        }
+        stats.hits++;
+        run = it->second;
+        return true;
+    }
+
+    void store(const std::string& key, const CachedRun& run) {
+        entries[key] = run;
+        stats.stores++;
+        if(!directory.empty()) save(key, run);
+    }
+
+    const CacheStats& getStats() const { return stats; }
+
+    // IR text that determines a run: everything the interpreter links
+    static std::string canonical(const IRProgram& program) {
+        std::string text;
+        auto sortedSizes = [](const std::unordered_map<std::string, int>& sizes) {
+            std::vector<std::pair<std::string, int>> sorted(sizes.begin(), sizes.end());
+            std::sort(sorted.begin(), sorted.end());
+            std::string s;
+            for(const auto& [name, size] : sorted) s += " " + name + "[" + std::to_string(size) + "]";
+            return s;
+        };
+        text += "globals " + std::to_string(program.globalCount) + sortedSizes(program.arraySizes) + "\n";
+        for(const auto& instr : program.instructions) text += instr.toString() + "\n";
+        for(const auto& func : program.functions) {
+            text += "function " + func.signature() + " frame " + std::to_string(func.frameSize) +
+                    sortedSizes(func.arraySizes) + "\n";
+            for(const auto& instr : func.instructions) text += instr.toString() + "\n";
+        }
+        return text;
+    }
+
+private:
+    static uint64_t fnv1a(const std::string& text, uint64_t hash) {
+        for(unsigned char c : text) hash = (hash ^ c) * 0x100000001b3ull;
+        return hash;
+    }
+
+    std::string path(const std::string& key) const {
+        return (std::filesystem::path(directory) / (key + SUFFIX)).string();
+    }
+
+    // Entry file: magic, version, key, status, error, line count, lines
+    bool load(const std::string& key) {
+        if(directory.empty()) return false;
+        std::ifstream in(path(key));
+        std::string magic, written, storedKey, status, error, count;
+        if(!std::getline(in, magic) || magic != MAGIC) return false;
+        if(!std::getline(in, written) || written != version()) return false;
+        if(!std::getline(in, storedKey) || storedKey != key) return false;
+        if(!std::getline(in, status) || !std::getline(in, error) || !std::getline(in, count)) return false;
+        CachedRun run;
+        run.ok = status == "ok";
+        run.error = error;
+        long lines = std::atol(count.c_str());
+        for(long i = 0; i < lines; i++) {
+            std::string line;
+            if(!std::getline(in, line)) return false;  // truncated
+            run.output.push_back(line);
+        }
+        entries[key] = std::move(run);
+        return true;
+    }
+
+    // Written to a temporary file and renamed, so readers never see half an entry
+    void save(const std::string& key, const CachedRun& run) const {
+        std::string target = path(key);
+        std::string temp = target + ".tmp";
+        {
+            std::ofstream out(temp);
+            if(!out) return;
+            out << MAGIC << "\n" << version() << "\n" << key << "\n"
+                << (run.ok ? "ok" : "error") << "\n" << run.error << "\n" << run.output.size() << "\n";
+            for(const auto& line : run.output) out << line << "\n";
+            if(!out) return;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp, target, ec);
+    }
+};
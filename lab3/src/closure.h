@@ -0,0 +1,787 @@
+/**
+ * @file closure.h
+ * @brief Closure-compiled interpreter - executes TAC as pre-bound handlers
+ *
+ * The program is compiled once into an array of nodes. Each node holds a
+ * handler function specialized for its opcode and operand kinds, plus the
+ * operands already bound: globals and constants as cell pointers, frame
+ * slots as offsets from the frame pointer. Executing a node is a call to
+ * its handler, which does the work and continues with the next node; no
+ * opcode switch, operand kind switch or label lookup is left at run time.
+ * Unconditional jumps are threaded away while binding: a node's successor
+ * is the final destination of any chain of gotos.
+ *
+ * With a must-tail-call attribute (clang, GCC 15) each handler tail-calls
+ * the next one, so execution is a chain of indirect jumps. Otherwise the
+ * handler returns the next node to a trampoline loop.
+ *
+ * Calls use fixed-size frames on a value stack like the switch-based
+ * Interpreter. Parallel loops run serially (a `parallel for` is
+ * equivalent to its serial loop), with the bound evaluated once into a
+ * hidden slot. Pure-function memoization is not supported.
+ */
+
+#pragma once
+
+#include "ir.h"
+#include "simd.h"
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <memory>
+#include <cstdio>
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define CLOSURE_MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define CLOSURE_MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+// Continues with node `n` from a handler
+#ifdef CLOSURE_MUSTTAIL
+#define CLOSURE_NEXT(n) do { const Node* next_ = (n); CLOSURE_MUSTTAIL return next_->run(next_, s); } while(0)
+#else
+#define CLOSURE_NEXT(n) return ((void)s, (n))
+#endif
+
+struct ClosureStats {
+    int nodes = 0;           // handler records in the compiled program
+    int threadedJumps = 0;   // gotos removed by binding successors
+};
+
+class ClosureInterpreter {
+public:
+    static constexpr int STACK_SLOTS = 1 << 20;
+    static constexpr int MAX_CALL_DEPTH = 100000;
+
+private:
+    struct Node;
+    struct State;
+    using Handler = const Node* (*)(const Node*, State&);
+
+    // Bound operand; the handler knows which member is meaningful
+    union Ref {
+        int* cell;             // global or constant
+        std::ptrdiff_t offset; // frame slot
+    };
+
+    enum Kind : unsigned char { FRAME_DST = 1, FRAME_A = 2, FRAME_B = 4 };
+
+    struct Node {
+        Handler run = nullptr;
+        const Node* next = nullptr;
+        const Node* target = nullptr;  // branch target, callee entry, loop exit or body
+        Ref dst{}, a{}, b{};
+        int size = 0;    // array size or callee frame size
+        int index = 0;   // callee, vector kernel or first argument
+        int count = 0;   // argument count
+        unsigned char kinds = 0;  // Kind bits, for handlers that are not specialized
+    };
+
+    struct CallRecord {
+        const Node* call;  // the CALL node: result slot and return point
+        int* fp;
+    };
+
+    struct State {
+        ClosureInterpreter* vm;
+        int* fp;
+        int* sp;
+        int* limit;
+        std::vector<CallRecord> callStack;
+        int result = 0;
+    };
+
+    // ---------- Linking: IR -> unbound ops ----------
+
+    enum class Code : unsigned char {
+        BIN, UN, MOVE, JUMP, JUMP_IF_ZERO, LOAD, STORE, PRINT, INPUT,
+        CALL, RET, VECTOR, LOOP_BEGIN, LOOP_END, HALT
+    };
+
+    struct Spec {
+        enum Kind : unsigned char { CONST, GLOBAL, LOCAL } kind = CONST;
+        int index = 0;  // constant pool, global or frame slot
+    };
+
+    struct Op {
+        Code code = Code::HALT;
+        BinOp binOp = BinOp::ADD;
+        UnOp unOp = UnOp::NEG;
+        bool checked = true;
+        Spec dst, a, b;
+        int target = 0;
+        int size = 0;
+        int index = 0;
+        int count = 0;
+    };
+
+    struct VecKernel {
+        BinOp op = BinOp::ADD;
+        bool reduce = false;
+        Spec dst, lo, hi;
+        int dstSize = 0;
+        Spec src[2];
+        bool array[2] = {false, false};
+        int offset[2] = {0, 0};
+        int size[2] = {0, 0};
+    };
+
+    struct BoundKernel {
+        VecKernel spec;
+        Ref dst, lo, hi, src[2];
+    };
+
+    std::vector<Op> ops;
+    std::vector<Spec> argSpecs;
+    std::vector<VecKernel> vecSpecs;
+    std::vector<int> entries;      // first op of each function
+    std::vector<int> frameSizes;   // including hidden loop-bound slots
+    std::vector<std::string> names;
+
+    std::vector<Node> nodes;
+    std::vector<std::pair<Ref, bool>> args;  // bound argument, frame slot?
+    std::vector<BoundKernel> kernels;
+    std::vector<int> constants;
+    std::vector<int> globals;
+    std::unique_ptr<int[]> stack;  // uninitialized: call() zeroes each frame
+    std::vector<long> calls;
+
+    std::vector<std::string> output;
+    const int* input = nullptr;
+    size_t inputCount = 0;
+    size_t inputPos = 0;
+    bool quiet = false;
+    ClosureStats stats;
+
+public:
+    void setQuiet(bool value) { quiet = value; }
+
+    // Values returned by input(), in order; the caller keeps them alive
+    void setInput(const int* values, size_t count) {
+        input = values;
+        inputCount = count;
+        inputPos = 0;
+    }
+
+    bool execute(const IRProgram& program) {
+        output.clear();
+        stats = ClosureStats();
+        bool ok = true;
+        try {
+            link(program);
+            bind();
+            if(!stack) stack.reset(new int[STACK_SLOTS]);
+            calls.assign(entries.size(), 0);
+
+            State state;
+            state.vm = this;
+            state.fp = state.sp = stack.get();
+            state.limit = stack.get() + STACK_SLOTS;
+            state.callStack.reserve(1024);
+            run(&nodes[0], state);
+        } catch(const std::exception& e) {
+            fprintf(stderr, "Runtime error: %s\n", e.what());
+            ok = false;
+        }
+        return ok;
+    }
+
+    const std::vector<std::string>& getOutput() const { return output; }
+
+    const ClosureStats& getStats() const { return stats; }
+
+    // Dynamic call count per function from the last run
+    std::unordered_map<std::string, long> getCallCounts() const {
+        std::unordered_map<std::string, long> counts;
+        for(size_t i = 0; i < names.size() && i < calls.size(); i++) counts[names[i]] = calls[i];
+        return counts;
+    }
+
+private:
+    static void run(const Node* node, State& s) {
+#ifdef CLOSURE_MUSTTAIL
+        node->run(node, s);
+#else
+        while(node) node = node->run(node, s);
+#endif
+    }
+
+    // ---------- Handlers ----------
+
+    template<bool Frame>
+    static int& at(const Ref& r, State& s) {
+        if constexpr(Frame) return s.fp[r.offset];
+        else return *r.cell;
+    }
+
+    static int& at(const Ref& r, bool frame, State& s) {
+        return frame ? s.fp[r.offset] : *r.cell;
+    }
+
+    template<BinOp Op>
+    static int apply(int left, int right) {
+        if constexpr(Op == BinOp::ADD) return left + right;
+        else if constexpr(Op == BinOp::SUB) return left - right;
+        else if constexpr(Op == BinOp::MUL) return left * right;
+        else if constexpr(Op == BinOp::DIV) {
+            if(right == 0) throw std::runtime_error("Division by zero");
+            return simd::divide(left, right);
+        } else if constexpr(Op == BinOp::MOD) {
+            if(right == 0) throw std::runtime_error("Modulo by zero");
+            return simd::remainder(left, right);
+        }
+        else if constexpr(Op == BinOp::EQ) return left == right;
+        else if constexpr(Op == BinOp::NE) return left != right;
+        else if constexpr(Op == BinOp::LT) return left < right;
+        else if constexpr(Op == BinOp::GT) return left > right;
+        else if constexpr(Op == BinOp::LE) return left <= right;
+        else if constexpr(Op == BinOp::GE) return left >= right;
+        else if constexpr(Op == BinOp::AND) return left && right;
+        else return left || right;
+    }
+
+    template<BinOp Op, bool D, bool A, bool B>
+    static const Node* bin(const Node* n, State& s) {
+        at<D>(n->dst, s) = apply<Op>(at<A>(n->a, s), at<B>(n->b, s));
+        CLOSURE_NEXT(n->next);
+    }
+
+    template<UnOp Op, bool D, bool A>
+    static const Node* unary(const Node* n, State& s) {
+        int value = at<A>(n->a, s);
+        at<D>(n->dst, s) = (Op == UnOp::NEG) ? -value : !value;
+        CLOSURE_NEXT(n->next);
+    }
+
+    template<bool D, bool A>
+    static const Node* move(const Node* n, State& s) {
+        at<D>(n->dst, s) = at<A>(n->a, s);
+        CLOSURE_NEXT(n->next);
+    }
+
+    template<bool A>
+    static const Node* jumpIfZero(const Node* n, State& s) {
+        CLOSURE_NEXT(at<A>(n->a, s) == 0 ? n->target : n->next);
+    }
+
+    static const Node* jump(const Node* n, State& s) {
+        CLOSURE_NEXT(n->target);
+    }
+
+    // Array element base[index]; the base is the array's first slot
+    template<bool Checked, bool Base>
+    static int& element(const Node* n, const Ref& base, int index, State& s) {
+        if(Checked && static_cast<unsigned>(index) >= static_cast<unsigned>(n->size)) {
+            throw std::runtime_error("Array index " + std::to_string(index) +
+                                     " out of bounds [0, " + std::to_string(n->size) + ")");
+        }
+        return (&at<Base>(base, s))[index];
+    }
+
+    // dst = a[b]
+    template<bool Checked, bool D, bool A, bool B>
+    static const Node* load(const Node* n, State& s) {
+        at<D>(n->dst, s) = element<Checked, A>(n, n->a, at<B>(n->b, s), s);
+        CLOSURE_NEXT(n->next);
+    }
+
+    // dst[a] = b
+    template<bool Checked, bool D, bool A, bool B>
+    static const Node* store(const Node* n, State& s) {
+        element<Checked, D>(n, n->dst, at<A>(n->a, s), s) = at<B>(n->b, s);
+        CLOSURE_NEXT(n->next);
+    }
+
+    template<bool A>
+    static const Node* print(const Node* n, State& s) {
+        int value = at<A>(n->a, s);
+        if(!s.vm->quiet) printf("%d\n", value);
+        s.vm->output.push_back(std::to_string(value));
+        CLOSURE_NEXT(n->next);
+    }
+
+    template<bool D>
+    static const Node* read(const Node* n, State& s) {
+        ClosureInterpreter* vm = s.vm;
+        if(vm->inputPos >= vm->inputCount) throw std::runtime_error("input(): no more input values");
+        at<D>(n->dst, s) = vm->input[vm->inputPos++];
+        CLOSURE_NEXT(n->next);
+    }
+
+    static const Node* call(const Node* n, State& s) {
+        int* frame = s.sp;
+        if(n->size > s.limit - frame || static_cast<int>(s.callStack.size()) >= MAX_CALL_DEPTH) {
+            throw std::runtime_error("Stack overflow");
+        }
+        std::fill(frame, frame + n->size, 0);
+        const auto* arg = s.vm->args.data() + n->index;
+        for(int i = 0; i < n->count; i++) frame[i] = at(arg[i].first, arg[i].second, s);
+
+        s.vm->calls[n->a.offset]++;
+        s.callStack.push_back({n, s.fp});
+        s.fp = frame;
+        s.sp = frame + n->size;
+        CLOSURE_NEXT(n->target);
+    }
+
+    template<bool A>
+    static const Node* ret(const Node* n, State& s) {
+        int value = at<A>(n->a, s);
+        if(s.callStack.empty()) {  // return from top level
+            s.result = value;
+            return nullptr;
+        }
+        CallRecord rec = s.callStack.back();
+        s.callStack.pop_back();
+        s.sp = s.fp;
+        s.fp = rec.fp;
+        at(rec.call->dst, rec.call->kinds & FRAME_DST, s) = value;
+        CLOSURE_NEXT(rec.call->next);
+    }
+
+    static const Node* halt(const Node*, State&) {
+        return nullptr;
+    }
+
+    static const Node* vector(const Node* n, State& s) {
+        const BoundKernel& k = s.vm->kernels[n->index];
+        const VecKernel& spec = k.spec;
+        auto value = [&](const Ref& r, const Spec& sp) -> int& {
+            return at(r, sp.kind == Spec::LOCAL, s);
+        };
+        int lo = value(k.lo, spec.lo);
+        int hi = value(k.hi, spec.hi);
+        if(hi <= lo) CLOSURE_NEXT(n->next);
+
+        // Range check once: the first out-of-range index is the one the
+        // scalar loop would have failed on
+        auto span = [&](const Ref& base, const Spec& sp, int offset, int size) -> int* {
+            int first = lo + offset;
+            int last = hi - 1 + offset;
+            if(first < 0 || first >= size || last >= size) {
+                int bad = (first < 0 || first >= size) ? first : size;
+                throw std::runtime_error("Array index " + std::to_string(bad) +
+                                         " out of bounds [0, " + std::to_string(size) + ")");
+            }
+            return &value(base, sp) + first;
+        };
+        simd::Source src[2];
+        for(int i = 0; i < 2; i++) {
+            if(spec.array[i]) src[i].ptr = span(k.src[i], spec.src[i], spec.offset[i], spec.size[i]);
+            else src[i].scalar = value(k.src[i], spec.src[i]);
+        }
+        if(spec.reduce) {
+            int& acc = value(k.dst, spec.dst);
+            acc = simd::scalarOp(BinOp::ADD, acc, simd::reduce(spec.op, src[0], src[1], hi - lo));
+        } else {
+            simd::map(spec.op, span(k.dst, spec.dst, 0, spec.dstSize), src[0], src[1], hi - lo);
+        }
+        CLOSURE_NEXT(n->next);
+    }
+
+    // Serial parallel loop: dst is the induction variable, a and b the
+    // range; the bound is saved to hidden slot `size` of the frame (count
+    // 1) or the globals, target is the first op past the loop
+    template<bool D, bool A, bool B>
+    static const Node* loopBegin(const Node* n, State& s) {
+        int lo = at<A>(n->a, s);
+        int hi = at<B>(n->b, s);
+        if(lo >= hi) CLOSURE_NEXT(n->target);
+        at<D>(n->dst, s) = lo;
+        (n->count ? s.fp : s.vm->globals.data())[n->size] = hi;
+        CLOSURE_NEXT(n->next);
+    }
+
+    // dst: induction variable, b: saved bound, target: first op of the body
+    template<bool D, bool B>
+    static const Node* loopEnd(const Node* n, State& s) {
+        if(++at<D>(n->dst, s) < at<B>(n->b, s)) CLOSURE_NEXT(n->target);
+        CLOSURE_NEXT(n->next);
+    }
+
+    // ---------- Handler selection ----------
+
+    template<BinOp Op, size_t... K>
+    static Handler binFor(unsigned kinds, std::index_sequence<K...>) {
+        static constexpr Handler table[] = {&bin<Op, (K & FRAME_DST) != 0, (K & FRAME_A) != 0, (K & FRAME_B) != 0>...};
+        return table[kinds];
+    }
+
+    template<bool Checked, bool Load, size_t... K>
+    static Handler memoryFor(unsigned kinds, std::index_sequence<K...>) {
+        static constexpr Handler loads[] = {&load<Checked, (K & FRAME_DST) != 0, (K & FRAME_A) != 0, (K & FRAME_B) != 0>...};
+        static constexpr Handler stores[] = {&store<Checked, (K & FRAME_DST) != 0, (K & FRAME_A) != 0, (K & FRAME_B) != 0>...};
+        return Load ? loads[kinds] : stores[kinds];
+    }
+
+    template<size_t... K>
+    static Handler loopBeginFor(unsigned kinds, std::index_sequence<K...>) {
+        static constexpr Handler table[] = {&loopBegin<(K & FRAME_DST) != 0, (K & FRAME_A) != 0, (K & FRAME_B) != 0>...};
+        return table[kinds];
+    }
+
+    static Handler binFor(BinOp op, unsigned kinds) {
+        auto all = std::make_index_sequence<8>();
+        switch(op) {
+            case BinOp::ADD: return binFor<BinOp::ADD>(kinds, all);
+            case BinOp::SUB: return binFor<BinOp::SUB>(kinds, all);
+            case BinOp::MUL: return binFor<BinOp::MUL>(kinds, all);
+            case BinOp::DIV: return binFor<BinOp::DIV>(kinds, all);
+            case BinOp::MOD: return binFor<BinOp::MOD>(kinds, all);
+            case BinOp::EQ: return binFor<BinOp::EQ>(kinds, all);
+            case BinOp::NE: return binFor<BinOp::NE>(kinds, all);
+            case BinOp::LT: return binFor<BinOp::LT>(kinds, all);
+            case BinOp::GT: return binFor<BinOp::GT>(kinds, all);
+            case BinOp::LE: return binFor<BinOp::LE>(kinds, all);
+            case BinOp::GE: return binFor<BinOp::GE>(kinds, all);
+            case BinOp::AND: return binFor<BinOp::AND>(kinds, all);
+            case BinOp::OR: return binFor<BinOp::OR>(kinds, all);
+        }
+        return nullptr;
+    }
+
+    static Handler handlerFor(const Op& op, unsigned kinds) {
+        bool d = kinds & FRAME_DST, a = kinds & FRAME_A;
+        auto all = std::make_index_sequence<8>();
+        switch(op.code) {
+            case Code::BIN:
+                return binFor(op.binOp, kinds);
+            case Code::UN:
+                if(op.unOp == UnOp::NEG) {
+                    return d ? (a ? &unary<UnOp::NEG, true, true> : &unary<UnOp::NEG, true, false>)
+                             : (a ? &unary<UnOp::NEG, false, true> : &unary<UnOp::NEG, false, false>);
+                }
+                return d ? (a ? &unary<UnOp::NOT, true, true> : &unary<UnOp::NOT, true, false>)
+                         : (a ? &unary<UnOp::NOT, false, true> : &unary<UnOp::NOT, false, false>);
+            case Code::MOVE:
+                return d ? (a ? &move<true, true> : &move<true, false>)
+                         : (a ? &move<false, true> : &move<false, false>);
+            case Code::JUMP:
+                return &jump;
+            case Code::JUMP_IF_ZERO:
+                return a ? &jumpIfZero<true> : &jumpIfZero<false>;
+            case Code::LOAD:
+                return op.checked ? memoryFor<true, true>(kinds, all) : memoryFor<false, true>(kinds, all);
+            case Code::STORE:
+                return op.checked ? memoryFor<true, false>(kinds, all) : memoryFor<false, false>(kinds, all);
+            case Code::PRINT:
+                return a ? &print<true> : &print<false>;
+            case Code::INPUT:
+                return d ? &read<true> : &read<false>;
+            case Code::CALL:
+                return &call;
+            case Code::RET:
+                return a ? &ret<true> : &ret<false>;
+            case Code::VECTOR:
+                return &vector;
+            case Code::LOOP_BEGIN:
+                return loopBeginFor(kinds, all);
+            case Code::LOOP_END: {
+                bool b = kinds & FRAME_B;
+                return d ? (b ? &loopEnd<true, true> : &loopEnd<true, false>)
+                         : (b ? &loopEnd<false, true> : &loopEnd<false, false>);
+            }
+            case Code::HALT:
+                return &halt;
+        }
+        return &halt;
+    }
+
+    // ---------- Binding: ops -> nodes ----------
+
+    void bind() {
+        nodes.assign(ops.size(), Node());
+        auto ref = [&](const Spec& spec) -> Ref {
+            Ref r{};
+            switch(spec.kind) {
+                case Spec::CONST: r.cell = &constants[spec.index]; break;
+                case Spec::GLOBAL: r.cell = &globals[spec.index]; break;
+                case Spec::LOCAL: r.offset = spec.index; break;
+            }
+            return r;
+        };
+        // Destination of a transfer to op i: the end of any goto chain
+        auto land = [&](int i) -> const Node* {
+            for(size_t hops = 0; ops[i].code == Code::JUMP && hops < ops.size(); hops++) {
+                i = ops[i].target;
+            }
+            return &nodes[i];
+        };
+
+        for(size_t i = 0; i < ops.size(); i++) {
+            const Op& op = ops[i];
+            Node& node = nodes[i];
+            unsigned kinds = (op.dst.kind == Spec::LOCAL ? FRAME_DST : 0) |
+                             (op.a.kind == Spec::LOCAL ? FRAME_A : 0) |
+                             (op.b.kind == Spec::LOCAL ? FRAME_B : 0);
+            node.run = handlerFor(op, kinds);
+            node.kinds = static_cast<unsigned char>(kinds);
+            node.dst = ref(op.dst);
+            node.a = ref(op.a);
+            node.b = ref(op.b);
+            node.size = op.size;
+            node.index = op.index;
+            node.count = op.count;
+            if(i + 1 < ops.size()) node.next = land(static_cast<int>(i) + 1);
+
+            switch(op.code) {
+                case Code::JUMP:
+                case Code::JUMP_IF_ZERO:
+                case Code::LOOP_BEGIN:
+                case Code::LOOP_END:
+                    node.target = land(op.target);
+                    break;
+                case Code::CALL:
+                    node.target = land(entries[op.target]);
+                    node.size = frameSizes[op.target];
+                    node.a.offset = op.target;
+                    break;
+                default:
+                    break;
+            }
+            if(op.code == Code::JUMP) stats.threadedJumps++;
+        }
+        stats.nodes = static_cast<int>(ops.size()) - stats.threadedJumps;
+
+        args.clear();
+        for(const auto& spec : argSpecs) args.push_back({ref(spec), spec.kind == Spec::LOCAL});
+        kernels.clear();
+        for(const auto& spec : vecSpecs) {
+            BoundKernel k;
+            k.spec = spec;
+            k.dst = ref(spec.dst);
+            k.lo = ref(spec.lo);
+            k.hi = ref(spec.hi);
+            for(int i = 0; i < 2; i++) k.src[i] = ref(spec.src[i]);
+            kernels.push_back(k);
+        }
+    }
+
+    void link(const IRProgram& program) {
+        ops.clear();
+        argSpecs.clear();
+        vecSpecs.clear();
+        constants.clear();
+        entries.assign(program.functions.size(), 0);
+        frameSizes.assign(program.functions.size(), 0);
+        names.clear();
+
+        std::unordered_map<std::string, int> funcIndex;
+        for(size_t i = 0; i < program.functions.size(); i++) {
+            funcIndex[program.functions[i].name] = static_cast<int>(i);
+            names.push_back(program.functions[i].name);
+        }
+
+        int globalCount = program.globalCount;
+        linkBody(program, program.instructions, nullptr, globalCount, funcIndex);
+        ops.push_back(Op());  // HALT at the end of top-level code
+
+        for(size_t i = 0; i < program.functions.size(); i++) {
+            const auto& func = program.functions[i];
+            entries[i] = static_cast<int>(ops.size());
+            int frameSize = func.frameSize;
+            linkBody(program, func.instructions, &func, frameSize, funcIndex);
+            frameSizes[i] = frameSize;
+
+            Op ret;  // guard against falling off the end of a body
+            ret.code = Code::RET;
+            ops.push_back(ret);
+        }
+        globals.assign(globalCount, 0);
+    }
+
+    // `slots` is the size of the body's slot space (globals or the
+    // frame); hidden slots for loop bounds are added past its end
+    void linkBody(const IRProgram& program, const std::vector<Instruction>& body,
+                  const IRFunction* func, int& slots,
+                  const std::unordered_map<std::string, int>& funcIndex) {
+        std::unordered_map<std::string, int> labels;
+        int offset = static_cast<int>(ops.size());
+        for(const auto& instr : body) {
+            if(instr.type == InstrType::LABEL) {
+                labels[instr.label] = offset;
+            } else if(instr.type != InstrType::NOP && instr.type != InstrType::CONST &&
+                      instr.type != InstrType::PAR_REDUCE) {
+                offset++;
+            }
+        }
+
+        auto resolve = [&](const Operand& op) -> Spec {
+            Spec s;
+            if(op.isConst()) {
+                s.kind = Spec::CONST;
+                s.index = static_cast<int>(constants.size());
+                constants.push_back(op.value);
+                return s;
+            }
+            if(func) {
+                auto it = func->slots.find(op.name);
+                if(it != func->slots.end()) {
+                    s.kind = Spec::LOCAL;
+                    s.index = it->second;
+                    return s;
+                }
+            }
+            auto it = program.globalSlots.find(op.name);
+            if(it == program.globalSlots.end()) {
+                throw std::runtime_error("Undefined variable: " + op.str());
+            }
+            s.kind = Spec::GLOBAL;
+            s.index = it->second;
+            return s;
+        };
+        auto arraySize = [&](const Operand& op) -> int {
+            if(func && func->slots.count(op.name)) {
+                auto it = func->arraySizes.find(op.name);
+                if(it != func->arraySizes.end()) return it->second;
+            } else {
+                auto it = program.arraySizes.find(op.name);
+                if(it != program.arraySizes.end()) return it->second;
+            }
+            throw std::runtime_error("Not an array: " + op.str());
+        };
+        auto target = [&](const std::string& label) -> int {
+            auto it = labels.find(label);
+            if(it == labels.end()) throw std::runtime_error("Label not found: " + label);
+            return it->second;
+        };
+
+        std::vector<size_t> openLoops;  // LOOP_BEGIN ops awaiting their end
+        for(const auto& instr : body) {
+            Op op;
+            switch(instr.type) {
+                case InstrType::BIN_OP:
+                    op.code = Code::BIN;
+                    op.binOp = instr.binOp;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    break;
+                case InstrType::UN_OP:
+                    op.code = Code::UN;
+                    op.unOp = instr.unOp;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::ASSIGN:
+                    op.code = Code::MOVE;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::LOAD_IDX:
+                    op.code = Code::LOAD;
+                    op.checked = instr.boundsCheck;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.size = arraySize(instr.op1);
+                    break;
+                case InstrType::STORE_IDX:
+                    op.code = Code::STORE;
+                    op.checked = instr.boundsCheck;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.size = arraySize(instr.result);
+                    break;
+                case InstrType::VEC_MAP:
+                case InstrType::VEC_REDUCE: {
+                    VecKernel k;
+                    k.op = instr.binOp;
+                    k.reduce = instr.type == InstrType::VEC_REDUCE;
+                    k.dst = resolve(instr.result);
+                    if(!k.reduce) k.dstSize = arraySize(instr.result);
+                    const Operand* sources[2] = {&instr.op1, &instr.op2};
+                    for(int i = 0; i < 2; i++) {
+                        k.src[i] = resolve(*sources[i]);
+                        k.array[i] = !instr.args[2 + i].name.empty();
+                        if(k.array[i]) {
+                            k.offset[i] = instr.args[2 + i].value;
+                            k.size[i] = arraySize(*sources[i]);
+                        }
+                    }
+                    k.lo = resolve(instr.args[0]);
+                    k.hi = resolve(instr.args[1]);
+                    op.code = Code::VECTOR;
+                    op.index = static_cast<int>(vecSpecs.size());
+                    vecSpecs.push_back(k);
+                    break;
+                }
+                case InstrType::GOTO:
+                    op.code = Code::JUMP;
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::IF_GOTO:
+                    op.code = Code::JUMP_IF_ZERO;
+                    op.a = resolve(instr.op1);
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::PRINT:
+                    op.code = Code::PRINT;
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::INPUT:
+                    op.code = Code::INPUT;
+                    op.dst = resolve(instr.result);
+                    break;
+                case InstrType::RETURN:
+                    op.code = Code::RET;
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::CALL: {
+                    if(instr.funcName == "print") {
+                        op.code = Code::PRINT;
+                        op.a = instr.args.empty() ? resolve(Operand(0)) : resolve(instr.args[0]);
+                        break;
+                    }
+                    auto it = funcIndex.find(instr.funcName);
+                    if(it == funcIndex.end()) {
+                        throw std::runtime_error("Undefined function: " + instr.funcName);
+                    }
+                    if(instr.args.size() != program.functions[it->second].params.size()) {
+                        throw std::runtime_error("Argument count mismatch in call to " +
+                                                 instr.funcName);
+                    }
+                    op.code = Code::CALL;
+                    op.target = it->second;
+                    op.dst = resolve(instr.result);
+                    op.index = static_cast<int>(argSpecs.size());
+                    op.count = static_cast<int>(instr.args.size());
+                    for(const auto& arg : instr.args) argSpecs.push_back(resolve(arg));
+                    break;
+                }
+                case InstrType::PAR_BEGIN:
+                    op.code = Code::LOOP_BEGIN;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.size = slots++;  // the bound, evaluated once
+                    op.count = func ? 1 : 0;
+                    openLoops.push_back(ops.size());
+                    break;
+                case InstrType::PAR_END: {
+                    if(openLoops.empty()) throw std::runtime_error("Parallel loop without begin");
+                    Op& begin = ops[openLoops.back()];
+                    openLoops.pop_back();
+                    op.code = Code::LOOP_END;
+                    op.dst = begin.dst;
+                    op.b.kind = func ? Spec::LOCAL : Spec::GLOBAL;
+                    op.b.index = begin.size;
+                    op.target = static_cast<int>(&begin - ops.data()) + 1;
+                    begin.target = static_cast<int>(ops.size()) + 1;
+                    break;
+                }
+                case InstrType::LABEL:
+                case InstrType::CONST:
+                case InstrType::NOP:
+                case InstrType::PAR_REDUCE:
+                    continue;
+            }
+            ops.push_back(op);
+        }
+    }
+};
@@ -8,6 +8,7 @@
 #include "ir.h"
 #include "parser.h"
 #include "semantic.h"
+#include <climits>
 #include <unordered_map>
 
 class CodeGenerator {
@@ -17,12 +18,16 @@ private:
     int labelCounter = 0;
     SemanticAnalyzer& semanticAnalyzer;
     std::unordered_map<std::string, int> variableTypes;
+    IRFunction* currentFunction = nullptr;
+    bool inParallel = false;  // generating a parallel loop body
+    int line = 0, column = 0;  // source position of the node being generated
 
 public:
     CodeGenerator(SemanticAnalyzer& sem) : semanticAnalyzer(sem) {}
 
     IRProgram generate(const ProgramPtr& program) {
         ir.instructions.clear();
+        ir.functions.clear();
         tempCounter = 0;
         labelCounter = 0;
 
@@ -34,14 +39,20 @@ public:
                 int typeCode = (decl->dataType == "int") ? 0 : 1;
                 ir.variableTypes[decl->varName] = typeCode;
                 variableTypes[decl->varName] = typeCode;
+                if(decl->arraySize > 0) ir.arraySizes[decl->varName] = decl->arraySize;
             }
         }
 
         // Second pass: generate code
         for(const auto& stmt : program->statements) {
-            genStatement(stmt);
+            if(auto func = std::dynamic_pointer_cast<FuncDecl>(stmt)) {
+                genFunction(func);
+            } else {
+                genStatement(stmt);
+            }
         }
 
+        ir.layoutFrames();
         return ir;
     }
 
@@ -54,12 +65,62 @@ private:
         return "L" + std::to_string(labelCounter++);
     }
 
-    void emitInstruction(const Instruction& instr) {
-        ir.addInstruction(instr);
+    void emitInstruction(Instruction instr) {
+        instr.line = line;
+        instr.column = column;
+        if(currentFunction) {
+            currentFunction->instructions.push_back(instr);
+        } else {
+            ir.addInstruction(instr);
+        }
+    }
+
+    // Instructions emitted while generating `node` (and not one of its
+    // children) carry its position
+    class Position {
+        CodeGenerator& gen;
+        int line, column;
+
+    public:
+        Position(CodeGenerator& gen, const ASTNode& node) : gen(gen), line(gen.line), column(gen.column) {
+            if(node.line > 0) {
+                gen.line = node.line;
+                gen.column = node.column;
+            }
+        }
+        ~Position() {
+            gen.line = line;
+            gen.column = column;
+        }
+    };
+
+    void genFunction(const std::shared_ptr<FuncDecl>& func) {
+        IRFunction irFunc;
+        irFunc.name = func->name;
+        irFunc.pure = semanticAnalyzer.isFunctionPure(func->name);
+        for(const auto& param : func->params) {
+            irFunc.params.push_back(param.name);
+            irFunc.variableTypes[param.name] = (param.dataType == "int") ? 0 : 1;
+        }
+
+        currentFunction = &irFunc;
+        for(const auto& stmt : func->body) {
+            genStatement(stmt);
+        }
+
+        // Falling off the end returns 0
+        if(irFunc.instructions.empty() ||
+           irFunc.instructions.back().type != InstrType::RETURN) {
+            emitInstruction(Instruction::createReturn(Operand(0)));
+        }
+        currentFunction = nullptr;
+
+        ir.functions.push_back(std::move(irFunc));
     }
 
     void genStatement(const StatementPtr& stmt) {
         if(!stmt) return;
+        Position position(*this, *stmt);
 
         if(auto decl = std::dynamic_pointer_cast<DeclStmt>(stmt)) {
             genDecl(decl);
@@ -85,22 +146,42 @@ private:
             } else {
                 emitInstruction(Instruction::createReturn(Operand(0)));
             }
+        } else if(auto exprStmt = std::dynamic_pointer_cast<ExprStmt>(stmt)) {
+            genExpression(exprStmt->expr);
         }
     }
 
     void genDecl(const std::shared_ptr<DeclStmt>& decl) {
         int typeCode = (decl->dataType == "int") ? 0 : 1;
-        ir.variableTypes[decl->varName] = typeCode;
-        variableTypes[decl->varName] = typeCode;
+        if(currentFunction) {
+            currentFunction->variableTypes[decl->varName] = typeCode;
+            if(decl->arraySize > 0) currentFunction->arraySizes[decl->varName] = decl->arraySize;
+        } else {
+            ir.variableTypes[decl->varName] = typeCode;
+            variableTypes[decl->varName] = typeCode;
+            if(decl->arraySize > 0) ir.arraySizes[decl->varName] = decl->arraySize;
+        }
 
         if(decl->initializer) {
             auto result = genExpression(decl->initializer);
             emitInstruction(Instruction::createAssign(
                 Operand(decl->varName, Operand::Type::VAR), result));
+        } else if(inParallel) {
+            // Each iteration gets a fresh copy, not the previous iteration's
+            emitInstruction(Instruction::createAssign(
+                Operand(decl->varName, Operand::Type::VAR), Operand(0)));
         }
     }
 
     void genAssign(const std::shared_ptr<AssignStmt>& assign) {
+        if(assign->index) {
+            auto index = genExpression(assign->index);
+            auto value = genExpression(assign->value);
+            emitInstruction(Instruction::createStoreIdx(
+                Operand(assign->varName, Operand::Type::VAR), index, value));
+            return;
+        }
+
         auto result = genExpression(assign->value);
         emitInstruction(Instruction::createAssign(
             Operand(assign->varName, Operand::Type::VAR), result));
@@ -152,6 +233,11 @@ private:
     }
 
     void genForStatement(const std::shared_ptr<ForStmt>& forStmt) {
+        if(forStmt->parallel) {
+            genParallelFor(forStmt);
+            return;
+        }
+
         if(forStmt->init) {
             genStatement(forStmt->init);
         }
@@ -172,15 +258,74 @@ private:
         }
 
         if(forStmt->update) {
-            genExpression(forStmt->update);
+            genStatement(forStmt->update);
         }
 
         emitInstruction(Instruction::createGoto(loopLabel));
         emitInstruction(Instruction::createLabel(endLabel));
     }
 
+    // The bound is evaluated once; the shape was checked by the analyzer.
+    // An inclusive bound b runs [a, b + 1). For b = INT_MAX that range
+    // wraps to empty, while the loop as written never ends: a constant
+    // INT_MAX is rejected by the analyzer, a computed one is tested at
+    // run time and the loop then runs in its sequential form.
+    void genParallelFor(const std::shared_ptr<ForStmt>& forStmt) {
+        genStatement(forStmt->init);
+
+        auto cond = std::dynamic_pointer_cast<BinExpr>(forStmt->condition);
+        auto iv = std::dynamic_pointer_cast<VarExpr>(cond->left);
+        Operand ivVar(iv->name, Operand::Type::VAR);
+        Operand hi = genExpression(cond->right);
+        Operand inclusive = hi;
+        std::string sequentialLabel;
+        if(cond->op == BinOp::LE) {
+            if(!inclusive.isConst()) {
+                Operand fits(genTemp(), Operand::Type::TEMP);
+                emitInstruction(Instruction::createBinOp(fits, BinOp::LT, inclusive, Operand(INT_MAX)));
+                sequentialLabel = genLabel();
+                emitInstruction(Instruction::createIfGoto(fits, sequentialLabel));
+            }
+            hi = Operand(genTemp(), Operand::Type::TEMP);
+            emitInstruction(Instruction::createBinOp(hi, BinOp::ADD, inclusive, Operand(1)));
+        }
+
+        emitInstruction(Instruction::createParBegin(ivVar, hi));
+        for(const auto& reduction : semanticAnalyzer.getReductions(forStmt.get())) {
+            emitInstruction(Instruction::createParReduce(
+                Operand(reduction.name, Operand::Type::VAR), reduction.op));
+        }
+
+        inParallel = true;
+        for(const auto& stmt : forStmt->body) {
+            genStatement(stmt);
+        }
+        inParallel = false;
+
+        emitInstruction(Instruction::createParEnd());
+        if(sequentialLabel.empty()) return;
+
+        std::string endLabel = genLabel();
+        emitInstruction(Instruction::createGoto(endLabel));
+        emitInstruction(Instruction::createLabel(sequentialLabel));
+        Operand more(genTemp(), Operand::Type::TEMP);
+        emitInstruction(Instruction::createBinOp(more, BinOp::LE, ivVar, inclusive));
+        emitInstruction(Instruction::createIfGoto(more, endLabel));
+        inParallel = true;  // declarations still start at zero in every iteration
+        for(const auto& stmt : forStmt->body) {
+            genStatement(stmt);
+        }
+        inParallel = false;
+        Operand next(genTemp(), Operand::Type::TEMP);
+        emitInstruction(Instruction::createBinOp(next, BinOp::ADD, ivVar, Operand(1)));
+        emitInstruction(Instruction::createAssign(ivVar, next));
+        emitInstruction(Instruction::createGoto(sequentialLabel));
+        emitInstruction(Instruction::createLabel(endLabel));
+    }
+
     auto genExpression(const ExpressionPtr& expr) -> Operand {
         if(!expr) return Operand(0);
+        Position position(*this, *expr);
 
         if(auto binExpr = std::dynamic_pointer_cast<BinExpr>(expr)) {
             return genBinExpr(binExpr);
@@ -198,11 +343,24 @@ private:
             }
         } else if(auto callExpr = std::dynamic_pointer_cast<CallExpr>(expr)) {
             return genCallExpr(callExpr);
+        } else if(auto indexExpr = std::dynamic_pointer_cast<IndexExpr>(expr)) {
+            return genIndexExpr(indexExpr);
         }
 
         return Operand(0);
     }
 
+    Operand genIndexExpr(const std::shared_ptr<IndexExpr>& expr) {
+        auto index = genExpression(expr->index);
+        std::string result = genTemp();
+
+        emitInstruction(Instruction::createLoadIdx(
+            Operand(result, Operand::Type::TEMP),
+            Operand(expr->arrayName, Operand::Type::VAR), index));
+
+        return Operand(result, Operand::Type::TEMP);
+    }
+
     Operand genBinExpr(const std::shared_ptr<BinExpr>& expr) {
         auto left = genExpression(expr->left);
         auto right = genExpression(expr->right);
@@ -229,6 +387,12 @@ private:
     }
 
     Operand genCallExpr(const std::shared_ptr<CallExpr>& expr) {
+        if(expr->funcName == "input") {
+            Operand result(genTemp(), Operand::Type::TEMP);
+            emitInstruction(Instruction::createInput(result));
+            return result;
+        }
+
         std::vector<Operand> args;
         for(const auto& arg : expr->args) {
             args.push_back(genExpression(arg));
@@ -0,0 +1,277 @@
+/**
+ * @file generator.h
+ * @brief Seeded generator of benchmark programs
+ *
+ * Writes valid, terminating programs of a requested size (a few hundred
+ * bytes over it), the same text for the same seed, mix and size on every
+ * platform. A program is a sequence of units drawn from the mix:
+ *   - EXPRESSIONS: assignments of deeply nested expressions
+ *   - STRAIGHT:    runs of short assignments, conditionals and prints
+ *   - LOOPS:       nested counted loops over scalars and arrays, while loops
+ *   - VARIABLES:   new int and bool variables and uses of old ones
+ *   - MIXED:       all of the above plus small functions and their calls
+ * Values stay small: every assignment is reduced modulo 10007 and only a
+ * leaf is ever multiplied by a small constant, so no expression
+ * overflows. With setInputs(n) the first n variables are read with
+ * input() instead of starting at a constant; values in [0, 10007) keep
+ * that guarantee. Loops run at most a few dozen iterations per unit, which
+ * keeps execution time proportional to the program size.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+class ProgramGenerator {
+public:
+    enum class Mix { MIXED, EXPRESSIONS, STRAIGHT, LOOPS, VARIABLES };
+    static constexpr Mix MIXES[] = {Mix::MIXED, Mix::EXPRESSIONS, Mix::STRAIGHT, Mix::LOOPS, Mix::VARIABLES};
+
+    static const char* name(Mix mix) {
+        static const char* const names[] = {"mixed", "expressions", "straight", "loops", "variables"};
+        return names[static_cast<int>(mix)];
+    }
+
+    static bool parse(const std::string& text, Mix& mix) {
+        for(Mix m : MIXES) {
+            if(text == name(m)) {
+                mix = m;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    explicit ProgramGenerator(uint64_t seed, Mix mix = Mix::MIXED) : state(seed), mix(mix) {}
+
+    // The program reads `count` values (at most 8) with input() first
+    void setInputs(int count) { inputs = std::min(std::max(count, 0), 8); }
+
+    // Streams a program of at least `bytes` bytes to `out`
+    void generate(std::ostream& out, size_t bytes) {
+        std::string chunk = "// Generated by lab3 bench: mix " + std::string(name(mix)) + "\n";
+        for(int i = 0; i < 8; i++) chunk += declareInt(i < inputs ? "input()" : std::to_string(i + 1));
+        size_t written = 0;
+        long units = 0;
+        while(written + chunk.size() < bytes) {
+            unit(chunk);
+            if(++units % 64 == 0) chunk += "print(" + intVar() + ");\n";
+            if(chunk.size() >= (1 << 16)) {
+                out << chunk;
+                written += chunk.size();
+                chunk.clear();
+            }
+        }
+        std::string last = intVar();
+        chunk += "print(" + last + " + " + intVar() + ");\n";
+        out << chunk;
+    }
+
+    std::string generate(size_t bytes) {
+        std::ostringstream out;
+        generate(out, bytes);
+        return out.str();
+    }
+
+private:
+    uint64_t state;
+    Mix mix;
+    int inputs = 0;     // v0 .. v{inputs-1} read with input()
+    int ints = 0;       // v0 .. v{ints-1}
+    int bools = 0;      // b0 .. b{bools-1}
+    int arrays = 0;     // a0 .. a{arrays-1}, ARRAY_SIZE elements each
+    int functions = 0;  // f0 .. f{functions-1}(x, y)
+    int counters = 0;   // loop variables c0, c1, ...
+
+    static constexpr int ARRAY_SIZE = 64;
+    static constexpr int MAX_LEAVES = 48;
+
+    // splitmix64: the same sequence everywhere, unlike <random> distributions
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    int below(int n) { return static_cast<int>(next() % static_cast<uint64_t>(n)); }
+    int between(int lo, int hi) { return lo + below(hi - lo + 1); }
+
+    // Variables from the recent past are used more, as in real code.
+    // Every draw is a statement of its own: the operands of + are not
+    // evaluated in a fixed order, and the text must not depend on it.
+    std::string intVar() {
+        int window = std::min(ints, 64);
+        int index = (below(4) == 0) ? below(ints) : ints - 1 - below(window);
+        return "v" + std::to_string(index);
+    }
+    std::string boolVar() { return "b" + std::to_string(below(bools)); }
+
+    std::string declareInt(const std::string& value) {
+        return "int v" + std::to_string(ints++) + " = " + value + ";\n";
+    }
+
+    // A variable, a constant, or a variable scaled by a small constant
+    std::string leaf(const std::string& counter = "") {
+        switch(below(6)) {
+            case 0: return std::to_string(between(0, 99));
+            case 1: {
+                std::string scale = std::to_string(between(2, 9));
+                return scale + " * " + intVar();
+            }
+            case 2: if(!counter.empty()) return counter; [[fallthrough]];
+            default: return intVar();
+        }
+    }
+
+    // `depth` levels of parentheses over at most `leaves` leaves
+    std::string expression(int depth, int& leaves, const std::string& counter = "") {
+        if(depth <= 0 || leaves <= 1) {
+            leaves--;
+            return leaf(counter);
+        }
+        static const char* const ops[] = {" + ", " - ", " + ", " - ", " / 7 + ", " % 13 - "};
+        std::string inner = expression(depth - 1, leaves, counter);
+        std::string other = (below(4) == 0 && leaves > 2) ? expression(2, leaves, counter) : leaf(counter);
+        leaves--;
+        if(below(2) == 0) return "(" + other + " - " + inner + ")";
+        return "(" + inner + ops[below(6)] + other + ")";
+    }
+
+    std::string assignment(const std::string& target, int depth, const std::string& counter = "") {
+        int leaves = MAX_LEAVES;
+        return target + " = " + expression(depth, leaves, counter) + " % 10007;\n";
+    }
+
+    std::string condition() {
+        static const char* const compare[] = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+        std::string left = intVar();
+        std::string test = left + compare[below(6)];
+        test += leaf();
+        if(bools > 0 && below(3) == 0) {
+            std::string negate = below(2) ? "!" : "";
+            std::string flag = boolVar();
+            test = negate + flag + (below(2) ? " && " : " || ") + test;
+        }
+        return test;
+    }
+
+    std::string counted(const std::string& counter, int bound) {
+        return "for (int " + counter + " = 0; " + counter + " < " + std::to_string(bound) + "; " + counter +
+               " = " + counter + " + 1) {\n";
+    }
+
+    void unit(std::string& out) {
+        Mix kind = mix;
+        if(kind == Mix::MIXED) {
+            int roll = below(20);
+            if(roll == 0) {
+                function(out);
+                return;
+            }
+            kind = (roll < 5) ? Mix::EXPRESSIONS : (roll < 11) ? Mix::STRAIGHT : (roll < 15) ? Mix::LOOPS : Mix::VARIABLES;
+        }
+        switch(kind) {
+            case Mix::EXPRESSIONS: {
+                std::string target = intVar();
+                out += assignment(target, between(8, 40));
+                break;
+            }
+            case Mix::STRAIGHT: straight(out); break;
+            case Mix::LOOPS: loops(out); break;
+            default: variables(out); break;
+        }
+    }
+
+    void straight(std::string& out) {
+        int statements = between(4, 12);
+        for(int i = 0; i < statements; i++) {
+            int roll = below(10);
+            std::string target = intVar();
+            if(roll == 0) {
+                out += "if (" + condition() + ") {\n    ";
+                out += assignment(target, 2) + "} else {\n    ";
+                target = intVar();
+                out += assignment(target, 2) + "}\n";
+            } else if(roll == 1 && functions > 0) {
+                std::string callee = "f" + std::to_string(below(functions));
+                std::string x = intVar();
+                out += target + " = " + callee + "(" + x + ", " + leaf() + ");\n";
+            } else {
+                out += assignment(target, between(1, 3));
+            }
+        }
+    }
+
+    void loops(std::string& out) {
+        std::string outer = "c" + std::to_string(counters++);
+        std::string inner = "c" + std::to_string(counters++);
+        switch(below(4)) {
+            case 0: {  // fill and reduce an array
+                std::string array = "a" + std::to_string(arrays++);
+                out += "int " + array + "[" + std::to_string(ARRAY_SIZE) + "];\n";
+                out += counted(outer, ARRAY_SIZE) + "    " + assignment(array + "[" + outer + "]", 2, outer) + "}\n";
+                std::string sum = intVar();
+                out += counted(inner, ARRAY_SIZE) + "    " + sum + " = (" + sum + " + " + array + "[" + inner +
+                       "]) % 10007;\n}\n";
+                break;
+            }
+            case 1: {  // while loop with a counter
+                out += "int " + outer + " = " + std::to_string(between(8, 24)) + ";\n";
+                std::string target = intVar();
+                out += "while (" + outer + " > 0) {\n    " + assignment(target, 3, outer);
+                out += "    " + outer + " = " + outer + " - 1;\n}\n";
+                break;
+            }
+            default: {  // two nested counted loops
+                int n = between(3, 8);
+                int m = between(3, 8);
+                out += counted(outer, n) + "    " + counted(inner, m);
+                int body = between(1, 3);
+                for(int i = 0; i < body; i++) {
+                    std::string target = intVar();
+                    out += "        " + assignment(target, 3, inner);
+                }
+                out += "    }\n";
+                if(below(2) == 0) {
+                    out += "    if (" + condition() + ") {\n        ";
+                    std::string target = intVar();
+                    out += assignment(target, 2, outer) + "    }\n";
+                }
+                out += "}\n";
+                break;
+            }
+        }
+    }
+
+    void variables(std::string& out) {
+        int count = between(2, 6);
+        for(int i = 0; i < count; i++) {
+            if(below(4) == 0) {
+                std::string test = condition();
+                out += "bool b" + std::to_string(bools++) + " = " + test + ";\n";
+            } else {
+                int leaves = 4;
+                std::string value = expression(2, leaves);
+                out += declareInt("(" + value + ") % 10007");
+            }
+        }
+    }
+
+    void function(std::string& out) {
+        std::string f = "f" + std::to_string(functions);
+        std::string scale = std::to_string(between(2, 9));
+        std::string threshold = std::to_string(between(0, 5000));
+        out += "int " + f + "(int x, int y) {\n";
+        out += "    int r = (x * " + scale + " + y) % 10007;\n";
+        out += "    if (r < " + threshold + ") {\n        r = (r + y / 3) % 10007;\n    }\n";
+        out += "    return r;\n}\n";
+        functions++;  // callable from now on
+        std::string target = intVar();
+        std::string x = intVar();
+        out += target + " = " + f + "(" + x + ", " + leaf() + ");\n";
+    }
+};
@@ -1,167 +1,2298 @@
 /**
  * @file interpreter.h
  * @brief TAC Interpreter - Executes Three-Address Code
+ *
+ * Before execution the IR is linked into a flat array of decoded ops:
+ * labels are resolved to code offsets and every operand to a global slot,
+ * a frame slot or an immediate. Calls run on a contiguous value stack of
+ * fixed-size frames (sizes come from IRFunction::layoutFrame), so a
+ * call/return is a stack-pointer bump plus argument copies.
+ *
+ * input() reads the next value of an input sequence set by setInput().
+ * A linked program can also run single function calls (call()); the
+ * batch interpreter uses that for calls made by its lanes.
+ *
+ * Superinstructions: the main thread profiles the first
+ * PROFILE_DISPATCHES ops it executes (per-site counts plus the opcode
+ * sequences seen), then rewrites hot sites whose ops match a fusion
+ * pattern (compare + branch, arithmetic + copy, copy + goto, ...) to a
+ * fused opcode that executes the whole sequence in one dispatch. Only
+ * the opcode of the first op changes; the fused handler reads the
+ * following ops' operands in place, so jumps into the middle of a fused
+ * sequence still land on the original ops.
+ *
+ * Tracing: the main thread counts the iterations of every loop closed by
+ * a backward goto. After HOT_LOOP_ITERATIONS it records one iteration
+ * from the loop header back to it while executing it; the linear trace
+ * has a guard for every conditional jump (the direction seen) and is
+ * compiled to x86-64 code (jit.h) that loops natively. A failing guard,
+ * a zero divisor or an out-of-range index leaves the trace with the pc
+ * to resume at; the interpreter re-executes the op there, so runtime
+ * errors are raised by the interpreter as usual. Loops that call, print,
+ * read input or contain inner loops are not traced. With setPerfMap() every
+ * compiled trace is named for perf after its loop (perfmap.h).
+ *
+ * Budgets: setLimits() caps executed ops, wall time, printed bytes and
+ * frame memory. Ops are counted per extended basic block (a run of ops up
+ * to the next jump, call or return): entering a block adds its length to
+ * the thread's step counter, and only when the counter passes its next
+ * checkpoint are the shared step total and the clock consulted. Native
+ * traces burn a fuel slot per iteration and return when it is spent. A
+ * hit limit throws LimitExceeded, which execute() reports in BudgetStats.
+ *
+ * Instances: a prepared program can also run as many Instances, each with
+ * its own globals, small value stack, call records and output, sharing
+ * the linked code. resume() runs one for a slice of steps; when a block
+ * entry crosses the slice end, the dispatch jumps to a YIELD op that
+ * saves pc/fp/sp, so slicing costs nothing beyond the budget checkpoint.
+ * Instance contexts are workers: no memoization, profiling or tracing,
+ * which keeps one linked program safe to resume from several threads.
+ * A paused instance is plain data (pc, frames in use, call records,
+ * globals, unread input, output counters), so saveInstance() can write it
+ * out and restoreInstance() continue it in another process.
+ *
+ * Source lines: link() keeps a LineTable from op index to the source
+ * position of the instruction it came from. A failing op leaves its pc in
+ * the context, and the runtime error is rethrown with "at line N in f()"
+ * appended; trace reports name loops by their line too.
+ *
+ * Sampling: setSampling() arms a SIGPROF timer (sampler.h) for execute().
+ * A tick zeroes the main context's next checkpoint, so the following block
+ * entry takes the budget slow path and records one sample there: an op of
+ * the block just left, which was running when the tick came (of the loop,
+ * when a native trace was running), and the call sites on the call stack.
+ * Traces return at least every BUDGET_CHECK_STEPS while sampling. The
+ * samples are aggregated into per-line, per-block and per-stack counts
+ * when the run ends.
+ *
+ * In memoize mode, calls to pure functions first consult a bounded
+ * direct-mapped cache from argument tuple to result.
+ *
+ * Vectorized loops (VEC_MAP / VEC_REDUCE) check the whole index range
+ * once and then run as SIMD kernels from simd.h.
+ *
+ * A `parallel for` body is linked with its own slot mapping: names it
+ * writes become private slots of a worker frame, other locals of the
+ * enclosing function are reached through an OUTER slot. Chunks of
+ * iterations run on a work-stealing ThreadPool, each worker with its own
+ * Context (stack, call records, call counts); reduction partials are kept
+ * per chunk and combined in a fixed tree order, so results do not depend
+ * on scheduling.
  */
 
 #pragma once
 
 #include "ir.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "jit.h"
+#include "perfmap.h"
+#include "sampler.h"
 #include <unordered_map>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <array>
+
+struct MemoStats {
+    std::string function;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+
+    double hitRate() const {
+        long total = hits + misses;
+        return total ? 100.0 * hits / total : 0.0;
+    }
+};
+
+struct SuperStats {
+    struct Sequence {
+        std::string ops;   // opcode names, e.g. "BIN JUMP_IF_ZERO"
+        long count = 0;    // executions in the profiling window
+        bool fused = false;
+    };
+    long profiled = 0;     // dispatches in the profiling window
+    int sites = 0;         // ops rewritten to fused opcodes
+    long removed = 0;      // dispatches saved by fused opcodes
+    double coverage = 0;   // % of profiled dispatches the fused sites remove
+    std::vector<Sequence> pairs;    // hottest adjacent pairs and triples
+    std::vector<Sequence> triples;
+};
+
+struct TraceStats {
+    int compiled = 0;      // loops running as native traces
+    int rejected = 0;      // loops whose recording was abandoned
+    long entries = 0;      // trace runs started from a back-edge
+    long nativeBytes = 0;
+    std::vector<std::string> report;  // one line per hot loop
+};
+
+struct SampleStats {
+    struct Hotspot {
+        std::string where;
+        long samples = 0;
+    };
+    int hz = 0;
+    long samples = 0;
+    long dropped = 0;              // taken after the sample buffer filled up
+    std::vector<Hotspot> lines;    // "line N in f()", hottest first
+    std::vector<Hotspot> blocks;   // basic blocks, hottest first
+    std::vector<Hotspot> stacks;   // folded: "main:12;fib:4;fib:3"
+};
+
+// Resource quotas for untrusted programs; 0 leaves a resource unlimited
+struct ExecutionLimits {
+    long steps = 0;        // IR ops executed
+    long millis = 0;       // wall time
+    long outputBytes = 0;  // printed text, newlines included
+    long frameBytes = 0;   // value stack held by call frames, per thread
+};
+
+// Thrown when a program runs out of one of its ExecutionLimits
+class LimitExceeded : public std::runtime_error {
+public:
+    enum Resource { STEPS, TIME, OUTPUT, MEMORY };
+
+    Resource resource;
+    long limit;
+    long used;
+
+    // `location`: source position of the op that ran out, if known
+    LimitExceeded(Resource resource, long limit, long used, const std::string& location = "")
+        : std::runtime_error(describe(resource, limit, used) + (location.empty() ? "" : " at " + location)),
+          resource(resource), limit(limit), used(used) {}
+
+    static const char* name(Resource resource) {
+        static const char* const names[] = {"steps", "time", "output", "memory"};
+        return names[resource];
+    }
+
+private:
+    static std::string describe(Resource resource, long limit, long used) {
+        static const char* const what[] = {"Step", "Time", "Output", "Frame memory"};
+        static const char* const units[] = {"steps", "ms", "bytes", "bytes"};
+        return std::string(what[resource]) + " limit exceeded: " + std::to_string(used) + " " +
+               units[resource] + " (limit " + std::to_string(limit) + ")";
+    }
+};
+
+struct BudgetStats {
+    long steps = 0;        // IR ops executed, all threads
+    long millis = 0;
+    long outputBytes = 0;
+    long frameBytes = 0;   // peak of the main thread
+    bool exceeded = false;
+    LimitExceeded::Resource resource = LimitExceeded::STEPS;  // when exceeded
+    long limit = 0;
+};
+
+struct ParallelStats {
+    int threads = 1;
+    long loops = 0;    // parallel loops executed
+    long chunks = 0;   // chunks handed to the pool
+    long steals = 0;   // chunk blocks moved between workers
+};
 
 class Interpreter {
+public:
+    static constexpr int STACK_SLOTS = 1 << 20;     // value stack capacity
+    static constexpr int WORKER_STACK_SLOTS = 1 << 18;
+    static constexpr int MAX_CALL_DEPTH = 100000;
+    static constexpr int DEFAULT_MEMO_ENTRIES = 4096;
+    static constexpr int CHUNKS_PER_WORKER = 8;
+    static constexpr long PROFILE_DISPATCHES = 1 << 16;
+    static constexpr long HOT_SITE_RUNS = 64;  // fuse sites run this often in the window
+    static constexpr int REPORTED_SEQUENCES = 4;
+    static constexpr int HOT_LOOP_ITERATIONS = 200;
+    static constexpr int MAX_TRACE_OPS = 512;
+    static constexpr int HOT_SIDE_EXITS = 64;
+    static constexpr size_t MAX_TRACE_PATHS = 16;
+    static constexpr long BUDGET_CHECK_STEPS = 1 << 16;  // steps between clock reads
+    static constexpr long TRACE_FUEL = 1 << 30;
+    static constexpr int INSTANCE_STACK_SLOTS = 1 << 12;
+    static constexpr size_t MAX_SAMPLE_FRAMES = 64;        // innermost calls kept per sample
+    static constexpr size_t SAMPLE_BUFFER_WORDS = 1 << 22;
+
 private:
-    std::unordered_map<std::string, int> variables;
-    std::vector<std::string> output;
-    int pc = 0;  // Program counter
+    // Resolved operand
+    struct Slot {
+        enum Kind : unsigned char { IMM, GLOBAL, LOCAL, OUTER } kind = IMM;
+        int index = 0;  // slot index, or the value itself for IMM
+    };
+
+    enum class OpCode : unsigned char {
+        BIN, UN, MOVE, JUMP, JUMP_IF_ZERO, CALL, RET, PRINT, INPUT,
+        LOAD,   // dst = a[b]       (a: array base slot, target: array size)
+        STORE,  // dst[a] = b       (dst: array base slot, target: array size)
+        LOAD_UNCHECKED, STORE_UNCHECKED,  // index proven in range at compile time
+        VEC_MAP, VEC_REDUCE,              // target: kernel in vecPool
+        PARALLEL,  // dst: induction variable, a: lo, b: hi, target: region in parPool
+        PAR_END,   // next iteration of the chunk, or back to runRegion
+        HALT,
+        YIELD,  // end of an instance's slice: ctx.pc holds the block to resume at
+        // Superinstructions; operands after the first op are read from
+        // the ops that follow
+        BIN_JZ,         // BIN, JUMP_IF_ZERO
+        BIN_MOVE,       // BIN, MOVE
+        BIN_MOVE_JUMP,  // BIN, MOVE, JUMP
+        BIN_BIN,        // BIN, BIN
+        MOVE_JUMP,      // MOVE, JUMP
+        LOAD_BIN,       // LOAD or LOAD_UNCHECKED, BIN
+        LOAD_BIN_JZ,    // LOAD or LOAD_UNCHECKED, BIN, JUMP_IF_ZERO
+        OPCODE_COUNT
+    };
+
+    struct Fusion {
+        OpCode ops[3];
+        int length;
+        OpCode fused;
+    };
+    static constexpr Fusion FUSIONS[] = {  // longest patterns first
+        {{OpCode::BIN, OpCode::MOVE, OpCode::JUMP}, 3, OpCode::BIN_MOVE_JUMP},
+        {{OpCode::LOAD, OpCode::BIN, OpCode::JUMP_IF_ZERO}, 3, OpCode::LOAD_BIN_JZ},
+        {{OpCode::LOAD_UNCHECKED, OpCode::BIN, OpCode::JUMP_IF_ZERO}, 3, OpCode::LOAD_BIN_JZ},
+        {{OpCode::BIN, OpCode::JUMP_IF_ZERO}, 2, OpCode::BIN_JZ},
+        {{OpCode::BIN, OpCode::MOVE}, 2, OpCode::BIN_MOVE},
+        {{OpCode::BIN, OpCode::BIN}, 2, OpCode::BIN_BIN},
+        {{OpCode::MOVE, OpCode::JUMP}, 2, OpCode::MOVE_JUMP},
+        {{OpCode::LOAD, OpCode::BIN}, 2, OpCode::LOAD_BIN},
+        {{OpCode::LOAD_UNCHECKED, OpCode::BIN}, 2, OpCode::LOAD_BIN},
+    };
+
+    struct Op {
+        OpCode code = OpCode::HALT;
+        BinOp binOp = BinOp::ADD;
+        UnOp unOp = UnOp::NEG;
+        Slot dst, a, b;
+        int target = 0;     // jump target, callee index or array size
+        int argBegin = 0;   // first argument in argPool
+        int argCount = 0;
+    };
+
+    // Operand of a vector kernel: array elements base[k + offset] or a scalar
+    struct VecSource {
+        Slot slot;
+        bool array = false;
+        int offset = 0;
+        int size = 0;
+    };
+
+    struct VecKernel {
+        BinOp op = BinOp::ADD;
+        Slot dst;         // destination array base or accumulator
+        int dstSize = 0;  // VEC_MAP: destination array size
+        VecSource src[2];
+        Slot lo, hi;
+    };
+
+    struct ParRegion {
+        struct Reduction {
+            Slot shared;
+            int priv;
+            BinOp op;
+        };
+        int bodyStart = 0;
+        int endPc = 0;         // the PAR_END op
+        int privateCount = 0;  // worker frame size
+        int ivPrivate = 0;
+        int minIterations = 0;  // shorter ranges run serially
+        std::vector<Reduction> reductions;
+    };
+
+    struct FuncInfo {
+        std::string name;
+        int entry = 0;
+        int frameSize = 0;
+        int paramCount = 0;
+        long calls = 0;
+        int memo = -1;  // index into memoTables for memoized pure functions
+    };
+
+    struct CallRecord {
+        int returnPc;
+        int fp;
+        Slot dst;  // result slot in the caller's frame
+        int memo;       // memo table to fill on return, or -1
+        int memoEntry;
+    };
+
+    // Direct-mapped: an argument tuple hashes to exactly one entry, and a
+    // colliding tuple evicts it. Keys are `arity` ints per entry.
+    struct MemoTable {
+        int arity = 0;
+        std::vector<int> keys;
+        std::vector<int> values;
+        std::vector<unsigned char> used;
+        MemoStats stats;
+    };
+
+    // Mutable state of one run of the linked program: execute() and call()
+    // use the interpreter's own, every Instance has its own
+    struct RunState {
+        std::vector<int> globals;    // plus the trace fuel slot
+        std::vector<std::string> output;
+        long outputBytes = 0;
+        const int* input = nullptr;  // values for input(), not owned
+        size_t inputCount = 0;
+        size_t inputPos = 0;
+        std::atomic<long> stepsUsed{0};  // flushed from the contexts at budget checks
+        std::chrono::steady_clock::time_point started;
+    };
+
+    // Execution state of one thread: the main program, a worker running
+    // chunks of a parallel loop, a parallel loop run serially, or an
+    // Instance
+    struct Context {
+        RunState* run = nullptr;
+        int* st = nullptr;     // value stack
+        int stackSlots = 0;
+        int stackOffset = 0;   // slots of the same stack below `st`
+        int* outer = nullptr;  // frame enclosing the parallel region
+        int pc = 0;            // Program counter
+        int fp = 0;            // Current frame base in `st`
+        int sp = 0;            // First free stack slot
+        std::vector<CallRecord> callStack;
+        std::vector<long> calls;  // per-function call counts
+        bool worker = false;      // not the main thread: no memoization, profiling or tracing
+        int bodyStart = 0;        // region: first op of the body
+        int chunkEnd = 0;         // region: iteration bound of the chunk
+        int ivSlot = 0;           // region: private slot of the induction variable
+        int result = 0;           // value returned from the outermost call
+        long saved = 0;           // dispatches saved by superinstructions
+        bool paused = false;      // stopped at the end of the profiling window
+        long steps = 0;           // ops of the blocks entered
+        volatile long checkAt = 0;  // step count of the next budget check; zeroed by SIGPROF
+        long flushed = 0;         // steps already added to stepsUsed
+        int peakSlots = 0;        // deepest stack use, stackOffset included
+        long sliceEnd = LONG_MAX; // Instance: step count to yield at
+        bool yielded = false;     // Instance: stopped at the end of its slice
+    };
+
+    std::vector<Op> code;
+    std::vector<Slot> argPool;
+    std::vector<VecKernel> vecPool;
+    std::vector<ParRegion> parPool;
+    std::vector<FuncInfo> funcs;
+    RunState state;
+    std::string error;
+    std::unique_ptr<int[]> stack;  // uninitialized: frames are zeroed on push
+    int stackSize = 0;
+    Context mainContext;
+    bool quiet = false;
+    int threads = 1;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<Context> workers;
+    std::vector<std::vector<int>> workerStacks;
+    ParallelStats parallelStats;
+    bool memoize = false;
+    int memoEntries = DEFAULT_MEMO_ENTRIES;
+    std::vector<MemoTable> memoTables;
+    std::vector<int> memoPending;  // argument tuples of calls awaiting return
+    bool superinstructions = true;
+    long profileLeft = 0;          // dispatches left in the profiling window
+    std::vector<long> siteRuns;    // per op, during the profiling window
+    std::vector<long> pairRuns;    // per opcode pair / triple, same window
+    std::vector<long> tripleRuns;
+    SuperStats superStats;
+    ExecutionLimits limits;
+    bool budgeted = false;          // a step or time limit is set
+    std::vector<int> blockSteps;    // per op: ops up to and including the next jump, call or return
+    LineTable lineTable;            // op index -> source position
+    int fuelSlot = 0;               // global slot the traces count iterations down in
+    int yieldPc = 0;                // the YIELD op
+    BudgetStats budgetStats;
+    int sampleHz = 0;               // SIGPROF ticks per CPU second, 0: not sampling
+    std::vector<int> samples;       // per sample: frame count, call sites outer first, sampled op
+    long samplesDropped = 0;
+    uint32_t sampleSeed = 2463534242u;
+    SampleStats sampleStats;
+
+    // A recorded op; `taken` is the direction a conditional jump went
+    // while recording
+    struct TraceStep {
+        int pc;
+        OpCode code;
+        bool taken;
+    };
+    // Ops from `start` back to the loop header
+    struct TracePath {
+        int start = 0;
+        std::vector<TraceStep> steps;
+    };
+    // Loop [header, latch]: the recorded iteration plus side paths from
+    // guards that failed often
+    struct Trace {
+        int header = 0;
+        int latch = 0;
+        std::vector<TracePath> paths;
+        std::vector<std::pair<int, int>> branchExits;  // guard exit pc inside the loop, times taken
+        std::unique_ptr<jit::Code> native;
+        int (*entry)(int* globals, int* frame) = nullptr;  // returns the pc to resume at
+        long entries = 0;
+        int ops = 0;
+        int guards = 0;
+    };
+    bool tracing = true;
+    jit::PerfMap* perfMap = nullptr;   // names compiled traces for perf, not owned
+    // Superseded trace code stays mapped while perfMap has named it: a new
+    // trace at the same address would get two names in the map and dump
+    std::vector<std::unique_ptr<jit::Code>> retiredCode;
+    std::vector<OpCode> baseCode;      // opcodes before fusion
+    std::vector<std::string> labelAt;  // "function:label" of jump targets, for reports
+    std::vector<int> loopHeat;         // per header: back-edges taken, negative: never trace
+    std::vector<int> traceAt;          // per header: index into traces, or -1
+    std::vector<Trace> traces;
+    std::vector<std::string> rejectedLoops;
+    TraceStats traceStats;
 
 public:
+    // Quiet runs record output without printing it (profiling runs)
+    void setQuiet(bool value) { quiet = value; }
+
+    // Cache results of pure functions; `entries` is rounded up to a power of two
+    void setMemoize(bool value, int entries = DEFAULT_MEMO_ENTRIES) {
+        memoize = value;
+        memoEntries = 1;
+        while(memoEntries < entries) memoEntries <<= 1;
+    }
+
+    // Profile the first dispatches and fuse hot op sequences
+    void setSuperinstructions(bool value) { superinstructions = value; }
+
+    // Compile hot loops to native traces (x86-64 Linux and macOS only)
+    void setTracing(bool value) { tracing = value; }
+
+    // Announce every compiled trace to perf through `map`; null stops it
+    void setPerfMap(jit::PerfMap* map) { perfMap = map; }
+
+    // Quotas checked while running; exceeding one fails the run with LimitExceeded
+    void setLimits(const ExecutionLimits& value) { limits = value; }
+
+    // Sample the main thread `hz` times per CPU second during execute();
+    // 0 turns sampling off
+    void setSampling(int hz) { sampleHz = std::max(hz, 0); }
+
+    // Values returned by input(), in order; the caller keeps them alive
+    void setInput(const int* values, size_t count) {
+        state.input = values;
+        state.inputCount = count;
+        state.inputPos = 0;
+    }
+
+    // Number of values input() has consumed so far
+    size_t getInputPosition() const { return state.inputPos; }
+
+    // Worker threads for parallel loops; 0 means one per hardware thread
+    void setThreads(int count) {
+        threads = (count > 0) ? count : ThreadPool::defaultThreads();
+    }
+
     bool execute(const IRProgram& program) {
-        variables.clear();
-        output.clear();
-        pc = 0;
+        state.output.clear();
+        samples.clear();
+        samplesDropped = 0;
+        parallelStats = ParallelStats();
+        parallelStats.threads = threads;
+        startBudget();
+        error.clear();
+
+        bool ok = true;
+        try {
+            link(program);
+
+            state.globals.assign(program.globalCount + 1, 0);
+            fuelSlot = program.globalCount;
+            mainContext = Context();
+            mainContext.run = &state;
+            mainContext.st = mainStack(STACK_SLOTS);
+            mainContext.stackSlots = frameLimit(STACK_SLOTS);
+            mainContext.callStack.reserve(1024);
+            mainContext.calls.assign(funcs.size(), 0);
+            memoPending.clear();
+
+            mainContext.steps = blockSteps[0];
+            std::unique_ptr<SampleTimer> timer;
+            if(sampleHz > 0) timer = std::make_unique<SampleTimer>(sampleHz, &mainContext.checkAt);
+            runAt(mainContext);
+        } catch(const LimitExceeded& e) {
+            fprintf(stderr, "Runtime error: %s\n", e.what());
+            error = e.what();
+            budgetStats.exceeded = true;
+            budgetStats.resource = e.resource;
+            budgetStats.limit = e.limit;
+            ok = false;
+        } catch(const std::exception& e) {
+            fprintf(stderr, "Runtime error: %s\n", e.what());
+            error = e.what();
+            ok = false;
+        }
+        for(size_t i = 0; i < funcs.size() && i < mainContext.calls.size(); i++) {
+            funcs[i].calls = mainContext.calls[i];
+        }
+        superStats.removed = mainContext.saved;
+        finishTraceStats();
+        finishBudget();
+        finishSampleStats();
+        return ok;
+    }
+
+    const std::vector<std::string>& getOutput() const {
+        return state.output;
+    }
+
+    // Message of the runtime error that failed the last execute()
+    const std::string& getError() const { return error; }
+
+    // Links `program` for call() and spawn() without running its main
+    // code; call() frames go on a stack of `stackSlots`
+    void prepare(const IRProgram& program, int stackSlots = STACK_SLOTS) {
+        link(program);
+        state.globals.assign(program.globalCount + 1, 0);
+        fuelSlot = program.globalCount;
+        startBudget();
+        mainContext = Context();
+        mainContext.run = &state;
+        mainContext.st = mainStack(stackSlots);
+        mainContext.stackSlots = frameLimit(stackSlots);
+        mainContext.calls.assign(funcs.size(), 0);
+    }
+
+    int functionIndex(const std::string& name) const {
+        for(size_t i = 0; i < funcs.size(); i++) {
+            if(funcs[i].name == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Global slots of the prepared program, read and written by call()
+    std::vector<int>& globalState() { return state.globals; }
+
+    // Runs one call of a prepared program's function to completion and
+    // returns its result; output is reset first. Errors throw.
+    int call(int func, const int* args, int argCount) {
+        const FuncInfo& callee = funcs[func];
+        Context& ctx = mainContext;
+        state.output.clear();
+        memoPending.clear();
+        ctx.callStack.clear();
+        ctx.fp = 0;
+        ctx.sp = callee.frameSize;
+        std::fill(ctx.st, ctx.st + callee.frameSize, 0);
+        std::copy(args, args + argCount, ctx.st);
+        ctx.pc = callee.entry;
+        ctx.calls[func]++;
+        ctx.steps += blockSteps[ctx.pc];
+        runAt(ctx);
+        return ctx.result;
+    }
+
+    // Dynamic call count per function from the last run
+    std::unordered_map<std::string, long> getCallCounts() const {
+        std::unordered_map<std::string, long> counts;
+        for(const auto& func : funcs) counts[func.name] = func.calls;
+        return counts;
+    }
+
+    const ParallelStats& getParallelStats() const { return parallelStats; }
+
+    const SuperStats& getSuperStats() const { return superStats; }
+
+    const TraceStats& getTraceStats() const { return traceStats; }
+
+    // Samples of the last execute() under setSampling()
+    const SampleStats& getSampleStats() const { return sampleStats; }
+
+    // Resources used by the last execute(), and the limit it hit if any
+    const BudgetStats& getBudgetStats() const { return budgetStats; }
+
+    // "line N in f()" of a linked op, or "" when its position is unknown
+    std::string sourceLocation(int pc) const {
+        std::string at = lineTable.describe(pc);
+        if(at.empty()) return at;
+        const FuncInfo* owner = functionAt(pc);
+        return owner ? at + " in " + owner->name + "()" : at;
+    }
+
+    // One run of a prepared program, interleaved with others by resume()
+    class Instance {
+        friend class Interpreter;
+        RunState state;
+        std::vector<int> stack;
+        std::vector<int> input;  // unread input of a restored instance
+        Context ctx;
+        bool done = false;
+        long outputBase = 0;  // lines printed before the snapshot it was restored from
+
+    public:
+        bool finished() const { return done; }
+        // Lines printed since it was spawned or restored
+        const std::vector<std::string>& getOutput() const { return state.output; }
+        long getOutputLines() const { return outputBase + static_cast<long>(state.output.size()); }
+        long getSteps() const { return state.stepsUsed + ctx.steps - ctx.flushed; }
+
+        // Globals, value stack and call records
+        size_t memoryBytes() const {
+            return sizeof(Instance) + state.globals.capacity() * sizeof(int) +
+                   stack.capacity() * sizeof(int) + ctx.callStack.capacity() * sizeof(CallRecord) +
+                   ctx.calls.capacity() * sizeof(long);
+        }
+    };
+
+    // A fresh run of the prepared program's main code with a value stack
+    // of `stackSlots`; `input` must outlive it. Limits apply per instance.
+    std::unique_ptr<Instance> spawn(const int* input, size_t inputCount,
+                                    int stackSlots = INSTANCE_STACK_SLOTS) {
+        auto instance = std::make_unique<Instance>();
+        RunState& run = instance->state;
+        run.globals.assign(state.globals.size(), 0);
+        run.input = input;
+        run.inputCount = inputCount;
+        run.started = std::chrono::steady_clock::now();
+        instance->stack.assign(stackSlots, 0);
+        Context& ctx = instance->ctx;
+        ctx.run = &run;
+        ctx.st = instance->stack.data();
+        ctx.stackSlots = frameLimit(stackSlots);
+        ctx.worker = true;
+        ctx.calls.assign(funcs.size(), 0);
+        ctx.steps = blockSteps[0];
+        return instance;
+    }
 
-        // Initialize variables
-        for(const auto& [var, type] : program.variableTypes) {
-            variables[var] = 0;
+    // Runs `instance` until it finishes or enters a block past `slice`
+    // more steps; true once it has finished. Errors throw. Different
+    // instances may be resumed from different threads at once.
+    bool resume(Instance& instance, long slice) {
+        Context& ctx = instance.ctx;
+        ctx.sliceEnd = ctx.steps + slice;
+        ctx.checkAt = std::min(long(ctx.checkAt), ctx.sliceEnd);
+        ctx.yielded = false;
+        runAt(ctx);
+        instance.done = !ctx.yielded;
+        if(instance.done) flushSteps(ctx);
+        return instance.done;
+    }
+
+    // Writes a paused (or never resumed) instance of the prepared program
+    void saveInstance(const Instance& instance, std::ostream& out) const {
+        const Context& ctx = instance.ctx;
+        const RunState& run = instance.state;
+        if(instance.done) throw std::runtime_error("Snapshot: the instance has finished");
+        putNumber(out, static_cast<long>(code.size()));
+        putNumber(out, instance.getSteps());
+        putNumber(out, ctx.pc);
+        putNumber(out, ctx.fp);
+        putNumber(out, ctx.sp);
+        putNumber(out, instance.getOutputLines());
+        putNumber(out, run.outputBytes);
+        putNumber(out, static_cast<long>(run.globals.size()));
+        for(int value : run.globals) putNumber(out, value);
+        for(int i = 0; i < ctx.sp; i++) putNumber(out, ctx.st[i]);
+        putNumber(out, static_cast<long>(ctx.callStack.size()));
+        for(const auto& record : ctx.callStack) {
+            putNumber(out, record.returnPc);
+            putNumber(out, record.fp);
+            putNumber(out, record.dst.kind);
+            putNumber(out, record.dst.index);
+        }
+        putNumber(out, static_cast<long>(run.inputCount - run.inputPos));
+        for(size_t i = run.inputPos; i < run.inputCount; i++) putNumber(out, run.input[i]);
+        if(!out) throw std::runtime_error("Snapshot: write failed");
+    }
+
+    // An instance continuing where the one saved by saveInstance() paused;
+    // `in` must come from the same program. Malformed data throws.
+    std::unique_ptr<Instance> restoreInstance(std::istream& in, int stackSlots = STACK_SLOTS) {
+        auto fail = [](const char* what) -> long { throw std::runtime_error(std::string("Snapshot: ") + what); };
+        auto number = [&](long lo, long hi) {
+            long value = getNumber(in);
+            if(!in || value < lo || value > hi) fail("corrupt or truncated data");
+            return value;
+        };
+        if(number(0, LONG_MAX) != static_cast<long>(code.size())) fail("saved from a different program");
+
+        auto instance = spawn(nullptr, 0, stackSlots);
+        Context& ctx = instance->ctx;
+        RunState& run = instance->state;
+        long steps = number(0, LONG_MAX);
+        ctx.pc = static_cast<int>(number(0, static_cast<long>(code.size()) - 1));
+        ctx.fp = static_cast<int>(number(0, INT_MAX));
+        ctx.sp = static_cast<int>(number(ctx.fp, INT_MAX));
+        instance->outputBase = number(0, LONG_MAX);
+        run.outputBytes = number(0, LONG_MAX);
+        if(number(0, INT_MAX) != static_cast<long>(run.globals.size())) fail("saved from a different program");
+        for(int& value : run.globals) value = static_cast<int>(number(INT_MIN, INT_MAX));
+        if(ctx.sp > ctx.stackSlots) stackOverflow(ctx.sp);
+        for(int i = 0; i < ctx.sp; i++) ctx.st[i] = static_cast<int>(number(INT_MIN, INT_MAX));
+        long depth = number(0, MAX_CALL_DEPTH);
+        for(long i = 0; i < depth; i++) {
+            CallRecord record;
+            record.returnPc = static_cast<int>(number(0, static_cast<long>(code.size()) - 1));
+            record.fp = static_cast<int>(number(0, ctx.fp));
+            record.dst.kind = static_cast<Slot::Kind>(number(Slot::IMM, Slot::LOCAL));
+            record.dst.index = static_cast<int>(number(INT_MIN, INT_MAX));
+            bool inFrame = record.dst.kind != Slot::LOCAL ||
+                           (record.dst.index >= 0 && record.fp + record.dst.index < ctx.sp);
+            bool inGlobals = record.dst.kind != Slot::GLOBAL ||
+                             (record.dst.index >= 0 && record.dst.index < static_cast<int>(run.globals.size()));
+            if(!inFrame || !inGlobals) fail("corrupt or truncated data");
+            record.memo = -1;
+            record.memoEntry = 0;
+            ctx.callStack.push_back(record);
         }
+        long unread = number(0, INT_MAX);
+        for(long i = 0; i < unread; i++) instance->input.push_back(static_cast<int>(number(INT_MIN, INT_MAX)));
+        run.input = instance->input.data();
+        run.inputCount = instance->input.size();
 
+        // The block at pc was charged before the pause
+        run.stepsUsed = steps;
+        ctx.steps = ctx.flushed = steps;
+        ctx.peakSlots = ctx.sp;
+        return instance;
+    }
+
+    std::vector<MemoStats> getMemoStats() const {
+        std::vector<MemoStats> result;
+        for(const auto& table : memoTables) result.push_back(table.stats);
+        return result;
+    }
+
+private:
+    // Value stack of the main context, kept across runs of the same size.
+    // Not zero-filled: a call clears its frame, so a fresh run does not
+    // touch pages it never uses.
+    int* mainStack(int slots) {
+        if(stackSize != slots) {
+            stack.reset(new int[slots]);
+            stackSize = slots;
+        }
+        return stack.get();
+    }
+
+    // run() for an entry point: errors are rethrown with the source
+    // position of the op that raised them
+    void runAt(Context& ctx) {
         try {
-            while(pc < static_cast<int>(program.instructions.size())) {
-                const auto& instr = program.instructions[pc];
+            run(ctx);
+        } catch(const LimitExceeded& e) {
+            std::string at = sourceLocation(ctx.pc);
+            if(at.empty()) throw;
+            throw LimitExceeded(e.resource, e.limit, e.used, at);
+        } catch(const std::exception& e) {
+            std::string at = sourceLocation(ctx.pc);
+            if(at.empty()) throw;
+            throw std::runtime_error(std::string(e.what()) + " at " + at);
+        }
+    }
 
-                switch(instr.type) {
-                    case InstrType::BIN_OP:
-                        executeBinOp(instr);
-                        break;
-                    case InstrType::UN_OP:
-                        executeUnOp(instr);
-                        break;
-                    case InstrType::ASSIGN:
-                        executeAssign(instr);
-                        break;
-                    case InstrType::LABEL:
-                        // Labels don't execute anything
-                        break;
-                    case InstrType::GOTO:
-                        pc = findLabel(program, instr.label) - 1;
-                        break;
-                    case InstrType::IF_GOTO: {
-                        int condValue = getValue(instr.op1);
-                        if(condValue == 0) {
-                            pc = findLabel(program, instr.label) - 1;
+    // The main thread runs the profiling loop until the window closes,
+    // fuses hot sites and resumes in the plain loop
+    void run(Context& ctx) {
+        if(profileLeft > 0 && !ctx.worker) {
+            ctx.paused = false;
+            runLoop<true>(ctx);
+            if(!ctx.paused) return;
+            fuseHotSites();
+        }
+        runLoop<false>(ctx);
+    }
+
+    // Zigzag LEB128: small values of either sign take one byte
+    static void putNumber(std::ostream& out, long value) {
+        unsigned long bits = (static_cast<unsigned long>(value) << 1) ^ static_cast<unsigned long>(value >> 63);
+        while(bits >= 0x80) {
+            out.put(static_cast<char>((bits & 0x7F) | 0x80));
+            bits >>= 7;
+        }
+        out.put(static_cast<char>(bits));
+    }
+
+    static long getNumber(std::istream& in) {
+        unsigned long bits = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            int c = in.get();
+            if(c == EOF) break;
+            bits |= static_cast<unsigned long>(c & 0x7F) << shift;
+            if(!(c & 0x80)) return static_cast<long>(bits >> 1) ^ -static_cast<long>(bits & 1);
+        }
+        in.setstate(std::ios::failbit);
+        return 0;
+    }
+
+    template<bool Profile>
+    void runLoop(Context& ctx) {
+        const Op* ops = code.data();
+        RunState& run = *ctx.run;
+        int* gl = run.globals.data();
+        int* st = ctx.st;
+        int* outer = ctx.outer;
+        int pc = ctx.pc;
+        int fp = ctx.fp;
+        int sp = ctx.sp;
+        long* calls = ctx.calls.data();
+        auto& callStack = ctx.callStack;
+        bool traceLoops = !loopHeat.empty() && !ctx.worker;
+        const int* blocks = blockSteps.data();
+
+        // Control enters the block at `next`: charge its ops to the
+        // budget, or yield there when the slice is over
+        auto enter = [&](int next) -> int {
+            if((ctx.steps += blocks[next]) >= ctx.checkAt && checkBudget(ctx, pc, next)) {
+                ctx.pc = next;
+                return yieldPc;
+            }
+            return next;
+        };
+        // Goto from `from` to `target`; back-edges may run a trace
+        auto jump = [&](int from, int target) -> int {
+            return enter((traceLoops && target <= from) ? backEdge(target, from, st + fp, ctx) : target);
+        };
+
+        auto read = [&](const Slot& s) -> int {
+            switch(s.kind) {
+                case Slot::IMM: return s.index;
+                case Slot::GLOBAL: return gl[s.index];
+                case Slot::LOCAL: return st[fp + s.index];
+                default: return outer[s.index];
+            }
+        };
+        auto write = [&](const Slot& s, int value) {
+            if(s.kind == Slot::GLOBAL) gl[s.index] = value;
+            else if(s.kind == Slot::LOCAL) st[fp + s.index] = value;
+            else if(s.kind == Slot::OUTER) outer[s.index] = value;
+        };
+        auto elementUnchecked = [&](const Slot& base, int index) -> int& {
+            switch(base.kind) {
+                case Slot::GLOBAL: return gl[base.index + index];
+                case Slot::LOCAL: return st[fp + base.index + index];
+                default: return outer[base.index + index];
+            }
+        };
+        auto element = [&](const Slot& base, int index, int size) -> int& {
+            if(static_cast<unsigned>(index) >= static_cast<unsigned>(size)) {
+                throw std::runtime_error("Array index " + std::to_string(index) +
+                                         " out of bounds [0, " + std::to_string(size) + ")");
+            }
+            return elementUnchecked(base, index);
+        };
+
+        // A failing op leaves its pc in the context for the error report
+        struct FaultPc {
+            Context& ctx;
+            const int& pc;
+            ~FaultPc() {
+                if(std::uncaught_exceptions() > 0) ctx.pc = pc;
+            }
+        } faultPc{ctx, pc};
+
+        int previous[2] = {-1, -1};  // opcodes of the last two dispatches
+        while(true) {
+            const Op& op = ops[pc];
+
+            if constexpr(Profile) {
+                if(profileLeft == 0) {
+                    ctx.pc = pc;
+                    ctx.fp = fp;
+                    ctx.sp = sp;
+                    ctx.paused = true;
+                    return;
+                }
+                profileLeft--;
+                siteRuns[pc]++;
+                int current = static_cast<int>(op.code);
+                if(previous[1] >= 0) {
+                    pairRuns[previous[1] * OPCODE_SLOTS + current]++;
+                    if(previous[0] >= 0) {
+                        tripleRuns[(previous[0] * OPCODE_SLOTS + previous[1]) * OPCODE_SLOTS + current]++;
+                    }
+                }
+                previous[0] = previous[1];
+                previous[1] = current;
+            }
+
+            switch(op.code) {
+                case OpCode::BIN:
+                    write(op.dst, binary(op.binOp, read(op.a), read(op.b)));
+                    break;
+                case OpCode::UN: {
+                    int operand = read(op.a);
+                    write(op.dst, (op.unOp == UnOp::NEG) ? -operand : (operand ? 0 : 1));
+                    break;
+                }
+                case OpCode::MOVE:
+                    write(op.dst, read(op.a));
+                    break;
+                case OpCode::LOAD:
+                    write(op.dst, element(op.a, read(op.b), op.target));
+                    break;
+                case OpCode::STORE:
+                    element(op.dst, read(op.a), op.target) = read(op.b);
+                    break;
+                case OpCode::LOAD_UNCHECKED:
+                    write(op.dst, elementUnchecked(op.a, read(op.b)));
+                    break;
+                case OpCode::STORE_UNCHECKED:
+                    elementUnchecked(op.dst, read(op.a)) = read(op.b);
+                    break;
+                case OpCode::VEC_MAP:
+                case OpCode::VEC_REDUCE: {
+                    const VecKernel& kernel = vecPool[op.target];
+                    int lo = read(kernel.lo);
+                    int hi = read(kernel.hi);
+                    if(hi <= lo) break;
+
+                    // Range check once: the first out-of-range index is
+                    // the one the scalar loop would have failed on
+                    auto span = [&](const Slot& base, int offset, int size) -> int* {
+                        int first = lo + offset;
+                        int last = hi - 1 + offset;
+                        if(first < 0 || first >= size) element(base, first, size);
+                        if(last >= size) element(base, size, size);
+                        return &elementUnchecked(base, first);
+                    };
+                    simd::Source src[2];
+                    for(int i = 0; i < 2; i++) {
+                        const VecSource& s = kernel.src[i];
+                        if(s.array) src[i].ptr = span(s.slot, s.offset, s.size);
+                        else src[i].scalar = read(s.slot);
+                    }
+
+                    if(op.code == OpCode::VEC_MAP) {
+                        simd::map(kernel.op, span(kernel.dst, 0, kernel.dstSize), src[0], src[1], hi - lo);
+                    } else {
+                        int sum = simd::reduce(kernel.op, src[0], src[1], hi - lo);
+                        write(kernel.dst, simd::scalarOp(BinOp::ADD, read(kernel.dst), sum));
+                    }
+                    break;
+                }
+                case OpCode::JUMP:
+                    pc = jump(pc, op.target);
+                    continue;
+                case OpCode::JUMP_IF_ZERO:
+                    if(read(op.a) == 0) {
+                        pc = enter(op.target);
+                        continue;
+                    }
+                    pc = enter(pc + 1);
+                    continue;
+                case OpCode::PRINT: {
+                    std::string text = std::to_string(read(op.a));
+                    run.outputBytes += static_cast<long>(text.size()) + 1;
+                    if(limits.outputBytes > 0 && run.outputBytes > limits.outputBytes) {
+                        throw LimitExceeded(LimitExceeded::OUTPUT, limits.outputBytes, run.outputBytes);
+                    }
+                    if(!quiet) printf("%s\n", text.c_str());
+                    run.output.push_back(std::move(text));
+                    break;
+                }
+                case OpCode::INPUT:
+                    if(run.inputPos >= run.inputCount) throw std::runtime_error("input(): no more input values");
+                    write(op.dst, run.input[run.inputPos++]);
+                    break;
+                case OpCode::CALL: {
+                    const FuncInfo& callee = funcs[op.target];
+                    calls[op.target]++;
+                    const Slot* args = argPool.data() + op.argBegin;
+                    int memo = ctx.worker ? -1 : callee.memo;
+
+                    int memoEntry = 0;
+                    if(memo >= 0) {
+                        MemoTable& table = memoTables[callee.memo];
+                        size_t h = 0x9e3779b9u;
+                        for(int i = 0; i < op.argCount; i++) {
+                            h = (h ^ static_cast<unsigned>(read(args[i]))) * 0x100000001b3ull;
+                        }
+                        memoEntry = static_cast<int>((h ^ (h >> 29)) & (memoEntries - 1));
+
+                        const int* key = table.keys.data() + static_cast<size_t>(memoEntry) * table.arity;
+                        bool hit = table.used[memoEntry];
+                        for(int i = 0; hit && i < op.argCount; i++) {
+                            hit = key[i] == read(args[i]);
+                        }
+                        if(hit) {
+                            table.stats.hits++;
+                            write(op.dst, table.values[memoEntry]);
+                            pc = enter(pc + 1);
+                            continue;
+                        }
+                        table.stats.misses++;
+                        for(int i = 0; i < op.argCount; i++) {
+                            memoPending.push_back(read(args[i]));
                         }
-                        break;
                     }
-                    case InstrType::PRINT: {
-                        int value = getValue(instr.op1);
-                        printf("%d\n", value);
-                        output.push_back(std::to_string(value));
+
+                    if(sp + callee.frameSize > ctx.stackSlots ||
+                       static_cast<int>(callStack.size()) >= MAX_CALL_DEPTH) {
+                        stackOverflow(ctx.stackOffset + sp + callee.frameSize);
+                    }
+
+                    int newFp = sp;
+                    std::fill(st + newFp, st + newFp + callee.frameSize, 0);
+                    for(int i = 0; i < op.argCount; i++) {
+                        st[newFp + i] = read(args[i]);
+                    }
+
+                    callStack.push_back({pc + 1, fp, op.dst, memo, memoEntry});
+                    fp = newFp;
+                    sp = newFp + callee.frameSize;
+                    ctx.peakSlots = std::max(ctx.peakSlots, ctx.stackOffset + sp);
+                    pc = enter(callee.entry);
+                    continue;
+                }
+                case OpCode::RET: {
+                    int value = read(op.a);
+                    if(callStack.empty()) {  // return from top level
+                        ctx.result = value;
+                        return;
+                    }
+                    const CallRecord rec = callStack.back();
+                    callStack.pop_back();
+                    if(rec.memo >= 0) storeMemo(rec.memo, rec.memoEntry, value);
+                    sp = fp;
+                    fp = rec.fp;
+                    pc = enter(rec.returnPc);
+                    write(rec.dst, value);
+                    continue;
+                }
+                case OpCode::PARALLEL: {
+                    const ParRegion& region = parPool[op.target];
+                    int lo = read(op.a);
+                    int hi = read(op.b);
+                    ctx.fp = fp;
+                    ctx.sp = sp;
+                    runRegion(region, ctx, lo, hi);
+                    if(hi > lo) write(op.dst, hi);
+                    pc = enter(region.endPc + 1);
+                    continue;
+                }
+                case OpCode::PAR_END:
+                    if(++st[fp + ctx.ivSlot] < ctx.chunkEnd) {
+                        pc = enter(ctx.bodyStart);
+                        continue;
+                    }
+                    return;
+                case OpCode::HALT:
+                    return;
+                case OpCode::YIELD:
+                    ctx.fp = fp;
+                    ctx.sp = sp;
+                    ctx.yielded = true;
+                    return;
+
+                // The second op of a fused sequence consumes the value the
+                // first one computed (see chained()); it is forwarded
+                // instead of read back from its slot
+                case OpCode::BIN_JZ: {
+                    int value = binary(op.binOp, read(op.a), read(op.b));
+                    write(op.dst, value);
+                    ctx.saved++;
+                    pc = enter(value ? pc + 2 : ops[pc + 1].target);
+                    continue;
+                }
+                case OpCode::BIN_MOVE:
+                case OpCode::BIN_MOVE_JUMP: {
+                    int value = binary(op.binOp, read(op.a), read(op.b));
+                    write(op.dst, value);
+                    write(ops[pc + 1].dst, value);
+                    if(op.code == OpCode::BIN_MOVE) {
+                        ctx.saved++;
+                        pc += 2;
+                    } else {
+                        ctx.saved += 2;
+                        pc = jump(pc + 2, ops[pc + 2].target);
+                    }
+                    continue;
+                }
+                case OpCode::BIN_BIN: {
+                    const Op& second = ops[pc + 1];
+                    int value = binary(op.binOp, read(op.a), read(op.b));
+                    write(op.dst, value);
+                    write(second.dst, binary(second.binOp, value, read(second.b)));
+                    ctx.saved++;
+                    pc += 2;
+                    continue;
+                }
+                case OpCode::MOVE_JUMP:
+                    write(op.dst, read(op.a));
+                    ctx.saved++;
+                    pc = jump(pc + 1, ops[pc + 1].target);
+                    continue;
+                case OpCode::LOAD_BIN:
+                case OpCode::LOAD_BIN_JZ: {
+                    // Checked either way: an unchecked load is proven in range
+                    const Op& second = ops[pc + 1];
+                    int loaded = element(op.a, read(op.b), op.target);
+                    write(op.dst, loaded);
+                    int value = binary(second.binOp, loaded, read(second.b));
+                    write(second.dst, value);
+                    if(op.code == OpCode::LOAD_BIN) {
+                        ctx.saved++;
+                        pc += 2;
+                    } else {
+                        ctx.saved += 2;
+                        pc = enter(value ? pc + 3 : ops[pc + 2].target);
+                    }
+                    continue;
+                }
+                case OpCode::OPCODE_COUNT:
+                    break;
+            }
+
+            pc++;
+        }
+    }
+
+    // ---------- Superinstructions ----------
+
+    static constexpr int OPCODE_SLOTS = static_cast<int>(OpCode::OPCODE_COUNT);
+
+    static const char* opName(int code) {
+        static const char* const names[] = {
+            "BIN", "UN", "MOVE", "JUMP", "JUMP_IF_ZERO", "CALL", "RET", "PRINT", "INPUT",
+            "LOAD", "STORE", "LOAD_UNCHECKED", "STORE_UNCHECKED", "VEC_MAP", "VEC_REDUCE",
+            "PARALLEL", "PAR_END", "HALT", "YIELD", "BIN_JZ", "BIN_MOVE", "BIN_MOVE_JUMP", "BIN_BIN",
+            "MOVE_JUMP", "LOAD_BIN", "LOAD_BIN_JZ"
+        };
+        static_assert(sizeof(names) / sizeof(names[0]) == OPCODE_SLOTS, "opcode names");
+        return names[code];
+    }
+
+    // `next` takes `prev`'s result as its first operand (ifz, copy source
+    // or left operand)
+    static bool chained(const Op& prev, const Op& next) {
+        return prev.dst.kind != Slot::IMM && prev.dst.kind == next.a.kind &&
+               prev.dst.index == next.a.index;
+    }
+
+    void startProfile() {
+        profileLeft = superinstructions ? PROFILE_DISPATCHES : 0;
+        superStats = SuperStats();
+        siteRuns.assign(superinstructions ? code.size() : 0, 0);
+        pairRuns.assign(superinstructions ? OPCODE_SLOTS * OPCODE_SLOTS : 0, 0);
+        tripleRuns.assign(superinstructions ? OPCODE_SLOTS * OPCODE_SLOTS * OPCODE_SLOTS : 0, 0);
+    }
+
+    // Rewrites the first op of every hot site that starts a fusion
+    // pattern. Patterns begin with ops that always fall through, so a
+    // site's run count is the count of the whole sequence.
+    void fuseHotSites() {
+        superStats.profiled = PROFILE_DISPATCHES;
+        bool fusedPair[OPCODE_SLOTS * OPCODE_SLOTS] = {};
+        bool fusedTriple[OPCODE_SLOTS * OPCODE_SLOTS * OPCODE_SLOTS] = {};
+        size_t size = code.size();
+        std::vector<int> covered(size, 1);  // ops executed by the site's dispatch
+
+        for(size_t i = 0; i < size; i++) {
+            if(siteRuns[i] < HOT_SITE_RUNS) continue;
+            for(const Fusion& f : FUSIONS) {
+                bool match = i + f.length <= size;
+                for(int k = 0; match && k < f.length; k++) match = code[i + k].code == f.ops[k];
+                for(int k = 1; match && k < f.length && f.ops[k] != OpCode::JUMP; k++) {
+                    match = chained(code[i + k - 1], code[i + k]);
+                }
+                if(!match) continue;
+
+                int pair = static_cast<int>(f.ops[0]) * OPCODE_SLOTS + static_cast<int>(f.ops[1]);
+                fusedPair[pair] = true;
+                if(f.length == 3) fusedTriple[pair * OPCODE_SLOTS + static_cast<int>(f.ops[2])] = true;
+                covered[i] = f.length;
+                superStats.sites++;
+                break;
+            }
+        }
+
+        // Dispatches the window would have saved: a fused site absorbs
+        // the dispatches of the ops it covers whenever it is itself
+        // dispatched (sites inside a fused sequence may also be fused,
+        // for jumps that land on them)
+        std::vector<long> absorbed(size, 0);
+        long removed = 0;
+        for(size_t i = 0; i < size; i++) {
+            long dispatched = siteRuns[i] - absorbed[i];
+            for(int k = 1; k < covered[i]; k++) absorbed[i + k] += dispatched;
+            removed += absorbed[i];
+        }
+        for(size_t i = 0; i < size; i++) {
+            for(const Fusion& f : FUSIONS) {
+                if(covered[i] == f.length && code[i].code == f.ops[0] && code[i + 1].code == f.ops[1] &&
+                   (f.length == 2 || code[i + 2].code == f.ops[2])) {
+                    code[i].code = f.fused;
+                    break;
+                }
+            }
+        }
+        superStats.coverage = 100.0 * removed / PROFILE_DISPATCHES;
+
+        // Report the hottest sequences of original opcodes
+        auto hottest = [&](const std::vector<long>& runs, int length, const bool* fused) {
+            std::vector<SuperStats::Sequence> result;
+            for(size_t key = 0; key < runs.size(); key++) {
+                if(runs[key] == 0) continue;
+                SuperStats::Sequence seq;
+                int k = static_cast<int>(key);
+                std::string names = opName(k % OPCODE_SLOTS);
+                for(int n = 1; n < length; n++) {
+                    k /= OPCODE_SLOTS;
+                    names = std::string(opName(k % OPCODE_SLOTS)) + " " + names;
+                }
+                seq.ops = names;
+                seq.count = runs[key];
+                seq.fused = fused[key];
+                result.push_back(seq);
+            }
+            std::sort(result.begin(), result.end(), [](const auto& x, const auto& y) {
+                return x.count > y.count;
+            });
+            if(result.size() > REPORTED_SEQUENCES) result.resize(REPORTED_SEQUENCES);
+            return result;
+        };
+        superStats.pairs = hottest(pairRuns, 2, fusedPair);
+        superStats.triples = hottest(tripleRuns, 3, fusedTriple);
+        profileLeft = 0;
+    }
+
+    // ---------- Tracing ----------
+
+    void startTracing() {
+        baseCode.resize(code.size());
+        for(size_t i = 0; i < code.size(); i++) baseCode[i] = code[i].code;
+        labelAt.resize(code.size());
+        for(auto& trace : traces) retire(trace);
+        traces.clear();
+        traceStats = TraceStats();
+        rejectedLoops.clear();
+        bool native = false;
+#ifdef LAB3_JIT
+        native = tracing;
+#endif
+        loopHeat.assign(native ? code.size() : 0, 0);
+        traceAt.assign(native ? code.size() : 0, -1);
+    }
+
+    // A goto at `latch` back to `header` was taken; returns the pc to
+    // continue at
+    int backEdge(int header, int latch, int* frame, Context& ctx) {
+        int t = traceAt[header];
+        if(t >= 0) return runTrace(t, frame, ctx);
+        if(loopHeat[header] < 0 || ++loopHeat[header] < HOT_LOOP_ITERATIONS) return header;
+
+        Trace trace;
+        trace.header = header;
+        trace.latch = latch;
+        trace.paths.emplace_back();
+        std::string why;
+        int resume = recordPath(trace, header, frame, trace.paths[0].steps, why);
+        if(resume != header) {
+            if(!why.empty()) rejectedLoops.push_back("loop " + loopName(header) + " not traced: " + why);
+            loopHeat[header] = why.empty() ? 0 : -1;  // retry if the loop just ended
+            return resume;
+        }
+        traces.push_back(std::move(trace));
+        t = static_cast<int>(traces.size()) - 1;
+        if(!compileTrace(traces[t])) {
+            traces.pop_back();
+            loopHeat[header] = -1;
+            return header;
+        }
+        traceAt[header] = t;
+        return header;
+    }
+
+    int runTrace(int t, int* frame, Context& ctx) {
+        Trace& trace = traces[t];
+        // Iterations charge their ops; the trace leaves when the steps
+        // left before the next budget check are spent. While sampling,
+        // the trace comes back often enough to see the pending tick.
+        long fuel = std::min(ctx.checkAt - ctx.steps, sampleHz > 0 ? BUDGET_CHECK_STEPS : TRACE_FUEL);
+        if(fuel <= 0) return trace.header;
+        int* gl = ctx.run->globals.data();
+        gl[fuelSlot] = static_cast<int>(fuel);
+        trace.entries++;
+        int pc = trace.entry(gl, frame);
+        ctx.steps += fuel - gl[fuelSlot];
+        if(sampleHz > 0 && SampleTimer::take()) {
+            takeSample(ctx, ctx.callStack.size(), -1, trace.header, trace.latch - trace.header + 1);
+        }
+
+        // A guard that keeps failing into the loop body grows a side path
+        for(auto& exit : trace.branchExits) {
+            if(exit.first != pc || ++exit.second != HOT_SIDE_EXITS) continue;
+            if(trace.paths.size() > MAX_TRACE_PATHS) break;
+            TracePath path;
+            path.start = pc;
+            std::string why;
+            int resume = recordPath(trace, pc, frame, path.steps, why);
+            if(resume == trace.header) {
+                trace.paths.push_back(std::move(path));
+                if(!compileTrace(trace)) traceAt[trace.header] = -1;
+            }
+            return resume;
+        }
+        return pc;
+    }
+
+    static bool traceable(OpCode code) {
+        switch(code) {
+            case OpCode::BIN: case OpCode::UN: case OpCode::MOVE:
+            case OpCode::LOAD: case OpCode::STORE:
+            case OpCode::LOAD_UNCHECKED: case OpCode::STORE_UNCHECKED:
+            case OpCode::JUMP: case OpCode::JUMP_IF_ZERO:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Executes the loop body op by op from `pc` until control is back at
+    // the header, recording each op. Returns the pc to continue at: the
+    // header when the path is complete, else the first op not executed,
+    // with `why` set unless the loop merely exited.
+    int recordPath(const Trace& trace, int pc, int* frame, std::vector<TraceStep>& steps,
+                   std::string& why) {
+        int* gl = state.globals.data();  // traces run on the main thread only
+        auto read = [&](const Slot& s) -> int {
+            return (s.kind == Slot::IMM) ? s.index : (s.kind == Slot::GLOBAL) ? gl[s.index] : frame[s.index];
+        };
+        auto cell = [&](const Slot& s, int offset = 0) -> int& {
+            return (s.kind == Slot::GLOBAL) ? gl[s.index + offset] : frame[s.index + offset];
+        };
+        auto checked = [&](int index, int size) {
+            if(static_cast<unsigned>(index) >= static_cast<unsigned>(size)) {
+                throw std::runtime_error("Array index " + std::to_string(index) +
+                                         " out of bounds [0, " + std::to_string(size) + ")");
+            }
+            return index;
+        };
+
+        do {
+            if(pc < trace.header || pc > trace.latch) return pc;  // left the loop
+            const Op& op = code[pc];
+            OpCode base = baseCode[pc];
+            if(!traceable(base)) {
+                why = (base == OpCode::CALL) ? "calls a function"
+                    : (base == OpCode::PRINT) ? "prints"
+                    : (base == OpCode::INPUT) ? "reads input"
+                    : "has a vector or parallel loop";
+                return pc;
+            }
+            if(steps.size() >= MAX_TRACE_OPS) {
+                why = "iteration too long";
+                return pc;
+            }
+
+            TraceStep step{pc, base, false};
+            int next = pc + 1;
+            switch(base) {
+                case OpCode::BIN:
+                    cell(op.dst) = binary(op.binOp, read(op.a), read(op.b));
+                    break;
+                case OpCode::UN: {
+                    int operand = read(op.a);
+                    cell(op.dst) = (op.unOp == UnOp::NEG) ? -operand : (operand ? 0 : 1);
+                    break;
+                }
+                case OpCode::MOVE:
+                    cell(op.dst) = read(op.a);
+                    break;
+                case OpCode::LOAD:
+                case OpCode::LOAD_UNCHECKED:
+                    cell(op.dst) = cell(op.a, checked(read(op.b), op.target));
+                    break;
+                case OpCode::STORE:
+                case OpCode::STORE_UNCHECKED:
+                    cell(op.dst, checked(read(op.a), op.target)) = read(op.b);
+                    break;
+                case OpCode::JUMP:
+                    next = op.target;
+                    break;
+                default:  // JUMP_IF_ZERO
+                    step.taken = read(op.a) == 0;
+                    if(step.taken) next = op.target;
+                    break;
+            }
+            steps.push_back(step);
+            if(next <= pc && next != trace.header) {
+                why = "contains an inner loop";
+                return next;
+            }
+            pc = next;
+        } while(pc != trace.header);
+        return pc;
+    }
+
+    // x86-64 for the trace tree: RDI = globals, RSI = frame. The main path
+    // loops back to its top; a failing guard jumps to the side path that
+    // starts at its target, or returns the pc to resume at in EAX.
+    bool compileTrace(Trace& trace) {
+        jit::Assembler as;
+        std::vector<int> pathLabels;
+        for(size_t i = 0; i < trace.paths.size(); i++) pathLabels.push_back(as.newLabel());
+        std::vector<std::pair<int, int>> exits;  // label, pc
+        auto exitTo = [&](int pc) {
+            for(const auto& e : exits) if(e.second == pc) return e.first;
+            exits.push_back({as.newLabel(), pc});
+            return exits.back().first;
+        };
+        // Guard target: a side path starting at `pc`, else an exit
+        trace.branchExits.clear();
+        auto branchTo = [&](int pc) {
+            for(size_t i = 1; i < trace.paths.size(); i++) {
+                if(trace.paths[i].start == pc) return pathLabels[i];
+            }
+            if(pc >= trace.header && pc <= trace.latch) {
+                bool known = false;
+                for(const auto& exit : trace.branchExits) known = known || exit.first == pc;
+                if(!known) trace.branchExits.push_back({pc, 0});
+            }
+            return exitTo(pc);
+        };
+        // Leaving a path after `executed` of its ops goes through a stub
+        // charging them to the fuel; a completed path charges all its ops
+        std::vector<std::array<int, 3>> charges;  // label, ops, destination
+        int executed = 0;
+        auto leave = [&](int label, int ops) {
+            if(ops == 0) return label;
+            charges.push_back({as.newLabel(), ops, label});
+            return charges.back()[0];
+        };
+
+        // EAX caches the value of `cached` after it was computed or
+        // stored, saving the reload by the next op
+        Slot cached;
+        bool valid = false;
+        auto base = [](const Slot& s) { return s.kind == Slot::GLOBAL ? jit::RDI : jit::RSI; };
+        auto same = [](const Slot& x, const Slot& y) { return x.kind == y.kind && x.index == y.index; };
+        auto load = [&](jit::Reg r, const Slot& s) {
+            if(s.kind == Slot::IMM) as.movImm(r, s.index);
+            else if(valid && same(s, cached)) { if(r != jit::EAX) as.mov(r, jit::EAX); }
+            else as.load(r, base(s), s.index * 4);
+        };
+        auto storeEax = [&](const Slot& dst) {
+            as.store(base(dst), dst.index * 4, jit::EAX);
+            cached = dst;
+            valid = true;
+        };
+        // Errors are raised by the interpreter: leave before the op
+        auto boundsCheck = [&](const Op& op, bool check, int pc) {
+            if(check) {
+                as.cmpImm(jit::ECX, op.target);
+                as.jcc(jit::AE, leave(exitTo(pc), executed));
+            }
+        };
+
+        int ops = 0, guards = 0;
+        std::vector<jit::PerfMap::Line> lines;  // where the code of each op starts
+        for(size_t p = 0; p < trace.paths.size(); p++) {
+            as.bind(pathLabels[p]);
+            valid = false;
+            executed = 0;
+            for(const auto& step : trace.paths[p].steps) {
+                const Op& op = code[step.pc];
+                ops++;
+                if(const LineTable::Range* range = lineTable.find(step.pc)) lines.push_back({as.size(), range->line});
+                switch(step.code) {
+                    case OpCode::BIN: {
+                        // Load the right operand first: it may be the cached one
+                        load(jit::ECX, op.b);
+                        load(jit::EAX, op.a);
+                        switch(op.binOp) {
+                            case BinOp::ADD: as.add(jit::EAX, jit::ECX); break;
+                            case BinOp::SUB: as.sub(jit::EAX, jit::ECX); break;
+                            case BinOp::MUL: as.imul(jit::EAX, jit::ECX); break;
+                            case BinOp::DIV:
+                            case BinOp::MOD:
+                                // Zero (error) and -1 (overflow trap) go back to the interpreter
+                                as.cmpImm(jit::ECX, 0);
+                                as.jcc(jit::E, leave(exitTo(step.pc), executed));
+                                as.cmpImm(jit::ECX, -1);
+                                as.jcc(jit::E, leave(exitTo(step.pc), executed));
+                                as.cdq();
+                                as.idiv(jit::ECX);
+                                if(op.binOp == BinOp::MOD) as.mov(jit::EAX, jit::EDX);
+                                break;
+                            case BinOp::AND:
+                            case BinOp::OR:
+                                as.test(jit::EAX);
+                                as.setcc(jit::NE, jit::EAX);
+                                as.test(jit::ECX);
+                                as.setcc(jit::NE, jit::ECX);
+                                if(op.binOp == BinOp::AND) as.andByte(jit::EAX, jit::ECX);
+                                else as.orByte(jit::EAX, jit::ECX);
+                                as.movzxByte(jit::EAX);
+                                break;
+                            default: {
+                                jit::Cond cond = jit::E;
+                                switch(op.binOp) {
+                                    case BinOp::NE: cond = jit::NE; break;
+                                    case BinOp::LT: cond = jit::L; break;
+                                    case BinOp::GT: cond = jit::G; break;
+                                    case BinOp::LE: cond = jit::LE; break;
+                                    case BinOp::GE: cond = jit::GE; break;
+                                    default: break;
+                                }
+                                as.cmp(jit::EAX, jit::ECX);
+                                as.setcc(cond, jit::EAX);
+                                as.movzxByte(jit::EAX);
+                                break;
+                            }
+                        }
+                        storeEax(op.dst);
                         break;
                     }
-                    case InstrType::RETURN:
-                        return true;
-                    case InstrType::CALL:
-                        // Built-in print function handling
-                        if(instr.funcName == "print" && !instr.args.empty()) {
-                            int value = getValue(instr.args[0]);
-                            printf("%d\n", value);
-                            output.push_back(std::to_string(value));
+                    case OpCode::UN:
+                        load(jit::EAX, op.a);
+                        if(op.unOp == UnOp::NEG) {
+                            as.neg(jit::EAX);
+                        } else {
+                            as.test(jit::EAX);
+                            as.setcc(jit::E, jit::EAX);
+                            as.movzxByte(jit::EAX);
                         }
+                        storeEax(op.dst);
+                        break;
+                    case OpCode::MOVE:
+                        load(jit::EAX, op.a);
+                        storeEax(op.dst);
+                        break;
+                    case OpCode::LOAD:
+                    case OpCode::LOAD_UNCHECKED:
+                        load(jit::ECX, op.b);
+                        boundsCheck(op, step.code == OpCode::LOAD, step.pc);
+                        as.loadIndexed(jit::EAX, base(op.a), op.a.index * 4);
+                        storeEax(op.dst);
+                        break;
+                    case OpCode::STORE:
+                    case OpCode::STORE_UNCHECKED:
+                        load(jit::EDX, op.b);
+                        load(jit::ECX, op.a);
+                        boundsCheck(op, step.code == OpCode::STORE, step.pc);
+                        as.storeIndexed(base(op.dst), op.dst.index * 4, jit::EDX);
                         break;
-                    case InstrType::NOP:
+                    case OpCode::JUMP_IF_ZERO:
+                        guards++;
+                        load(jit::EAX, op.a);
+                        as.test(jit::EAX);
+                        if(step.taken) as.jcc(jit::NE, leave(branchTo(step.pc + 1), executed + 1));
+                        else as.jcc(jit::E, leave(branchTo(op.target), executed + 1));
+                        break;
+                    default:  // JUMP: followed
                         break;
                 }
-
-                pc++;
+                executed++;
             }
-            return true;
-        } catch(const std::exception& e) {
-            fprintf(stderr, "Runtime error: %s\n", e.what());
-            return false;
+            as.subImm(jit::RDI, fuelSlot * 4, static_cast<int>(trace.paths[p].steps.size()));
+            as.jcc(jit::L, exitTo(trace.header));
+            as.jmp(pathLabels[0]);
+        }
+        for(const auto& c : charges) {
+            as.bind(c[0]);
+            as.subImm(jit::RDI, fuelSlot * 4, c[1]);
+            as.jmp(c[2]);
+        }
+        for(const auto& e : exits) {
+            as.bind(e.first);
+            as.movImm(jit::EAX, e.second);
+            as.ret();
         }
+
+        auto native = jit::Code::load(as.finish());
+        if(!native) return false;
+        if(perfMap) perfMap->add("lab3 loop " + loopName(trace.header), *native, lines);
+        trace.entry = native->entry<int (*)(int*, int*)>();
+        retire(trace);
+        trace.native = std::move(native);
+        trace.ops = ops;
+        trace.guards = guards;
+        return true;
     }
 
-    const std::vector<std::string>& getOutput() const {
-        return output;
+    void retire(Trace& trace) {
+        if(perfMap && trace.native) retiredCode.push_back(std::move(trace.native));
     }
 
-private:
-    int getValue(const Operand& op) {
-        if(op.isConst()) {
-            return op.value;
+    // "main:L2 (line 4)": label and source line of a loop header
+    std::string loopName(int header) const {
+        std::string at = lineTable.describe(header);
+        return at.empty() ? labelAt[header] : labelAt[header] + " (" + at + ")";
+    }
+
+    void finishTraceStats() {
+        traceStats = TraceStats();
+        for(const auto& trace : traces) {
+            traceStats.compiled++;
+            traceStats.entries += trace.entries;
+            traceStats.nativeBytes += static_cast<long>(trace.native->bytes());
+            std::string line = "loop " + loopName(trace.header) + " traced: " +
+                               std::to_string(trace.ops) + " ops, " + std::to_string(trace.guards) + " guards";
+            if(trace.paths.size() > 1) line += ", " + std::to_string(trace.paths.size() - 1) + " side paths";
+            traceStats.report.push_back(line + ", " + std::to_string(trace.native->bytes()) + " bytes");
         }
-        if(op.isVar()) {
-            auto it = variables.find(op.str());
-            if(it != variables.end()) {
-                return it->second;
+        traceStats.rejected = static_cast<int>(rejectedLoops.size());
+        traceStats.report.insert(traceStats.report.end(), rejectedLoops.begin(), rejectedLoops.end());
+    }
+
+    // ---------- Parallel loops ----------
+
+    // Runs iterations [begin, end) of a region in `ctx`, whose stack is
+    // free from slot 0; `out` receives the reduction partials
+    void runChunk(const ParRegion& region, Context& ctx, int* outer, int begin, int end, int* out) {
+        ctx.outer = outer;
+        ctx.fp = 0;
+        ctx.sp = region.privateCount;
+        ctx.callStack.clear();
+        ctx.worker = true;
+        ctx.bodyStart = region.bodyStart;
+        ctx.chunkEnd = end;
+        ctx.ivSlot = region.ivPrivate;
+        std::fill(ctx.st, ctx.st + region.privateCount, 0);
+        for(const auto& r : region.reductions) {
+            ctx.st[r.priv] = (r.op == BinOp::MUL) ? 1 : 0;
+        }
+        ctx.st[region.ivPrivate] = begin;
+        ctx.pc = region.bodyStart;
+        ctx.steps += blockSteps[ctx.pc];
+        run(ctx);
+        flushSteps(ctx);
+        for(size_t i = 0; i < region.reductions.size(); i++) {
+            out[i] = ctx.st[region.reductions[i].priv];
+        }
+    }
+
+    void runRegion(const ParRegion& region, Context& ctx, int lo, int hi) {
+        if(hi <= lo) return;
+        int* outer = ctx.st + ctx.fp;
+        size_t reductionCount = region.reductions.size();
+        long n = static_cast<long>(hi) - lo;
+        if(!ctx.worker) parallelStats.loops++;  // stats belong to the main thread
+
+        // Serially on the current thread: nested in a worker, single
+        // threaded, or too few iterations. The region frame goes on top
+        // of the current stack.
+        if(ctx.worker || threads <= 1 || n == 1 || n < region.minIterations) {
+            Context nested;
+            nested.run = ctx.run;
+            nested.st = ctx.st + ctx.sp;
+            nested.stackSlots = ctx.stackSlots - ctx.sp;
+            nested.stackOffset = ctx.stackOffset + ctx.sp;
+            nested.calls.assign(funcs.size(), 0);
+            if(nested.stackSlots < region.privateCount) stackOverflow(nested.stackOffset + region.privateCount);
+            std::vector<int> partial(reductionCount);
+            runChunk(region, nested, outer, lo, hi, partial.data());
+            for(size_t f = 0; f < funcs.size(); f++) ctx.calls[f] += nested.calls[f];
+            ctx.saved += nested.saved;
+            ctx.peakSlots = std::max(ctx.peakSlots, nested.peakSlots);
+            for(size_t i = 0; i < reductionCount; i++) combine(region.reductions[i], ctx, outer, partial[i]);
+            return;
+        }
+
+        startPool();
+        for(auto& worker : workers) {
+            worker.calls.assign(funcs.size(), 0);
+            worker.run = ctx.run;
+        }
+        int chunks = static_cast<int>(std::min<long>(n, static_cast<long>(threads) * CHUNKS_PER_WORKER));
+        std::vector<int> partials(static_cast<size_t>(chunks) * reductionCount);
+        std::vector<std::exception_ptr> errors(chunks);
+        parallelStats.chunks += chunks;
+
+        long stealsBefore = pool->steals();
+        pool->run(chunks, [&](int worker, int chunk) {
+            int begin = static_cast<int>(lo + n * chunk / chunks);
+            int end = static_cast<int>(lo + n * (chunk + 1) / chunks);
+            try {
+                runChunk(region, workers[worker], outer, begin, end,
+                         partials.data() + static_cast<size_t>(chunk) * reductionCount);
+            } catch(...) {
+                errors[chunk] = std::current_exception();
+            }
+        });
+        parallelStats.steals += pool->steals() - stealsBefore;
+
+        for(auto& worker : workers) {
+            for(size_t f = 0; f < funcs.size(); f++) {
+                ctx.calls[f] += worker.calls[f];
+                worker.calls[f] = 0;
             }
-            throw std::runtime_error("Undefined variable: " + op.str());
+            ctx.saved += worker.saved;
+            worker.saved = 0;
         }
-        return 0;
+        // The earliest failing chunk is the error a serial run would hit first
+        for(const auto& error : errors) {
+            if(error) std::rethrow_exception(error);
+        }
+
+        // Pairwise tree over chunk order, independent of which worker ran what
+        for(size_t i = 0; i < reductionCount; i++) {
+            BinOp op = region.reductions[i].op;
+            auto at = [&](int chunk) -> int& { return partials[static_cast<size_t>(chunk) * reductionCount + i]; };
+            for(int stride = 1; stride < chunks; stride *= 2) {
+                for(int c = 0; c + stride < chunks; c += 2 * stride) {
+                    at(c) = simd::scalarOp(op, at(c), at(c + stride));
+                }
+            }
+            combine(region.reductions[i], ctx, outer, at(0));
+        }
+    }
+
+    // shared = shared op partial; the shared slot is read from the thread
+    // that started the region
+    void combine(const ParRegion::Reduction& r, Context& ctx, int* outer, int partial) {
+        int& cell = (r.shared.kind == Slot::GLOBAL) ? ctx.run->globals[r.shared.index] : outer[r.shared.index];
+        cell = simd::scalarOp(r.op, cell, partial);
     }
 
-    void setValue(const Operand& op, int value) {
-        if(op.isVar()) {
-            variables[op.str()] = value;
+    void startPool() {
+        if(pool && pool->size() == threads) return;
+        pool = std::make_unique<ThreadPool>(threads);
+        workers.assign(threads, Context());
+        workerStacks.assign(threads, std::vector<int>(WORKER_STACK_SLOTS, 0));
+        for(int w = 0; w < threads; w++) {
+            workers[w].st = workerStacks[w].data();
+            workers[w].stackSlots = frameLimit(WORKER_STACK_SLOTS);
+            workers[w].callStack.reserve(256);
         }
     }
 
-    void executeBinOp(const Instruction& instr) {
-        int left = getValue(instr.op1);
-        int right = getValue(instr.op2);
-        int result = 0;
+    // ---------- Budgets ----------
 
-        switch(instr.binOp) {
-            case BinOp::ADD: result = left + right; break;
-            case BinOp::SUB: result = left - right; break;
-            case BinOp::MUL: result = left * right; break;
+    void startBudget() {
+        budgeted = limits.steps > 0 || limits.millis > 0;
+        state.stepsUsed = 0;
+        state.outputBytes = 0;
+        budgetStats = BudgetStats();
+        state.started = std::chrono::steady_clock::now();
+        for(auto& worker : workers) {
+            worker.steps = worker.checkAt = worker.flushed = 0;
+            worker.stackSlots = frameLimit(WORKER_STACK_SLOTS);
+        }
+    }
+
+    void finishBudget() {
+        if(mainContext.run) flushSteps(mainContext);
+        budgetStats.steps = state.stepsUsed;
+        budgetStats.millis = elapsedMillis(state);
+        budgetStats.outputBytes = state.outputBytes;
+        budgetStats.frameBytes = 4L * mainContext.peakSlots;
+    }
+
+    static long elapsedMillis(const RunState& run) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - run.started).count();
+    }
+
+    // Stack slots a thread may use for frames
+    int frameLimit(int slots) const {
+        return (limits.frameBytes > 0) ? static_cast<int>(std::min<long>(slots, limits.frameBytes / 4)) : slots;
+    }
+
+    [[noreturn]] void stackOverflow(long slots) const {
+        if(limits.frameBytes > 0 && 4 * slots > limits.frameBytes) {
+            throw LimitExceeded(LimitExceeded::MEMORY, limits.frameBytes, 4 * slots);
+        }
+        throw std::runtime_error("Stack overflow");
+    }
+
+    long flushSteps(Context& ctx) {
+        long total = ctx.run->stepsUsed.fetch_add(ctx.steps - ctx.flushed, std::memory_order_relaxed) +
+                     (ctx.steps - ctx.flushed);
+        ctx.flushed = ctx.steps;
+        return total;
+    }
+
+    // Slow path of the per-block step charge on entering the block at
+    // `next` from the op at `from`: every context calls it once when it
+    // starts, then only at checkpoints and sampler ticks. True when an
+    // Instance's slice is over.
+    bool checkBudget(Context& ctx, int from, int next) {
+        if(sampleHz > 0 && &ctx == &mainContext && SampleTimer::take()) sampleBlockLeft(ctx, from, next);
+        long total = flushSteps(ctx);
+        if(limits.steps > 0 && total > limits.steps) {
+            throw LimitExceeded(LimitExceeded::STEPS, limits.steps, total);
+        }
+        if(limits.millis > 0) {
+            long millis = elapsedMillis(*ctx.run);
+            if(millis > limits.millis) throw LimitExceeded(LimitExceeded::TIME, limits.millis, millis);
+        }
+        if(ctx.steps >= ctx.sliceEnd) return true;
+        ctx.checkAt = ctx.sliceEnd;
+        if(budgeted) {
+            // Other threads' steps only show up at their own checks, so
+            // parallel loops may overshoot the step limit by a few checkpoints
+            long next = BUDGET_CHECK_STEPS;
+            if(limits.steps > 0) next = std::min(next, limits.steps - total + 1);
+            ctx.checkAt = std::min(long(ctx.checkAt), ctx.steps + next);
+        }
+        return false;
+    }
+
+    // ---------- Sampling ----------
+
+    // A tick seen on entering `next` came while the block ending at `from`
+    // ran. Its call stack is the one before the transfer: a call has
+    // already pushed the callee's frame, a return has popped its own.
+    void sampleBlockLeft(const Context& ctx, int from, int next) {
+        size_t frames = ctx.callStack.size();
+        int callSite = -1;
+        const Op& op = code[from];
+        if(op.code == OpCode::CALL && next == funcs[op.target].entry && frames > 0) {
+            frames--;
+        } else if(op.code == OpCode::RET) {
+            callSite = next - 1;
+        }
+        int first = blockStart(from);
+        takeSample(ctx, frames, callSite, first, blockSteps[first]);
+    }
+
+    // Records a tick as an op of [first, first + count), picked uniformly,
+    // plus the call sites of the innermost of the first `frames` frames and
+    // `callSite`, if any, below them
+    void takeSample(const Context& ctx, size_t frames, int callSite, int first, int count) {
+        size_t extra = callSite >= 0 ? 1 : 0;
+        size_t depth = std::min(frames + extra, MAX_SAMPLE_FRAMES);
+        if(samples.size() + depth + 2 > SAMPLE_BUFFER_WORDS) {
+            samplesDropped++;
+            return;
+        }
+        sampleSeed ^= sampleSeed << 13;  // xorshift32
+        sampleSeed ^= sampleSeed >> 17;
+        sampleSeed ^= sampleSeed << 5;
+        samples.push_back(static_cast<int>(depth));
+        for(size_t i = frames + extra - depth; i < frames; i++) {
+            samples.push_back(ctx.callStack[i].returnPc - 1);
+        }
+        if(callSite >= 0) samples.push_back(callSite);
+        samples.push_back(first + static_cast<int>(sampleSeed % static_cast<uint32_t>(std::max(count, 1))));
+    }
+
+    // Function whose body holds `pc`, or null for top-level code
+    const FuncInfo* functionAt(int pc) const {
+        const FuncInfo* owner = nullptr;
+        for(const auto& func : funcs) {
+            if(func.entry <= pc && (!owner || func.entry > owner->entry)) owner = &func;
+        }
+        return owner;
+    }
+
+    // "fib:3": a stack frame of the folded output
+    std::string frameName(int pc) const {
+        const FuncInfo* owner = functionAt(pc);
+        const LineTable::Range* range = lineTable.find(pc);
+        return (owner ? owner->name : "main") + ":" + (range ? std::to_string(range->line) : "?");
+    }
+
+    // First op of the basic block holding `pc`: blocks start at jump
+    // targets, function entries and after jumps, calls and returns
+    int blockStart(int pc) const {
+        while(pc > 0 && labelAt[pc].empty() && blockSteps[pc - 1] == blockSteps[pc] + 1) pc--;
+        return pc;
+    }
+
+    // "main:L2 (line 11), ops 40-47"
+    std::string blockName(int start) const {
+        int end = start;
+        while(blockSteps[end] > 1 && labelAt[end + 1].empty()) end++;
+        std::string name = labelAt[start];
+        if(name.empty()) {
+            const FuncInfo* owner = functionAt(start);
+            name = (owner ? owner->name : "main") + ":" +
+                   ((owner ? owner->entry : 0) == start ? "entry" : "@" + std::to_string(start));
+        }
+        std::string at = lineTable.describe(start);
+        if(!at.empty()) name += " (" + at + ")";
+        return name + ", ops " + std::to_string(start) + "-" + std::to_string(end);
+    }
+
+    // Hotspots by line, by block and by call stack
+    void finishSampleStats() {
+        sampleStats = SampleStats();
+        sampleStats.hz = sampleHz;
+        sampleStats.dropped = samplesDropped;
+        if(sampleHz <= 0) return;
+        std::unordered_map<std::string, long> lines, stacks;
+        std::unordered_map<int, long> blocks;
+        for(size_t i = 0; i < samples.size(); i += samples[i] + 2) {
+            int depth = samples[i];
+            int leaf = samples[i + depth + 1];
+            std::string stack = (depth == static_cast<int>(MAX_SAMPLE_FRAMES)) ? "...;" : "";
+            for(int k = 1; k <= depth; k++) stack += frameName(samples[i + k]) + ";";
+            stacks[stack + frameName(leaf)]++;
+            std::string line = sourceLocation(leaf);
+            lines[line.empty() ? "unknown" : line]++;
+            blocks[blockStart(leaf)]++;
+            sampleStats.samples++;
+        }
+        auto hottest = [](std::vector<SampleStats::Hotspot>& spots) {
+            std::sort(spots.begin(), spots.end(), [](const auto& a, const auto& b) {
+                return a.samples != b.samples ? a.samples > b.samples : a.where < b.where;
+            });
+        };
+        for(const auto& [where, count] : lines) sampleStats.lines.push_back({where, count});
+        for(const auto& [start, count] : blocks) sampleStats.blocks.push_back({blockName(start), count});
+        for(const auto& [where, count] : stacks) sampleStats.stacks.push_back({where, count});
+        hottest(sampleStats.lines);
+        hottest(sampleStats.blocks);
+        hottest(sampleStats.stacks);
+    }
+
+    void storeMemo(int memo, int entry, int value) {
+        MemoTable& table = memoTables[memo];
+        size_t arity = table.arity;
+        size_t pending = memoPending.size() - arity;
+
+        if(table.used[entry]) {
+            bool same = std::equal(memoPending.begin() + pending, memoPending.end(),
+                                   table.keys.begin() + entry * arity);
+            if(!same) table.stats.evictions++;
+        }
+        std::copy(memoPending.begin() + pending, memoPending.end(),
+                  table.keys.begin() + entry * arity);
+        table.values[entry] = value;
+        table.used[entry] = 1;
+        memoPending.resize(pending);
+    }
+
+    static int binary(BinOp binOp, int left, int right) {
+        switch(binOp) {
+            case BinOp::ADD: return left + right;
+            case BinOp::SUB: return left - right;
+            case BinOp::MUL: return left * right;
             case BinOp::DIV:
                 if(right == 0) throw std::runtime_error("Division by zero");
-                result = left / right;
-                break;
+                return simd::divide(left, right);
             case BinOp::MOD:
                 if(right == 0) throw std::runtime_error("Modulo by zero");
-                result = left % right;
-                break;
-            case BinOp::EQ: result = (left == right) ? 1 : 0; break;
-            case BinOp::NE: result = (left != right) ? 1 : 0; break;
-            case BinOp::LT: result = (left < right) ? 1 : 0; break;
-            case BinOp::GT: result = (left > right) ? 1 : 0; break;
-            case BinOp::LE: result = (left <= right) ? 1 : 0; break;
-            case BinOp::GE: result = (left >= right) ? 1 : 0; break;
-            case BinOp::AND: result = (left && right) ? 1 : 0; break;
-            case BinOp::OR: result = (left || right) ? 1 : 0; break;
+                return simd::remainder(left, right);
+            case BinOp::EQ: return (left == right) ? 1 : 0;
+            case BinOp::NE: return (left != right) ? 1 : 0;
+            case BinOp::LT: return (left < right) ? 1 : 0;
+            case BinOp::GT: return (left > right) ? 1 : 0;
+            case BinOp::LE: return (left <= right) ? 1 : 0;
+            case BinOp::GE: return (left >= right) ? 1 : 0;
+            case BinOp::AND: return (left && right) ? 1 : 0;
+            case BinOp::OR: return (left || right) ? 1 : 0;
         }
-
-        setValue(instr.result, result);
+        return 0;
     }
 
-    void executeUnOp(const Instruction& instr) {
-        int operand = getValue(instr.op1);
-        int result = 0;
+    // ---------- Linking: IR -> decoded ops ----------
+
+    void link(const IRProgram& program) {
+        code.clear();
+        argPool.clear();
+        vecPool.clear();
+        parPool.clear();
+        funcs.assign(program.functions.size(), FuncInfo());
+        memoTables.clear();
+        lineTable = LineTable();
 
-        if(instr.unOp == UnOp::NEG) {
-            result = -operand;
-        } else if(instr.unOp == UnOp::NOT) {
-            result = operand ? 0 : 1;
+        std::unordered_map<std::string, int> funcIndex;
+        for(size_t i = 0; i < program.functions.size(); i++) {
+            funcIndex[program.functions[i].name] = static_cast<int>(i);
         }
 
-        setValue(instr.result, result);
-    }
+        labelAt.clear();
+        linkBody(program, program.instructions, nullptr, funcIndex);
+        code.push_back(Op());  // HALT at the end of top-level code
+
+        for(size_t i = 0; i < program.functions.size(); i++) {
+            const auto& func = program.functions[i];
+            funcs[i].name = func.name;
+            funcs[i].entry = static_cast<int>(code.size());
+            funcs[i].frameSize = func.frameSize;
+            funcs[i].paramCount = static_cast<int>(func.params.size());
+            if(memoize && func.pure) {
+                MemoTable table;
+                table.arity = funcs[i].paramCount;
+                table.keys.assign(static_cast<size_t>(memoEntries) * table.arity, 0);
+                table.values.assign(memoEntries, 0);
+                table.used.assign(memoEntries, 0);
+                table.stats.function = func.name;
+                funcs[i].memo = static_cast<int>(memoTables.size());
+                memoTables.push_back(std::move(table));
+            }
+            linkBody(program, func.instructions, &func, funcIndex);
 
-    void executeAssign(const Instruction& instr) {
-        int value = getValue(instr.op1);
-        setValue(instr.result, value);
+            Op ret;  // guard against falling off the end of a body
+            ret.code = OpCode::RET;
+            code.push_back(ret);
+        }
+        Op yield;
+        yield.code = OpCode::YIELD;
+        yieldPc = static_cast<int>(code.size());
+        code.push_back(yield);
+
+        blockSteps.assign(code.size(), 1);
+        for(int pc = static_cast<int>(code.size()) - 2; pc >= 0; pc--) {
+            switch(code[pc].code) {
+                case OpCode::JUMP: case OpCode::JUMP_IF_ZERO: case OpCode::CALL: case OpCode::RET:
+                case OpCode::PARALLEL: case OpCode::PAR_END: case OpCode::HALT: case OpCode::YIELD:
+                    break;
+                default:
+                    blockSteps[pc] = blockSteps[pc + 1] + 1;
+                    break;
+            }
+        }
+        startProfile();
+        startTracing();
     }
 
-    int findLabel(const IRProgram& program, const std::string& label) {
-        for(size_t i = 0; i < program.instructions.size(); i++) {
-            if(program.instructions[i].type == InstrType::LABEL &&
-               program.instructions[i].label == label) {
-                return i;
+    void linkBody(const IRProgram& program, const std::vector<Instruction>& body,
+                  const IRFunction* func,
+                  const std::unordered_map<std::string, int>& funcIndex) {
+        // Labels are dropped from the decoded stream, so map them to the
+        // offset of the next real op first
+        std::unordered_map<std::string, int> labels;
+        int offset = static_cast<int>(code.size());
+        for(const auto& instr : body) {
+            if(instr.type == InstrType::LABEL) {
+                labels[instr.label] = offset;
+            } else if(instr.type != InstrType::NOP && instr.type != InstrType::CONST &&
+                      instr.type != InstrType::PAR_REDUCE) {
+                offset++;
+            }
+        }
+        for(const auto& label : labels) {
+            std::string name = (func ? func->name : "main") + ":" + label.first;
+            if(labelAt.size() <= static_cast<size_t>(label.second)) labelAt.resize(label.second + 1);
+            std::string& slot = labelAt[label.second];
+            if(slot.empty() || name < slot) slot = name;  // deterministic among aliases
+        }
+
+        // Inside a parallel body: name -> private slot of the worker frame
+        std::unordered_map<std::string, int> privates;
+        bool inRegion = false;
+
+        auto resolve = [&](const Operand& op) -> Slot {
+            Slot s;
+            if(op.isConst()) {
+                s.kind = Slot::IMM;
+                s.index = op.value;
+                return s;
+            }
+            if(inRegion) {
+                auto it = privates.find(op.name);
+                if(it != privates.end()) {
+                    s.kind = Slot::LOCAL;
+                    s.index = it->second;
+                    return s;
+                }
+            }
+            if(func) {
+                auto it = func->slots.find(op.name);
+                if(it != func->slots.end()) {
+                    s.kind = inRegion ? Slot::OUTER : Slot::LOCAL;
+                    s.index = it->second;
+                    return s;
+                }
+            }
+            auto it = program.globalSlots.find(op.name);
+            if(it == program.globalSlots.end()) {
+                throw std::runtime_error("Undefined variable: " + op.str());
+            }
+            s.kind = Slot::GLOBAL;
+            s.index = it->second;
+            return s;
+        };
+        // Every scalar the body writes gets a private slot
+        auto openRegion = [&](size_t begin) {
+            ParRegion region;
+            privates.clear();
+            auto addPrivate = [&](const std::string& name) {
+                if(!privates.count(name)) {
+                    int slot = static_cast<int>(privates.size());
+                    privates[name] = slot;
+                }
+            };
+            const Instruction& head = body[begin];
+            addPrivate(head.result.name);
+            size_t end = begin + 1;
+            for(; end < body.size() && body[end].type != InstrType::PAR_END; end++) {
+                const Instruction& instr = body[end];
+                switch(instr.type) {
+                    case InstrType::ASSIGN:
+                    case InstrType::BIN_OP:
+                    case InstrType::UN_OP:
+                    case InstrType::LOAD_IDX:
+                    case InstrType::CALL:
+                    case InstrType::VEC_REDUCE:
+                    case InstrType::PAR_REDUCE:
+                        if(!instr.result.name.empty()) addPrivate(instr.result.name);
+                        break;
+                    case InstrType::PAR_BEGIN:
+                        throw std::runtime_error("Nested parallel loop");
+                    default:
+                        break;
+                }
+            }
+            if(end == body.size()) throw std::runtime_error("Parallel loop without end");
+
+            region.privateCount = static_cast<int>(privates.size());
+            region.ivPrivate = privates[head.result.name];
+            if(!head.args.empty()) region.minIterations = head.args[0].value;
+            for(size_t x = begin + 1; x < end && body[x].type == InstrType::PAR_REDUCE; x++) {
+                ParRegion::Reduction r;
+                r.shared = resolve(body[x].result);  // resolved outside the region
+                r.priv = privates[body[x].result.name];
+                r.op = body[x].binOp;
+                region.reductions.push_back(r);
+            }
+            region.bodyStart = static_cast<int>(code.size()) + 1;
+            parPool.push_back(region);
+            inRegion = true;
+        };
+
+        auto arraySize = [&](const Operand& op) -> int {
+            if(func && func->slots.count(op.name)) {
+                auto it = func->arraySizes.find(op.name);
+                if(it != func->arraySizes.end()) return it->second;
+            } else {
+                auto it = program.arraySizes.find(op.name);
+                if(it != program.arraySizes.end()) return it->second;
+            }
+            throw std::runtime_error("Not an array: " + op.str());
+        };
+        auto target = [&](const std::string& label) -> int {
+            auto it = labels.find(label);
+            if(it == labels.end()) throw std::runtime_error("Label not found: " + label);
+            return it->second;
+        };
+
+        for(size_t x = 0; x < body.size(); x++) {
+            const Instruction& instr = body[x];
+            Op op;
+            switch(instr.type) {
+                case InstrType::PAR_BEGIN:
+                    op.code = OpCode::PARALLEL;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.target = static_cast<int>(parPool.size());
+                    openRegion(x);
+                    break;
+                case InstrType::PAR_END:
+                    op.code = OpCode::PAR_END;
+                    parPool.back().endPc = static_cast<int>(code.size());
+                    inRegion = false;
+                    break;
+                case InstrType::PAR_REDUCE:
+                    continue;
+                case InstrType::BIN_OP:
+                    op.code = OpCode::BIN;
+                    op.binOp = instr.binOp;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    break;
+                case InstrType::UN_OP:
+                    op.code = OpCode::UN;
+                    op.unOp = instr.unOp;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::ASSIGN:
+                    op.code = OpCode::MOVE;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::LOAD_IDX:
+                    op.code = instr.boundsCheck ? OpCode::LOAD : OpCode::LOAD_UNCHECKED;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.target = arraySize(instr.op1);
+                    break;
+                case InstrType::STORE_IDX:
+                    op.code = instr.boundsCheck ? OpCode::STORE : OpCode::STORE_UNCHECKED;
+                    op.dst = resolve(instr.result);
+                    op.a = resolve(instr.op1);
+                    op.b = resolve(instr.op2);
+                    op.target = arraySize(instr.result);
+                    break;
+                case InstrType::VEC_MAP:
+                case InstrType::VEC_REDUCE: {
+                    VecKernel kernel;
+                    kernel.op = instr.binOp;
+                    kernel.dst = resolve(instr.result);
+                    if(instr.type == InstrType::VEC_MAP) kernel.dstSize = arraySize(instr.result);
+                    const Operand* sources[2] = {&instr.op1, &instr.op2};
+                    for(int i = 0; i < 2; i++) {
+                        const Operand& offset = instr.args[2 + i];
+                        VecSource& s = kernel.src[i];
+                        s.slot = resolve(*sources[i]);
+                        s.array = !offset.name.empty();
+                        if(s.array) {
+                            s.offset = offset.value;
+                            s.size = arraySize(*sources[i]);
+                        }
+                    }
+                    kernel.lo = resolve(instr.args[0]);
+                    kernel.hi = resolve(instr.args[1]);
+                    op.code = (instr.type == InstrType::VEC_MAP) ? OpCode::VEC_MAP : OpCode::VEC_REDUCE;
+                    op.target = static_cast<int>(vecPool.size());
+                    vecPool.push_back(kernel);
+                    break;
+                }
+                case InstrType::GOTO:
+                    op.code = OpCode::JUMP;
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::IF_GOTO:
+                    op.code = OpCode::JUMP_IF_ZERO;
+                    op.a = resolve(instr.op1);
+                    op.target = target(instr.label);
+                    break;
+                case InstrType::PRINT:
+                    op.code = OpCode::PRINT;
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::INPUT:
+                    op.code = OpCode::INPUT;
+                    op.dst = resolve(instr.result);
+                    break;
+                case InstrType::RETURN:
+                    op.code = OpCode::RET;
+                    op.a = resolve(instr.op1);
+                    break;
+                case InstrType::CALL: {
+                    // Built-in print function handling
+                    if(instr.funcName == "print") {
+                        op.code = OpCode::PRINT;
+                        op.a = instr.args.empty() ? Slot() : resolve(instr.args[0]);
+                        break;
+                    }
+                    auto it = funcIndex.find(instr.funcName);
+                    if(it == funcIndex.end()) {
+                        throw std::runtime_error("Undefined function: " + instr.funcName);
+                    }
+                    const IRFunction& callee = program.functions[it->second];
+                    if(instr.args.size() != callee.params.size()) {
+                        throw std::runtime_error("Argument count mismatch in call to " +
+                                                 instr.funcName);
+                    }
+                    op.code = OpCode::CALL;
+                    op.target = it->second;
+                    op.dst = resolve(instr.result);
+                    op.argBegin = static_cast<int>(argPool.size());
+                    op.argCount = static_cast<int>(instr.args.size());
+                    for(const auto& arg : instr.args) {
+                        argPool.push_back(resolve(arg));
+                    }
+                    break;
+                }
+                case InstrType::LABEL:
+                case InstrType::CONST:
+                case InstrType::NOP:
+                    continue;
             }
+            lineTable.add(static_cast<int>(code.size()), instr.line, instr.column);
+            code.push_back(op);
         }
-        throw std::runtime_error("Label not found: " + label);
     }
 };
@@ -12,6 +12,7 @@
 #include <unordered_map>
 #include <variant>
 #include <iostream> 
+#include <algorithm>
 
 // Enumerations for IR operations
 enum class BinOp {
@@ -36,6 +37,14 @@ enum class InstrType {
     CALL,                             // t1 = func(args)
     RETURN,                           // return value
     PRINT,                            // print(value)
+    INPUT,                            // t1 = input()
+    LOAD_IDX,                         // t1 = a[i]
+    STORE_IDX,                        // a[i] = t1
+    VEC_MAP,                          // c[k] = a[k] op b[k], k in [lo, hi)
+    VEC_REDUCE,                       // s = s + sum(a[k] op b[k]), k in [lo, hi)
+    PAR_BEGIN,                        // parallel for i in [i, hi)
+    PAR_REDUCE,                       // reduction(+: s) of the enclosing region
+    PAR_END,                          // end of the parallel loop body
     NOP                               // No operation
 };
 
@@ -68,9 +77,20 @@ struct Instruction {
     UnOp unOp;
     std::vector<Operand> args;
     std::string funcName;
+    bool boundsCheck = true;  // LOAD_IDX/STORE_IDX: cleared when proven in range
+    int line = 0;             // source position; 0 when unknown
+    int column = 0;
 
     Instruction() : type(InstrType::NOP), binOp(BinOp::ADD), unOp(UnOp::NEG) {}
 
+    // Gives an instruction a pass creates the source position of the one
+    // it stands for
+    Instruction& at(const Instruction& origin) {
+        line = origin.line;
+        column = origin.column;
+        return *this;
+    }
+
     static Instruction createBinOp(const Operand& result, BinOp op, 
                                    const Operand& op1, const Operand& op2) {
         Instruction instr;
@@ -122,6 +142,13 @@ struct Instruction {
         return instr;
     }
 
+    static Instruction createInput(const Operand& result) {
+        Instruction instr;
+        instr.type = InstrType::INPUT;
+        instr.result = result;
+        return instr;
+    }
+
     static Instruction createCall(const Operand& result, const std::string& func,
                                   const std::vector<Operand>& arguments) {
         Instruction instr;
@@ -139,6 +166,76 @@ struct Instruction {
         return instr;
     }
 
+    // result = array[index]
+    static Instruction createLoadIdx(const Operand& result, const Operand& array,
+                                     const Operand& index) {
+        Instruction instr;
+        instr.type = InstrType::LOAD_IDX;
+        instr.result = result;
+        instr.op1 = array;
+        instr.op2 = index;
+        return instr;
+    }
+
+    // array[index] = value; the array is kept in `result`
+    static Instruction createStoreIdx(const Operand& array, const Operand& index,
+                                      const Operand& value) {
+        Instruction instr;
+        instr.type = InstrType::STORE_IDX;
+        instr.result = array;
+        instr.op1 = index;
+        instr.op2 = value;
+        return instr;
+    }
+
+    // Vector loop kernel over k in [lo, hi). `result` is the destination
+    // array (VEC_MAP) or the accumulator (VEC_REDUCE). A source with an
+    // offset operand is the array element src[k + offset]; a source without
+    // one (empty name) is a scalar broadcast to every lane.
+    // args = {lo, hi, offset1, offset2}
+    static Instruction createVector(InstrType kind, const Operand& result, BinOp op,
+                                    const Operand& src1, const Operand& offset1,
+                                    const Operand& src2, const Operand& offset2,
+                                    const Operand& lo, const Operand& hi) {
+        Instruction instr;
+        instr.type = kind;
+        instr.result = result;
+        instr.binOp = op;
+        instr.op1 = src1;
+        instr.op2 = src2;
+        instr.args = {lo, hi, offset1, offset2};
+        return instr;
+    }
+
+    // Starts a parallel loop over `iv` from its current value up to `hi`
+    // (exclusive). The body runs once per iteration, up to PAR_END, with
+    // its own copies of every name it writes; afterwards iv = max(iv, hi).
+    // Loops parallelized by the optimizer carry args = {minimum trip count};
+    // shorter ranges run on the calling thread.
+    static Instruction createParBegin(const Operand& iv, const Operand& hi) {
+        Instruction instr;
+        instr.type = InstrType::PAR_BEGIN;
+        instr.result = iv;
+        instr.op1 = iv;
+        instr.op2 = hi;
+        return instr;
+    }
+
+    // Combines the per-iteration copies of `var` with `op` (+ or *)
+    static Instruction createParReduce(const Operand& var, BinOp op) {
+        Instruction instr;
+        instr.type = InstrType::PAR_REDUCE;
+        instr.result = var;
+        instr.binOp = op;
+        return instr;
+    }
+
+    static Instruction createParEnd() {
+        Instruction instr;
+        instr.type = InstrType::PAR_END;
+        return instr;
+    }
+
     static Instruction createPrint(const Operand& value) {
         Instruction instr;
         instr.type = InstrType::PRINT;
@@ -149,20 +246,132 @@ struct Instruction {
     std::string toString() const;
 };
 
+// Source positions of an instruction sequence, sorted by index: one range
+// per run of instructions from the same line and column. Instructions of
+// unknown position (labels and jumps added by passes) extend the range
+// before them.
+struct LineTable {
+    struct Range {
+        int first;  // index of the first instruction of the range
+        int line;
+        int column;
+    };
+    std::vector<Range> ranges;
+
+    // Instruction `index` (not below the last range's) is at line:column
+    void add(int index, int line, int column) {
+        if(line <= 0) return;
+        if(!ranges.empty() && ranges.back().line == line && ranges.back().column == column) return;
+        ranges.push_back({index, line, column});
+    }
+
+    static LineTable of(const std::vector<Instruction>& body) {
+        LineTable table;
+        for(size_t i = 0; i < body.size(); i++) {
+            table.add(static_cast<int>(i), body[i].line, body[i].column);
+        }
+        return table;
+    }
+
+    // Range holding instruction `index`, or null before the first one
+    const Range* find(int index) const {
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), index,
+                                   [](int i, const Range& range) { return i < range.first; });
+        return (it == ranges.begin()) ? nullptr : &*(it - 1);
+    }
+
+    // "line L" of instruction `index`, or "" when unknown
+    std::string describe(int index) const {
+        const Range* range = find(index);
+        return range ? "line " + std::to_string(range->line) : "";
+    }
+};
+
+// User-defined function: its own TAC body and a fixed frame layout.
+// Frame slots are [params..., locals..., temps...]; any VAR operand that
+// is not in `slots` refers to a global.
+struct IRFunction {
+    std::string name;
+    std::vector<std::string> params;
+    std::vector<Instruction> instructions;
+    std::unordered_map<std::string, int> variableTypes;  // params and locals
+    std::unordered_map<std::string, int> arraySizes;     // local arrays
+    std::unordered_map<std::string, int> slots;          // name -> frame slot (arrays: first element)
+    int frameSize = 0;
+    bool pure = false;  // result depends only on the arguments
+
+    void layoutFrame();
+    std::string signature() const;
+};
+
 // IR Program
 struct IRProgram {
-    std::vector<Instruction> instructions;
+    std::vector<Instruction> instructions;               // top-level code
     std::unordered_map<std::string, int> variableTypes;  // 0: int, 1: bool
     std::unordered_map<std::string, int> symbolTable;    // var -> line defined
+    std::unordered_map<std::string, int> arraySizes;     // global arrays
+    std::vector<IRFunction> functions;
+    std::unordered_map<std::string, int> globalSlots;    // globals and top-level temps
+    int globalCount = 0;
 
     void addInstruction(const Instruction& instr) {
         instructions.push_back(instr);
     }
 
+    const IRFunction* findFunction(const std::string& name) const {
+        for(const auto& func : functions) {
+            if(func.name == name) return &func;
+        }
+        return nullptr;
+    }
+
+    // Assigns global slots and per-function frame slots. Must be re-run
+    // after any pass that adds or removes names.
+    void layoutFrames();
+
     void print() const;
     void saveToFile(const std::string& filename) const;
 };
 
+// Calls `fn` for every operand an instruction reads or writes
+template<typename Fn>
+inline void forEachOperand(const Instruction& instr, Fn fn) {
+    switch(instr.type) {
+        case InstrType::BIN_OP:
+        case InstrType::LOAD_IDX:
+        case InstrType::STORE_IDX:
+            fn(instr.result); fn(instr.op1); fn(instr.op2);
+            break;
+        case InstrType::UN_OP:
+        case InstrType::ASSIGN:
+            fn(instr.result); fn(instr.op1);
+            break;
+        case InstrType::IF_GOTO:
+        case InstrType::RETURN:
+        case InstrType::PRINT:
+            fn(instr.op1);
+            break;
+        case InstrType::CALL:
+            fn(instr.result);
+            for(const auto& arg : instr.args) fn(arg);
+            break;
+        case InstrType::VEC_MAP:
+        case InstrType::VEC_REDUCE:
+            fn(instr.result); fn(instr.op1); fn(instr.op2);
+            fn(instr.args[0]); fn(instr.args[1]);
+            break;
+        case InstrType::PAR_BEGIN:
+            fn(instr.result); fn(instr.op2);
+            break;
+        case InstrType::PAR_REDUCE:
+        case InstrType::INPUT:
+            fn(instr.result);
+            break;
+        default:
+            break;
+    }
+}
+
 inline std::string BinOpToString(BinOp op) {
     switch(op) {
         case BinOp::ADD: return "+";
@@ -223,6 +432,42 @@ inline std::string Instruction::toString() const {
         case InstrType::PRINT:
             s = "print(" + op1.str() + ")";
             break;
+        case InstrType::INPUT:
+            s = result.str() + " = input()";
+            break;
+        case InstrType::LOAD_IDX:
+            s = result.str() + " = " + op1.str() + "[" + op2.str() + "]";
+            if(!boundsCheck) s += "  (unchecked)";
+            break;
+        case InstrType::STORE_IDX:
+            s = result.str() + "[" + op1.str() + "] = " + op2.str();
+            if(!boundsCheck) s += "  (unchecked)";
+            break;
+        case InstrType::VEC_MAP:
+        case InstrType::VEC_REDUCE: {
+            auto element = [&](const Operand& src, const Operand& offset) {
+                if(offset.name.empty()) return src.str();
+                if(offset.value == 0) return src.str() + "[k]";
+                return src.str() + "[k" + (offset.value > 0 ? "+" : "") + offset.str() + "]";
+            };
+            s = "vec for k in [" + args[0].str() + ", " + args[1].str() + "): ";
+            s += (type == InstrType::VEC_MAP) ? result.str() + "[k] = " : result.str() + " += ";
+            s += element(op1, args[2]);
+            if(!(binOp == BinOp::ADD && args[3].name.empty() && op2.isConst() && op2.value == 0)) {
+                s += " " + BinOpToString(binOp) + " " + element(op2, args[3]);
+            }
+            break;
+        }
+        case InstrType::PAR_BEGIN:
+            s = "parallel for " + result.str() + " in [" + op1.str() + ", " + op2.str() + ")";
+            if(!args.empty()) s += "  (auto, min " + args[0].str() + " iterations)";
+            break;
+        case InstrType::PAR_REDUCE:
+            s = "reduction(" + BinOpToString(binOp) + ": " + result.str() + ")";
+            break;
+        case InstrType::PAR_END:
+            s = "end parallel";
+            break;
         case InstrType::NOP:
             s = "nop";
             break;
@@ -230,14 +475,101 @@ inline std::string Instruction::toString() const {
     return s;
 }
 
+// Number of slots a name occupies: an array takes one per element
+inline int slotWidth(const std::unordered_map<std::string, int>& arraySizes,
+                     const std::string& name) {
+    auto it = arraySizes.find(name);
+    return (it != arraySizes.end()) ? it->second : 1;
+}
+
+inline void IRFunction::layoutFrame() {
+    slots.clear();
+    int next = 0;
+    for(const auto& param : params) {
+        slots[param] = next++;
+    }
+
+    for(const auto& instr : instructions) {
+        forEachOperand(instr, [&](const Operand& op) {
+            if(op.isConst() || op.name.empty() || slots.count(op.name)) return;
+            if(op.isTemp() || variableTypes.count(op.name)) {
+                slots[op.name] = next;
+                next += slotWidth(arraySizes, op.name);
+            }
+        });
+    }
+
+    // Declared locals that are never referenced still get a slot
+    std::vector<std::string> unused;
+    for(const auto& [var, type] : variableTypes) {
+        if(!slots.count(var)) unused.push_back(var);
+    }
+    std::sort(unused.begin(), unused.end());
+    for(const auto& var : unused) {
+        slots[var] = next;
+        next += slotWidth(arraySizes, var);
+    }
+
+    frameSize = next;
+}
+
+inline std::string IRFunction::signature() const {
+    std::string s = name + "(";
+    for(size_t i = 0; i < params.size(); i++) {
+        if(i > 0) s += ", ";
+        s += params[i];
+    }
+    return s + ")";
+}
+
+inline void IRProgram::layoutFrames() {
+    globalSlots.clear();
+    int next = 0;
+    auto addGlobal = [&](const Operand& op) {
+        if(op.isConst() || op.name.empty() || globalSlots.count(op.name)) return;
+        globalSlots[op.name] = next;
+        next += slotWidth(arraySizes, op.name);
+    };
+
+    for(const auto& instr : instructions) {
+        forEachOperand(instr, addGlobal);
+    }
+    std::vector<std::string> declared;
+    for(const auto& [var, type] : variableTypes) declared.push_back(var);
+    std::sort(declared.begin(), declared.end());
+    for(const auto& var : declared) {
+        addGlobal(Operand(var, Operand::Type::VAR));
+    }
+
+    for(auto& func : functions) {
+        func.layoutFrame();
+        for(const auto& instr : func.instructions) {
+            forEachOperand(instr, [&](const Operand& op) {
+                if(!op.isConst() && !func.slots.count(op.name)) addGlobal(op);
+            });
+        }
+    }
+
+    globalCount = next;
+}
+
 inline void IRProgram::print() const {
     std::cout << "\n=== THREE-ADDRESS CODE (TAC) ===\n";
     for(size_t i = 0; i < instructions.size(); i++) {
         printf("%3zu:  %s\n", i, instructions[i].toString().c_str());
     }
+    for(const auto& func : functions) {
+        printf("\n=== FUNCTION %s [frame: %d slots%s] ===\n",
+               func.signature().c_str(), func.frameSize, func.pure ? ", pure" : "");
+        for(size_t i = 0; i < func.instructions.size(); i++) {
+            printf("%3zu:  %s\n", i, func.instructions[i].toString().c_str());
+        }
+    }
     std::cout << "\n=== VARIABLE TABLE ===\n";
     for(const auto& [var, type] : variableTypes) {
         std::string typeName = (type == 0) ? "int" : "bool";
+        auto size = arraySizes.find(var);
+        if(size != arraySizes.end()) typeName += "[" + std::to_string(size->second) + "]";
         printf("  %s : %s\n", var.c_str(), typeName.c_str());
     }
     std::cout << "\n";
@@ -251,9 +583,28 @@ inline void IRProgram::saveToFile(const std::string& filename) const {
     for(size_t i = 0; i < instructions.size(); i++) {
         fprintf(f, "%3zu:  %s\n", i, instructions[i].toString().c_str());
     }
+    for(const auto& func : functions) {
+        fprintf(f, "\n=== FUNCTION %s [frame: %d slots%s] ===\n\n",
+                func.signature().c_str(), func.frameSize, func.pure ? ", pure" : "");
+        for(size_t i = 0; i < func.instructions.size(); i++) {
+            fprintf(f, "%3zu:  %s\n", i, func.instructions[i].toString().c_str());
+        }
+    }
+    auto printLines = [&](const char* owner, const std::vector<Instruction>& body) {
+        fprintf(f, "  %s:", owner);
+        for(const auto& range : LineTable::of(body).ranges) {
+            fprintf(f, " %d@%d:%d", range.first, range.line, range.column);
+        }
+        fprintf(f, "\n");
+    };
+    fprintf(f, "\n=== LINE TABLE (instruction@line:column) ===\n");
+    printLines("main", instructions);
+    for(const auto& func : functions) printLines(func.name.c_str(), func.instructions);
     fprintf(f, "\n=== VARIABLE TABLE ===\n");
     for(const auto& [var, type] : variableTypes) {
         std::string typeName = (type == 0) ? "int" : "bool";
+        auto size = arraySizes.find(var);
+        if(size != arraySizes.end()) typeName += "[" + std::to_string(size->second) + "]";
         fprintf(f, "  %s : %s\n", var.c_str(), typeName.c_str());
     }
     fclose(f);
@@ -0,0 +1,153 @@
+/**
+ * @file jit.h
+ * @brief Minimal x86-64 assembler and executable memory for loop traces
+ *
+ * Only what the trace compiler needs: 32-bit moves, arithmetic and
+ * compares on EAX/ECX/EDX, memory operands relative to RDI (globals) and
+ * RSI (frame), optionally indexed by RCX * 4, and rel32 jumps to labels.
+ * Native code is available on x86-64 Linux and macOS (LAB3_JIT); other
+ * targets keep interpreting.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define LAB3_JIT 1
+#include <sys/mman.h>
+#endif
+
+namespace jit {
+
+enum Reg : uint8_t { EAX = 0, ECX = 1, EDX = 2, RSI = 6, RDI = 7 };
+
+// Condition codes (low nibble of Jcc / SETcc)
+enum Cond : uint8_t { AE = 0x3, E = 0x4, NE = 0x5, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF };
+
+class Assembler {
+    std::vector<uint8_t> bytes;
+    std::vector<long> labels;  // offset, or -1 while unbound
+    struct Fixup {
+        size_t at;  // rel32 field
+        int label;
+    };
+    std::vector<Fixup> fixups;
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+    void imm32(int32_t v) {
+        uint8_t raw[4];
+        memcpy(raw, &v, 4);
+        bytes.insert(bytes.end(), raw, raw + 4);
+    }
+    void rel32(int label) {
+        fixups.push_back({bytes.size(), label});
+        imm32(0);
+    }
+    // [base + disp32]
+    void memory(Reg r, Reg base, int32_t disp) {
+        byte(0x80 | (r << 3) | base);
+        imm32(disp);
+    }
+    // [base + rcx*4 + disp32]
+    void indexed(Reg r, Reg base, int32_t disp) {
+        byte(0x84 | (r << 3));
+        byte(0x88 | base);
+        imm32(disp);
+    }
+
+public:
+    int newLabel() {
+        labels.push_back(-1);
+        return static_cast<int>(labels.size()) - 1;
+    }
+    void bind(int label) { labels[label] = static_cast<long>(bytes.size()); }
+    // Offset of the next instruction
+    size_t size() const { return bytes.size(); }
+
+    void movImm(Reg r, int32_t v) { byte(0xB8 + r); imm32(v); }
+    void load(Reg r, Reg base, int32_t disp) { byte(0x8B); memory(r, base, disp); }
+    void store(Reg base, int32_t disp, Reg r) { byte(0x89); memory(r, base, disp); }
+    void loadIndexed(Reg r, Reg base, int32_t disp) { byte(0x8B); indexed(r, base, disp); }
+    void storeIndexed(Reg base, int32_t disp, Reg r) { byte(0x89); indexed(r, base, disp); }
+    void mov(Reg dst, Reg src) { byte(0x89); byte(0xC0 | (src << 3) | dst); }
+
+    // dst op= src
+    void add(Reg dst, Reg src) { byte(0x01); byte(0xC0 | (src << 3) | dst); }
+    void sub(Reg dst, Reg src) { byte(0x29); byte(0xC0 | (src << 3) | dst); }
+    void imul(Reg dst, Reg src) { byte(0x0F); byte(0xAF); byte(0xC0 | (dst << 3) | src); }
+    void cmp(Reg left, Reg right) { byte(0x39); byte(0xC0 | (right << 3) | left); }
+    void cmpImm(Reg r, int32_t v) { byte(0x81); byte(0xF8 | r); imm32(v); }
+    // dword [base + disp32] -= v
+    void subImm(Reg base, int32_t disp, int32_t v) { byte(0x81); memory(static_cast<Reg>(5), base, disp); imm32(v); }
+    void test(Reg r) { byte(0x85); byte(0xC0 | (r << 3) | r); }
+    void neg(Reg r) { byte(0xF7); byte(0xD8 | r); }
+    void cdq() { byte(0x99); }
+    void idiv(Reg r) { byte(0xF7); byte(0xF8 | r); }
+
+    // Low byte of r = condition; zero-extend the low byte of r into r
+    void setcc(Cond c, Reg r) { byte(0x0F); byte(0x90 | c); byte(0xC0 | r); }
+    void movzxByte(Reg r) { byte(0x0F); byte(0xB6); byte(0xC0 | (r << 3) | r); }
+    void andByte(Reg dst, Reg src) { byte(0x20); byte(0xC0 | (src << 3) | dst); }
+    void orByte(Reg dst, Reg src) { byte(0x08); byte(0xC0 | (src << 3) | dst); }
+
+    void jcc(Cond c, int label) { byte(0x0F); byte(0x80 | c); rel32(label); }
+    void jmp(int label) { byte(0xE9); rel32(label); }
+    void ret() { byte(0xC3); }
+
+    // Machine code with all label references resolved
+    std::vector<uint8_t> finish() {
+        for(const auto& f : fixups) {
+            int32_t rel = static_cast<int32_t>(labels[f.label] - static_cast<long>(f.at + 4));
+            memcpy(&bytes[f.at], &rel, 4);
+        }
+        return bytes;
+    }
+};
+
+// A block of executable memory holding one compiled function
+class Code {
+    void* memory = nullptr;
+    size_t size = 0;
+
+    Code() = default;
+
+public:
+    Code(const Code&) = delete;
+    Code& operator=(const Code&) = delete;
+
+    ~Code() {
+#ifdef LAB3_JIT
+        if(memory) munmap(memory, size);
+#endif
+    }
+
+    // Copies `bytes` into fresh pages and makes them executable; null when
+    // the platform has no JIT or the mapping fails
+    static std::unique_ptr<Code> load(const std::vector<uint8_t>& bytes) {
+#ifdef LAB3_JIT
+        std::unique_ptr<Code> code(new Code());
+        code->size = bytes.size();
+        void* memory = mmap(nullptr, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED) return nullptr;
+        code->memory = memory;
+        memcpy(memory, bytes.data(), bytes.size());
+        if(mprotect(memory, code->size, PROT_READ | PROT_EXEC) != 0) return nullptr;
+        return code;
+#else
+        (void)bytes;
+        return nullptr;
+#endif
+    }
+
+    template<typename Fn>
+    Fn entry() const { return reinterpret_cast<Fn>(memory); }
+
+    const void* address() const { return memory; }
+    size_t bytes() const { return size; }
+};
+
+}  // namespace jit
@@ -9,13 +9,14 @@
 #include <vector>
 #include <cctype>
 #include <unordered_set>
+#include <unordered_map>
 
 enum class TokenType {
     // Literals and identifiers
     INT_LIT, BOOL_LIT, IDENT,
     
     // Keywords
-    INT_KW, BOOL_KW, IF, ELSE, WHILE, FOR, RETURN, PRINT,
+    INT_KW, BOOL_KW, IF, ELSE, WHILE, FOR, PARALLEL, RETURN, PRINT,
     
     // Operators
     PLUS, MINUS, STAR, SLASH, PERCENT,
@@ -24,7 +25,7 @@ enum class TokenType {
     ASSIGN,
     
     // Delimiters
-    LPAREN, RPAREN, LBRACE, RBRACE,
+    LPAREN, RPAREN, LBRACE, RBRACE, LBRACKET, RBRACKET,
     SEMICOLON, COMMA,
     
     // Special
@@ -54,6 +55,7 @@ struct Token {
             {TokenType::ELSE, "ELSE"},
             {TokenType::WHILE, "WHILE"},
             {TokenType::FOR, "FOR"},
+            {TokenType::PARALLEL, "PARALLEL"},
             {TokenType::RETURN, "RETURN"},
             {TokenType::PRINT, "PRINT"},
             {TokenType::PLUS, "PLUS"},
@@ -75,6 +77,8 @@ struct Token {
             {TokenType::RPAREN, "RPAREN"},
             {TokenType::LBRACE, "LBRACE"},
             {TokenType::RBRACE, "RBRACE"},
+            {TokenType::LBRACKET, "LBRACKET"},
+            {TokenType::RBRACKET, "RBRACKET"},
             {TokenType::SEMICOLON, "SEMICOLON"},
             {TokenType::COMMA, "COMMA"},
             {TokenType::END_OF_FILE, "EOF"}
@@ -182,6 +186,7 @@ private:
             if(ident == "else") return Token(TokenType::ELSE, ident, startLine, startCol);
             if(ident == "while") return Token(TokenType::WHILE, ident, startLine, startCol);
             if(ident == "for") return Token(TokenType::FOR, ident, startLine, startCol);
+            if(ident == "parallel") return Token(TokenType::PARALLEL, ident, startLine, startCol);
             if(ident == "return") return Token(TokenType::RETURN, ident, startLine, startCol);
             if(ident == "print") return Token(TokenType::PRINT, ident, startLine, startCol);
             if(ident == "true") {
@@ -211,6 +216,8 @@ private:
             case ')': return Token(TokenType::RPAREN, ")", startLine, startCol);
             case '{': return Token(TokenType::LBRACE, "{", startLine, startCol);
             case '}': return Token(TokenType::RBRACE, "}", startLine, startCol);
+            case '[': return Token(TokenType::LBRACKET, "[", startLine, startCol);
+            case ']': return Token(TokenType::RBRACKET, "]", startLine, startCol);
             case ';': return Token(TokenType::SEMICOLON, ";", startLine, startCol);
             case ',': return Token(TokenType::COMMA, ",", startLine, startCol);
             
@@ -262,5 +269,5 @@ private:
 };
 
 const std::unordered_set<std::string> Lexer::KEYWORDS = {
-    "int", "bool", "if", "else", "while", "for", "return", "print"
+    "int", "bool", "if", "else", "while", "for", "parallel", "return", "print"
 };
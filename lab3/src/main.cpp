@@ -14,6 +14,13 @@
 #include "codegen.h"
 #include "optimizer.h"
 #include "interpreter.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "cache.h"
+#include "snapshot.h"
+#include "closure.h"
+#include "allocs.h"
+#include "perfcounters.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -25,6 +32,32 @@ void printUsage(const char* programName) {
     fprintf(stderr, "  -ast              Print AST\n");
     fprintf(stderr, "  -tokens           Print tokens\n");
     fprintf(stderr, "  -noopt            Disable optimization\n");
+    fprintf(stderr, "  -noinline         Disable function inlining\n");
+    fprintf(stderr, "  -novec            Disable loop vectorization\n");
+    fprintf(stderr, "  -autopar          Run independent counted loops in parallel\n");
+    fprintf(stderr, "  -pgo              Profile a training run to guide inlining\n");
+    fprintf(stderr, "  -memoize          Cache results of pure functions at run time\n");
+    fprintf(stderr, "  -nosuper          Disable superinstructions in the interpreter\n");
+    fprintf(stderr, "  -notrace          Do not compile hot loops to native traces\n");
+    fprintf(stderr, "  -max-steps <n>    Fail after executing n IR ops\n");
+    fprintf(stderr, "  -max-time <ms>    Fail after ms milliseconds of wall time\n");
+    fprintf(stderr, "  -max-output <n>   Fail when printed output exceeds n bytes\n");
+    fprintf(stderr, "  -max-frames <n>   Fail when call frames need more than n bytes\n");
+    fprintf(stderr, "  -threads <n>      Worker threads for parallel loops (default: all cores)\n");
+    fprintf(stderr, "  -batch <file>     Run once per input record (one line of integers each)\n");
+    fprintf(stderr, "  -instances <n>    Run n instances interleaved as green threads\n");
+    fprintf(stderr, "  -slice <n>        Steps an instance runs per turn (default: 10000)\n");
+    fprintf(stderr, "  -engine <name>    Execution engine: switch (default) or closure\n");
+    fprintf(stderr, "  -cache <dir>      Replay runs of input-free programs cached in dir\n");
+    fprintf(stderr, "  -snapshot <file>  Save the run's state to file when it pauses\n");
+    fprintf(stderr, "  -checkpoint <n>   Also save it every n steps\n");
+    fprintf(stderr, "  -pause-after <n>  Stop after n more steps (snapshot kept for -resume)\n");
+    fprintf(stderr, "  -resume <file>    Continue the run saved in a snapshot file\n");
+    fprintf(stderr, "  -sample-profile <file>  Sample the run; write folded stacks to file\n");
+    fprintf(stderr, "  -sample-hz <n>    Samples per second of CPU time (default: 1000)\n");
+    fprintf(stderr, "  -perf-map         Name trace code for perf in /tmp/perf-<pid>.map\n");
+    fprintf(stderr, "  -jitdump <dir>    Write trace code to dir/jit-<pid>.dump for perf inject\n");
+    fprintf(stderr, "  -perf-counters    Count cycles, instructions and misses per phase\n");
     fprintf(stderr, "  -o <file>         Output TAC to file\n");
 }
 
@@ -39,6 +72,87 @@ std::string readFile(const char* filename) {
     return buffer.str();
 }
 
+// Values for input(): all integers on stdin, read only when the program
+// calls input()
+std::vector<int> readInput(const IRProgram& ir) {
+    auto calls = [](const std::vector<Instruction>& body) {
+        return std::any_of(body.begin(), body.end(), [](const Instruction& instr) {
+            return instr.type == InstrType::INPUT;
+        });
+    };
+    bool used = calls(ir.instructions);
+    for(const auto& func : ir.functions) used = used || calls(func.instructions);
+
+    std::vector<int> values;
+    long value;
+    while(used && std::cin >> value) values.push_back(static_cast<int>(value));
+    return values;
+}
+
+// Hottest lines and blocks of a sampled run; all call stacks go to
+// `file` in the folded format of flame graph tools ("a;b;c count")
+void reportSamples(const SampleStats& stats, const char* file) {
+    std::ofstream out(file);
+    for(const auto& stack : stats.stacks) out << stack.where << " " << stack.samples << "\n";
+    if(!out) fprintf(stderr, "Error: Cannot write file '%s'\n", file);
+
+    printf("  Sample profile: %ld samples at %d Hz, %ld dropped, %zu stacks in %s\n",
+           stats.samples, stats.hz, stats.dropped, stats.stacks.size(), file);
+    const size_t shown = 5;
+    for(const auto* spots : {&stats.lines, &stats.blocks}) {
+        if(spots->empty()) continue;
+        printf("    Hottest %s:\n", spots == &stats.lines ? "lines" : "blocks");
+        for(size_t i = 0; i < spots->size() && i < shown; i++) {
+            printf("      %6.2f%%  %s\n", 100.0 * (*spots)[i].samples / stats.samples, (*spots)[i].where.c_str());
+        }
+    }
+}
+
+long irSize(const IRProgram& ir) {
+    long size = static_cast<long>(ir.instructions.size());
+    for(const auto& func : ir.functions) size += static_cast<long>(func.instructions.size());
+    return size;
+}
+
+// Counter totals per phase, then the same per token, IR instruction or
+// executed op; "-" where the event is not counted on this machine
+void reportCounters(PerfCounters& counters) {
+    counters.stop();
+    const PerfCounters::Event events[] = {PerfCounters::CYCLES, PerfCounters::INSTRUCTIONS,
+                                          PerfCounters::BRANCH_MISSES, PerfCounters::L1D_MISSES,
+                                          PerfCounters::LLC_MISSES};
+    printf("\n=== PERFORMANCE COUNTERS (user space) ===\n");
+    printf("  %-10s %26s", "phase", "task ms");
+    for(auto event : events) printf(" %14s", PerfCounters::name(event));
+    printf(" %6s\n", "IPC");
+    for(const auto& phase : counters.getPhases()) {
+        printf("  %-10s %26.3f", phase.name.c_str(), phase.values[PerfCounters::TASK_CLOCK] / 1e6);
+        for(auto event : events) {
+            if(counters.supported(event)) printf(" %14.0f", phase.values[event]);
+            else printf(" %14s", "-");
+        }
+        double cycles = phase.values[PerfCounters::CYCLES];
+        if(counters.supported(PerfCounters::INSTRUCTIONS) && counters.supported(PerfCounters::CYCLES) && cycles > 0) {
+            printf(" %6.2f\n", phase.values[PerfCounters::INSTRUCTIONS] / cycles);
+        } else {
+            printf(" %6s\n", "-");
+        }
+    }
+    printf("\n  %-10s %15s %10s", "per unit", "unit", "task ns");
+    for(auto event : events) printf(" %14s", PerfCounters::name(event));
+    printf("\n");
+    for(const auto& phase : counters.getPhases()) {
+        if(phase.units <= 0) continue;
+        printf("  %-10s %15s %10.1f", phase.name.c_str(), phase.unit,
+               phase.values[PerfCounters::TASK_CLOCK] / phase.units);
+        for(auto event : events) {
+            if(counters.supported(event)) printf(" %14.2f", phase.values[event] / phase.units);
+            else printf(" %14s", "-");
+        }
+        printf("\n");
+    }
+}
+
 void printBanner() {
     printf("\n");
     printf("╔════════════════════════════════════════════════════════════╗\n");
@@ -76,9 +190,33 @@ int main(int argc, char* argv[]) {
     // Parse arguments
     const char* sourceFile = argv[1];
     const char* outputFile = nullptr;
+    const char* batchFile = nullptr;
+    const char* cacheDir = nullptr;
+    const char* snapshotFile = nullptr;
+    const char* resumeFile = nullptr;
+    const char* sampleFile = nullptr;
+    const char* jitdumpDir = nullptr;
+    bool perfMap = false;
+    bool perfCounters = false;
+    const char* engine = "switch";
     bool printTokens = false;
     bool printAST = false;
     bool optimize = true;
+    bool inlining = true;
+    bool profileGuided = false;
+    bool memoize = false;
+    bool vectorize = true;
+    bool autoParallel = false;
+    bool superinstructions = true;
+    bool tracing = true;
+    std::vector<int> input;  // values for input()
+    int threads = 0;
+    ExecutionLimits limits;
+    int instances = 0;
+    long slice = Scheduler::DEFAULT_SLICE;
+    long checkpointSteps = 0;
+    long pauseAfter = 0;
+    int sampleHz = 1000;
 
     for(int i = 2; i < argc; i++) {
         if(strcmp(argv[i], "-tokens") == 0) {
@@ -87,21 +225,110 @@ int main(int argc, char* argv[]) {
             printAST = true;
         } else if(strcmp(argv[i], "-noopt") == 0) {
             optimize = false;
+        } else if(strcmp(argv[i], "-noinline") == 0) {
+            inlining = false;
+        } else if(strcmp(argv[i], "-novec") == 0) {
+            vectorize = false;
+        } else if(strcmp(argv[i], "-autopar") == 0) {
+            autoParallel = true;
+        } else if(strcmp(argv[i], "-pgo") == 0) {
+            profileGuided = true;
+        } else if(strcmp(argv[i], "-memoize") == 0) {
+            memoize = true;
+        } else if(strcmp(argv[i], "-nosuper") == 0) {
+            superinstructions = false;
+        } else if(strcmp(argv[i], "-notrace") == 0) {
+            tracing = false;
+        } else if(strcmp(argv[i], "-max-steps") == 0 && i + 1 < argc) {
+            limits.steps = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-max-time") == 0 && i + 1 < argc) {
+            limits.millis = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-max-output") == 0 && i + 1 < argc) {
+            limits.outputBytes = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-max-frames") == 0 && i + 1 < argc) {
+            limits.frameBytes = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-batch") == 0 && i + 1 < argc) {
+            batchFile = argv[++i];
+        } else if(strcmp(argv[i], "-instances") == 0 && i + 1 < argc) {
+            instances = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-slice") == 0 && i + 1 < argc) {
+            slice = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            engine = argv[++i];
+        } else if(strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if(strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc) {
+            snapshotFile = argv[++i];
+        } else if(strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc) {
+            checkpointSteps = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-pause-after") == 0 && i + 1 < argc) {
+            pauseAfter = atol(argv[++i]);
+        } else if(strcmp(argv[i], "-resume") == 0 && i + 1 < argc) {
+            resumeFile = argv[++i];
+        } else if(strcmp(argv[i], "-sample-profile") == 0 && i + 1 < argc) {
+            sampleFile = argv[++i];
+        } else if(strcmp(argv[i], "-sample-hz") == 0 && i + 1 < argc) {
+            sampleHz = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-perf-map") == 0) {
+            perfMap = true;
+        } else if(strcmp(argv[i], "-perf-counters") == 0) {
+            perfCounters = true;
+        } else if(strcmp(argv[i], "-jitdump") == 0 && i + 1 < argc) {
+            jitdumpDir = argv[++i];
         } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             outputFile = argv[++i];
         }
     }
 
+    if(strcmp(engine, "switch") != 0 && strcmp(engine, "closure") != 0) {
+        fprintf(stderr, "Error: Unknown engine '%s'\n", engine);
+        return 1;
+    }
+    // Checkpoints go to the snapshot file, or back to the one resumed
+    if(!snapshotFile) snapshotFile = resumeFile;
+    bool snapshots = snapshotFile != nullptr;
+    if((checkpointSteps > 0 || pauseAfter > 0) && !snapshots) {
+        fprintf(stderr, "Error: -checkpoint and -pause-after need -snapshot <file>\n");
+        return 1;
+    }
+    if(snapshots && (batchFile || instances > 0 || strcmp(engine, "switch") != 0)) {
+        fprintf(stderr, "Error: Snapshots need the switch engine without -batch or -instances\n");
+        return 1;
+    }
+    if(sampleFile && (snapshots || batchFile || instances > 0 || strcmp(engine, "switch") != 0)) {
+        fprintf(stderr, "Error: -sample-profile needs the switch engine without -batch, -instances or snapshots\n");
+        return 1;
+    }
+    if(sampleFile && (sampleHz <= 0 || !SampleTimer::available())) {
+        fprintf(stderr, "Error: -sample-profile needs a positive -sample-hz and a POSIX system\n");
+        return 1;
+    }
+
     printf("Input file: %s\n", sourceFile);
     if(optimize) printf("Optimization: Enabled\n");
     printf("\n");
 
     // ========== PHASE 1: LEXICAL ANALYSIS ==========
+    PerfCounters counters;
+    if(perfCounters && !counters.open()) {
+        std::string warning = "Hardware counters unavailable (" + counters.getError() + "); task-clock only";
+        printWarning(warning.c_str());
+    }
+    AllocPhase allocPhase("lex");
+    counters.enter("lex");
+    auto enterPhase = [&](const char* phase) {
+        allocPhase.enter(phase);
+        counters.enter(phase);
+    };
     printPhase("Phase 1: Lexical Analysis");
     std::string sourceCode = readFile(sourceFile);
 
     Lexer lexer(sourceCode);
     auto tokens = lexer.tokenize();
+    long tokenCount = static_cast<long>(tokens.size()) - 1;  // -1 for EOF
+    counters.count(tokenCount, "token");
 
     printSuccess("Tokenization complete");
     printf("  Tokens generated: %zu\n", tokens.size() - 1);  // -1 for EOF
@@ -118,9 +345,11 @@ int main(int argc, char* argv[]) {
     }
 
     // ========== PHASE 2: SYNTAX ANALYSIS ==========
+    enterPhase("parse");
     printPhase("Phase 2: Syntax Analysis");
     Parser parser(tokens);
     auto ast = parser.parse();
+    counters.count(tokenCount, "token");
 
     if(!ast) {
         printError("Failed to parse program");
@@ -131,9 +360,11 @@ int main(int argc, char* argv[]) {
     printf("  Statements: %zu\n", ast->statements.size());
 
     // ========== PHASE 3: SEMANTIC ANALYSIS ==========
+    enterPhase("semantic");
     printPhase("Phase 3: Semantic Analysis");
     SemanticAnalyzer semanticAnalyzer;
     bool semanticOK = semanticAnalyzer.analyze(ast);
+    counters.count(tokenCount, "token");
 
     if(!semanticOK) {
         const auto& errors = semanticAnalyzer.getErrors();
@@ -151,19 +382,77 @@ int main(int argc, char* argv[]) {
     }
 
     // ========== PHASE 4: CODE GENERATION ==========
+    enterPhase("codegen");
     printPhase("Phase 4: Code Generation");
     CodeGenerator codegen(semanticAnalyzer);
     auto ir = codegen.generate(ast);
+    counters.count(irSize(ir), "IR instruction");
 
     printSuccess("Code generation complete");
     printf("  Instructions: %zu\n", ir.instructions.size());
     printf("  Variables: %zu\n", ir.variableTypes.size());
+    if(!ir.functions.empty()) {
+        printf("  Functions: %zu\n", ir.functions.size());
+    }
 
     // ========== PHASE 5: OPTIMIZATION ==========
     if(optimize) {
+        enterPhase("optimize");
         printPhase("Phase 5: Optimization");
-        Optimizer optimizer;
+        InlineConfig inlineConfig;
+        inlineConfig.enabled = inlining;
+        if(inlining && profileGuided && !ir.functions.empty()) {
+            Interpreter trainer;
+            trainer.setQuiet(true);
+            trainer.setLimits(limits);  // an untrusted program must not hang the compiler
+            if(!batchFile) {
+                input = readInput(ir);
+                trainer.setInput(input.data(), input.size());
+            }
+            if(trainer.execute(ir)) {
+                inlineConfig.profile = trainer.getCallCounts();
+                printf("  Profile: %zu functions\n", inlineConfig.profile.size());
+            } else {
+                printf("  Profile: training run failed, inlining without a profile\n");
+            }
+        }
+
+        Optimizer optimizer(inlineConfig);
+        optimizer.setVectorize(vectorize);
+        optimizer.setAutoParallel(autoParallel);
         auto optimizedIR = optimizer.optimize(ir);
+        counters.count(irSize(ir), "IR instruction");
+
+        const auto& stats = optimizer.getStats();
+        if(stats.tailCalls > 0) {
+            printf("  Tail-call elimination: %d self-recursive calls\n", stats.tailCalls);
+        }
+        if(stats.inlinedCalls > 0) {
+            printf("  Inlining: %d call sites, +%d instructions, %d functions removed\n",
+                   stats.inlinedCalls, stats.inlineGrowth, stats.removedFunctions);
+        }
+        if(stats.vectorizedLoops > 0 || !stats.vectorReport.empty()) {
+            printf("  Vectorization: %d loops vectorized, %zu rejected\n",
+                   stats.vectorizedLoops, stats.vectorReport.size());
+            for(const auto& rejected : stats.vectorReport) {
+                printf("    not vectorized: %s\n", rejected.c_str());
+            }
+        }
+        if(autoParallel) {
+            printf("  Auto-parallelization: %d loops parallelized, %zu rejected\n",
+                   stats.parallelizedLoops, stats.parallelReport.size());
+            for(const auto& rejected : stats.parallelReport) {
+                printf("    serial: %s\n", rejected.c_str());
+            }
+        }
+
+        if(stats.boundsChecksRemoved > 0 || !stats.keptBoundsChecks.empty()) {
+            printf("  Bounds checks: %d removed, %zu kept\n",
+                   stats.boundsChecksRemoved, stats.keptBoundsChecks.size());
+            for(const auto& kept : stats.keptBoundsChecks) {
+                printf("    checked: %s\n", kept.c_str());
+            }
+        }
 
         int removed = ir.instructions.size() - optimizedIR.instructions.size();
         if(removed > 0) {
@@ -174,6 +463,7 @@ int main(int argc, char* argv[]) {
     }
 
     // ========== OUTPUT: THREE-ADDRESS CODE ==========
+    enterPhase("output");
     printf("\n");
     ir.print();
 
@@ -183,21 +473,266 @@ int main(int argc, char* argv[]) {
     }
 
     // ========== PHASE 6: INTERPRETATION ==========
+    enterPhase("interpret");
     printPhase("Phase 6: Interpretation");
-    Interpreter interpreter;
-    bool execOK = interpreter.execute(ir);
-
-    if(!execOK) {
-        printError("Execution failed");
-        return 1;
+    bool limited = limits.steps > 0 || limits.millis > 0 || limits.outputBytes > 0 || limits.frameBytes > 0;
+    if(limited && (batchFile || (instances == 0 && strcmp(engine, "closure") == 0))) {
+        printWarning("Execution limits are enforced by the switch engine only; -max-* ignored");
+    }
+    if((perfMap || jitdumpDir) && (batchFile || instances > 0 || snapshots || strcmp(engine, "closure") == 0)) {
+        printWarning("Only plain switch engine runs compile traces; -perf-map and -jitdump ignored");
+    }
+    // The output of an input-free program is a function of its IR
+    std::unique_ptr<ResultCache> cache;
+    std::string cacheKey;
+    CachedRun cached;
+    bool replay = false;
+    if(cacheDir && sampleFile) {
+        printWarning("A sampled run is never replayed; -cache ignored");
+    } else if(cacheDir && !snapshots && !batchFile && instances == 0 && strcmp(engine, "switch") == 0) {
+        if(ResultCache::cacheable(ir)) {
+            cache = std::make_unique<ResultCache>(cacheDir);
+            cacheKey = ResultCache::key(ir, limits);
+            replay = cache->lookup(cacheKey, cached);
+        } else {
+            printWarning("The program reads input(); -cache ignored");
+        }
     }
+    if(batchFile) {
+        std::ifstream records(batchFile);
+        if(!records.is_open()) {
+            fprintf(stderr, "Error: Cannot open file '%s'\n", batchFile);
+            return 1;
+        }
+        BatchInterpreter batch;
+        bool batchOK = batch.execute(ir, records);
+        const auto& stats = batch.getStats();
+        counters.count(stats.steps, "executed op");
+        if(!batchOK) {
+            printError("Execution failed");
+            if(stats.failed > 0) {
+                printf("  Failed records: %ld of %ld\n", stats.failed, stats.records);
+            }
+            return 1;
+        }
+        printSuccess("Execution complete");
+        printf("  Batch: %ld records in %ld batches of %d lanes, %.1f%% lane utilization\n",
+               stats.records, stats.batches, BatchInterpreter::LANES, batch.utilization());
+        printf("  Steps: %ld (%ld masked), %ld per-lane calls, %ld output lines\n",
+               stats.steps, stats.maskedSteps, stats.laneCalls, stats.outputLines);
+    } else if(instances > 0) {
+        if(input.empty()) input = readInput(ir);
+        if(memoize) printWarning("Instances do not memoize; -memoize ignored");
+        Scheduler scheduler;
+        scheduler.setThreads(threads);
+        scheduler.setSlice(slice);
+        int program = scheduler.addProgram(ir, limits);
+        for(int i = 0; i < instances; i++) scheduler.spawn(program, input);
+        scheduler.run();
+        counters.count(scheduler.getStats().steps, "executed op");
+
+        // Instance 0 stands for the others; differing outputs are counted
+        const auto& first = scheduler.result(0);
+        for(const auto& line : first.output) printf("%s\n", line.c_str());
+        int differing = 0;
+        const Scheduler::Result* failure = nullptr;
+        for(int i = 0; i < instances; i++) {
+            const auto& result = scheduler.result(i);
+            if(result.output != first.output) differing++;
+            if(!result.ok && !failure) failure = &result;
+        }
+        const auto& stats = scheduler.getStats();
+        if(failure) {
+            fprintf(stderr, "Runtime error: %s\n", failure->error.c_str());
+            printError("Execution failed");
+            printf("  Failed instances: %ld of %ld\n", stats.failed, stats.instances);
+            return 1;
+        }
+        printSuccess("Execution complete");
+        printf("  Output lines: %zu per instance, %d instances differ from the first\n",
+               first.output.size(), differing);
+        printf("  Scheduler: %ld instances on %d threads, %ld slices of %ld steps, %ld steps in all\n",
+               stats.instances, stats.threads, stats.slices, slice, stats.steps);
+        printf("  Instance state: %zu bytes (globals, value stack, call records)\n",
+               stats.instanceBytes);
+    } else if(snapshots) {
+        if(memoize) printWarning("Snapshot runs do not memoize; -memoize ignored");
+        Interpreter interpreter;
+        interpreter.setLimits(limits);
+        std::string key = SnapshotFile::programKey(ir);
+        std::unique_ptr<Interpreter::Instance> instance;
+        long checkpoints = 0;
+        long snapshotBytes = 0;
+        try {
+            interpreter.prepare(ir, 0);
+            if(resumeFile) {
+                instance = SnapshotFile::load(resumeFile, key, interpreter);
+                printf("  Snapshot: resumed %s at step %ld, %ld lines printed before\n",
+                       resumeFile, instance->getSteps(), instance->getOutputLines());
+            } else {
+                input = readInput(ir);
+                instance = interpreter.spawn(input.data(), input.size(), Interpreter::STACK_SLOTS);
+            }
+            // Run to the next checkpoint or the pause, whichever comes first
+            long pauseAt = (pauseAfter > 0) ? instance->getSteps() + pauseAfter : LONG_MAX;
+            while(true) {
+                long remaining = pauseAt - instance->getSteps();
+                long steps = (checkpointSteps > 0) ? std::min(checkpointSteps, remaining) : remaining;
+                if(steps <= 0 || interpreter.resume(*instance, std::min(steps, LONG_MAX / 4))) break;
+                snapshotBytes = SnapshotFile::save(snapshotFile, key, interpreter, *instance);
+                checkpoints++;
+            }
+        } catch(const std::exception& e) {
+            fprintf(stderr, "Runtime error: %s\n", e.what());
+            printError("Execution failed");
+            return 1;
+        }
 
-    printSuccess("Execution complete");
-    const auto& output = interpreter.getOutput();
-    if(!output.empty()) {
-        printf("  Output lines: %zu\n", output.size());
+        if(!instance->finished()) {
+            printSuccess("Execution paused");
+            printf("  Snapshot: %s (%ld bytes) after %ld steps, %ld checkpoints\n",
+                   snapshotFile, snapshotBytes, instance->getSteps(), checkpoints);
+            printf("  Continue with: -resume %s\n", snapshotFile);
+            return 0;
+        }
+        // A finished run leaves no checkpoint behind to be resumed by mistake
+        if(checkpoints > 0 || (resumeFile && strcmp(resumeFile, snapshotFile) == 0)) std::remove(snapshotFile);
+        printSuccess("Execution complete");
+        if(instance->getOutputLines() > 0) {
+            printf("  Output lines: %ld\n", instance->getOutputLines());
+        }
+        printf("  Snapshot: finished after %ld steps, %ld checkpoints\n", instance->getSteps(), checkpoints);
+    } else if(replay) {
+        for(const auto& line : cached.output) printf("%s\n", line.c_str());
+        if(!cached.ok) {
+            fprintf(stderr, "Runtime error: %s\n", cached.error.c_str());
+            printError("Execution failed");
+            printf("  Result cache: hit %s\n", cacheKey.c_str());
+            return 1;
+        }
+        printSuccess("Execution complete");
+        if(!cached.output.empty()) {
+            printf("  Output lines: %zu\n", cached.output.size());
+        }
+        printf("  Result cache: hit %s\n", cacheKey.c_str());
+    } else if(strcmp(engine, "closure") == 0) {
+        if(input.empty()) input = readInput(ir);
+        if(memoize) printWarning("The closure engine does not memoize; -memoize ignored");
+        ClosureInterpreter interpreter;
+        interpreter.setInput(input.data(), input.size());
+        bool execOK = interpreter.execute(ir);
+
+        if(!execOK) {
+            printError("Execution failed");
+            return 1;
+        }
+
+        printSuccess("Execution complete");
+        const auto& output = interpreter.getOutput();
+        if(!output.empty()) {
+            printf("  Output lines: %zu\n", output.size());
+        }
+        const auto& stats = interpreter.getStats();
+        printf("  Closure engine: %d handler nodes, %d jumps threaded\n",
+               stats.nodes, stats.threadedJumps);
+    } else {
+        if(input.empty()) input = readInput(ir);
+        // Traces are the only code generated at run time
+        jit::PerfMap perf;
+        perf.setSource(std::filesystem::absolute(sourceFile).string());
+        if(perfMap && !perf.openMap()) printWarning("Perf maps are written on Linux only; -perf-map ignored");
+        if(jitdumpDir && !perf.openDump(jitdumpDir)) {
+            fprintf(stderr, "Error: Cannot write a jitdump file in '%s'\n", jitdumpDir);
+            return 1;
+        }
+        Interpreter interpreter;
+        interpreter.setPerfMap(&perf);
+        interpreter.setInput(input.data(), input.size());
+        interpreter.setMemoize(memoize);
+        interpreter.setThreads(threads);
+        interpreter.setSuperinstructions(superinstructions);
+        interpreter.setTracing(tracing);
+        interpreter.setLimits(limits);
+        if(sampleFile) interpreter.setSampling(sampleHz);
+        bool execOK = interpreter.execute(ir);
+        const auto& budget = interpreter.getBudgetStats();
+        counters.count(budget.steps, "executed op");
+        // A timed-out run says nothing about the next one
+        if(cache && !(budget.exceeded && budget.resource == LimitExceeded::TIME)) {
+            cache->store(cacheKey, {execOK, interpreter.getError(), interpreter.getOutput()});
+        }
+
+        if(!execOK) {
+            printError("Execution failed");
+            if(cache) printf("  Result cache: miss, stored %s\n", cacheKey.c_str());
+            if(sampleFile) reportSamples(interpreter.getSampleStats(), sampleFile);
+            if(perfCounters) reportCounters(counters);
+            if(budget.exceeded) {
+                printf("  Limit exceeded: %s (limit %ld), used %ld steps, %ld ms, %ld output bytes, "
+                       "%ld frame bytes\n",
+                       LimitExceeded::name(budget.resource), budget.limit, budget.steps,
+                       budget.millis, budget.outputBytes, budget.frameBytes);
+            }
+            return 1;
+        }
+
+        printSuccess("Execution complete");
+        const auto& output = interpreter.getOutput();
+        if(!output.empty()) {
+            printf("  Output lines: %zu\n", output.size());
+        }
+        if(cache) {
+            printf("  Result cache: miss, stored %s\n", cacheKey.c_str());
+        }
+        if(limited) {
+            printf("  Budget: %ld steps, %ld ms, %ld output bytes, %ld frame bytes\n",
+                   budget.steps, budget.millis, budget.outputBytes, budget.frameBytes);
+        }
+        if(sampleFile) reportSamples(interpreter.getSampleStats(), sampleFile);
+        const auto& parallel = interpreter.getParallelStats();
+        if(parallel.loops > 0) {
+            printf("  Parallel loops: %ld run, %ld chunks on %d threads, %ld steals\n",
+                   parallel.loops, parallel.chunks, parallel.threads, parallel.steals);
+        }
+        const auto& traces = interpreter.getTraceStats();
+        if(!traces.report.empty()) {
+            printf("  Traces: %d loops compiled (%ld bytes of native code), %d rejected, %ld entries\n",
+                   traces.compiled, traces.nativeBytes, traces.rejected, traces.entries);
+            for(const auto& line : traces.report) {
+                printf("    %s\n", line.c_str());
+            }
+        }
+        if(!perf.getMapFile().empty() || !perf.getDumpFile().empty()) {
+            const char* separator = " in ";
+            printf("  Perf symbols: %ld code blocks", perf.getBlocks());
+            for(const auto* file : {&perf.getMapFile(), &perf.getDumpFile()}) {
+                if(file->empty()) continue;
+                printf("%s%s", separator, file->c_str());
+                separator = ", ";
+            }
+            printf("\n");
+        }
+        const auto& super = interpreter.getSuperStats();
+        if(super.sites > 0) {
+            printf("  Superinstructions: %d sites fused, %ld dispatches removed "
+                   "(%.1f%% of the %ld profiled)\n",
+                   super.sites, super.removed, super.coverage, super.profiled);
+            for(const auto* sequences : {&super.pairs, &super.triples}) {
+                for(const auto& seq : *sequences) {
+                    printf("    %-40s %6.2f%%%s\n", seq.ops.c_str(),
+                           100.0 * seq.count / super.profiled, seq.fused ? "  fused" : "");
+                }
+            }
+        }
+        for(const auto& memo : interpreter.getMemoStats()) {
+            printf("  Memo %s: %ld hits, %ld misses (%.1f%% hit rate), %ld evictions\n",
+                   memo.function.c_str(), memo.hits, memo.misses, memo.hitRate(),
+                   memo.evictions);
+        }
     }
 
+    if(perfCounters) reportCounters(counters);
+
     // ========== SUMMARY ==========
     printf("\n");
     printf("╔════════════════════════════════════════════════════════════╗\n");
@@ -1,33 +1,1658 @@
 /**
  * @file optimizer.h
- * @brief Code Optimizer - Performs dead code elimination and constant folding
+ * @brief Code Optimizer - Performs tail-call elimination, inlining,
+ *        constant folding/propagation, dead code elimination, loop
+ *        vectorization, automatic parallelization and bounds-check
+ *        elimination
  */
 
 #pragma once
 
 #include "ir.h"
+#include "simd.h"
+#include "allocs.h"
+#include <climits>
 #include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
+#include <functional>
+#include <chrono>
+
+// Inlining cost model. A call site is inlined when the callee size (in
+// non-label instructions) fits its threshold:
+//   threshold = baseThreshold * (1 + loopDepthBonus * loopDepth), doubled
+//   for callees whose profile count reaches hotCallCount.
+// Total program size may grow by at most `growthBudget` (a fraction of
+// the size before inlining, but never less than `minGrowth`). Sites are
+// visited hottest first.
+struct InlineConfig {
+    bool enabled = true;
+    int baseThreshold = 12;
+    int loopDepthBonus = 1;
+    long hotCallCount = 1000;
+    double growthBudget = 0.5;
+    int minGrowth = 32;
+    std::unordered_map<std::string, long> profile;  // function -> dynamic calls
+};
+
+struct OptimizerStats {
+    int tailCalls = 0;         // self-recursive tail calls turned into jumps
+    int inlinedCalls = 0;
+    int inlineGrowth = 0;      // instructions added by inlining
+    int removedFunctions = 0;  // functions with no remaining callers
+    int boundsChecksRemoved = 0;
+    std::vector<std::string> keptBoundsChecks;  // "function:index: instruction"
+    int vectorizedLoops = 0;
+    std::vector<std::string> vectorReport;      // "function:index: label: reason"
+    int parallelizedLoops = 0;
+    std::vector<std::string> parallelReport;    // "function:index: label: reason"
+    std::vector<std::pair<std::string, double>> passMillis;  // wall time of each pass run, in order
+};
 
 class Optimizer {
+private:
+    InlineConfig inlineConfig;
+    OptimizerStats stats;
+    int inlineCounter = 0;
+    int parallelCounter = 0;
+    bool vectorize = true;
+    bool autoParallel = false;
+
 public:
+    Optimizer(const InlineConfig& config = InlineConfig()) : inlineConfig(config) {}
+
     IRProgram optimize(const IRProgram& input) {
         IRProgram result = input;
+        stats = OptimizerStats();
+        auto timed = [&](const char* pass, const std::function<void()>& run) {
+            AllocPhase phase(pass);
+            auto start = std::chrono::steady_clock::now();
+            run();
+            std::chrono::duration<double, std::milli> spent = std::chrono::steady_clock::now() - start;
+            stats.passMillis.push_back({pass, spent.count()});
+        };
+        
+        // Pass 1: Tail-call elimination (may make functions non-recursive
+        // and therefore inlinable)
+        timed("tail calls", [&] { result = eliminateTailCalls(result); });
+        
+        // Pass 2: Inlining
+        if(inlineConfig.enabled) {
+            timed("inlining", [&] { result = inlineCalls(result); });
+        }
         
-        // Pass 1: Constant folding
-        result = foldConstants(result);
+        // Pass 3: Constant folding and propagation, repeated while they
+        // keep exposing new constants (specializes inlined bodies)
+        timed("constants", [&] {
+            result = foldConstants(result);
+            for(int round = 0; round < 4 && propagateConstants(result); round++) {
+                result = foldConstants(result);
+            }
+        });
         
-        // Pass 2: Dead code elimination
-        result = eliminateDeadCode(result);
+        // Pass 4: Dead code elimination
+        timed("dead code", [&] { result = eliminateDeadCode(result); });
+        
+        // Pass 5: Loop vectorization (needs the frame layout to tell
+        // local arrays from global ones)
+        timed("vectorization", [&] {
+            result.layoutFrames();
+            if(vectorize) {
+                vectorizeLoops(result);
+                result.layoutFrames();
+            }
+        });
+
+        // Pass 6: Automatic parallelization of loops with independent
+        // iterations (opt-in; vectorized loops are already fast serially)
+        if(autoParallel) {
+            timed("parallelization", [&] {
+                parallelizeLoops(result);
+                result.layoutFrames();
+            });
+        }
+
+        // Pass 7: Bounds-check elimination (also inside parallel regions)
+        timed("bounds checks", [&] { eliminateBoundsChecks(result); });
         
         return result;
     }
 
+    const OptimizerStats& getStats() const { return stats; }
+
+    void setVectorize(bool enabled) { vectorize = enabled; }
+    void setAutoParallel(bool enabled) { autoParallel = enabled; }
+
+private:
+    // ---------- Tail-call elimination ----------
+
+    // Rewrites `t = f(args)` inside f whose value flows straight into
+    // `return t` into parameter reassignment plus a jump to f's entry,
+    // so self recursion in tail position runs in constant stack space
+    IRProgram eliminateTailCalls(const IRProgram& input) {
+        IRProgram result = input;
+        for(auto& func : result.functions) {
+            eliminateTailCalls(func);
+        }
+        return result;
+    }
+
+    void eliminateTailCalls(IRFunction& func) {
+        // Local arrays would need every element reset on re-entry
+        if(!func.arraySizes.empty()) return;
+
+        auto& body = func.instructions;
+        std::unordered_map<std::string, size_t> labels;
+        for(size_t i = 0; i < body.size(); i++) {
+            if(body[i].type == InstrType::LABEL) labels[body[i].label] = i;
+        }
+
+        std::vector<size_t> sites;
+        for(size_t i = 0; i < body.size(); i++) {
+            if(body[i].type == InstrType::CALL && body[i].funcName == func.name &&
+               body[i].args.size() == func.params.size() && isTailPosition(body, labels, i)) {
+                sites.push_back(i);
+            }
+        }
+        if(sites.empty()) return;
+
+        std::string entryLabel = "Lentry_" + func.name;
+
+        // Declared locals must start from 0 again, as in a fresh frame
+        std::vector<std::string> locals;
+        for(const auto& [var, type] : func.variableTypes) {
+            if(std::find(func.params.begin(), func.params.end(), var) == func.params.end()) {
+                locals.push_back(var);
+            }
+        }
+        std::sort(locals.begin(), locals.end());
+
+        for(auto it = sites.rbegin(); it != sites.rend(); ++it) {
+            const Instruction call = body[*it];
+            std::vector<Instruction> jump;
+
+            // Parameters are reassigned in order, so an argument reading
+            // an earlier parameter is saved first so it is not clobbered
+            std::vector<Operand> sources = call.args;
+            for(size_t p = 0; p < sources.size(); p++) {
+                const Operand& arg = sources[p];
+                auto pos = std::find(func.params.begin(), func.params.end(), arg.name);
+                if(arg.isConst() || pos == func.params.end() ||
+                   static_cast<size_t>(pos - func.params.begin()) >= p) continue;
+                Operand saved(func.params[p] + "_tc", Operand::Type::TEMP);
+                jump.push_back(Instruction::createAssign(saved, arg));
+                sources[p] = saved;
+            }
+            for(size_t p = 0; p < sources.size(); p++) {
+                if(!sources[p].isConst() && sources[p].name == func.params[p]) continue;
+                jump.push_back(Instruction::createAssign(
+                    Operand(func.params[p], Operand::Type::VAR), sources[p]));
+            }
+            for(const auto& local : locals) {
+                jump.push_back(Instruction::createAssign(
+                    Operand(local, Operand::Type::VAR), Operand(0)));
+            }
+            jump.push_back(Instruction::createGoto(entryLabel));
+            for(auto& instr : jump) instr.at(call);
+
+            body.erase(body.begin() + *it);
+            body.insert(body.begin() + *it, jump.begin(), jump.end());
+            stats.tailCalls++;
+        }
+
+        body.insert(body.begin(), Instruction::createLabel(entryLabel));
+    }
+
+    // True if the call's result reaches a `return` of that same value
+    // with nothing in between but labels and unconditional jumps
+    static bool isTailPosition(const std::vector<Instruction>& body,
+                               const std::unordered_map<std::string, size_t>& labels,
+                               size_t callIndex) {
+        const std::string& resultName = body[callIndex].result.name;
+        size_t i = callIndex + 1;
+        for(size_t steps = 0; steps < body.size() && i < body.size(); steps++) {
+            const auto& instr = body[i];
+            if(instr.type == InstrType::LABEL || instr.type == InstrType::NOP) {
+                i++;
+            } else if(instr.type == InstrType::GOTO) {
+                auto it = labels.find(instr.label);
+                if(it == labels.end()) return false;
+                i = it->second;
+            } else {
+                return instr.type == InstrType::RETURN && !instr.op1.isConst() &&
+                       instr.op1.name == resultName;
+            }
+        }
+        return false;
+    }
+
+    // ---------- Bounds-check elimination ----------
+
+    static bool writes(const Instruction& instr, const std::string& name) {
+        switch(instr.type) {
+            case InstrType::ASSIGN:
+            case InstrType::BIN_OP:
+            case InstrType::UN_OP:
+            case InstrType::LOAD_IDX:
+            case InstrType::CALL:
+            case InstrType::INPUT:
+            case InstrType::VEC_REDUCE:
+            case InstrType::PAR_BEGIN:
+            case InstrType::PAR_REDUCE:
+                return instr.result.name == name;
+            default:
+                return false;
+        }
+    }
+
+    static bool isJump(const Instruction& instr) {
+        return instr.type == InstrType::GOTO || instr.type == InstrType::IF_GOTO;
+    }
+
+    // Definitions of one name: how many, where the first one is, and the
+    // constant they assign while every one of them is `name = c`
+    struct Defs {
+        int count = 0;
+        long first = -1;
+        bool constant = true;
+        int value = 0;
+
+        void add(const Instruction& instr, long position) {
+            count++;
+            if(first < 0) first = position;
+            constant = constant && instr.type == InstrType::ASSIGN && instr.op1.isConst();
+            if(constant) value = instr.op1.value;
+        }
+    };
+    using DefTable = std::unordered_map<std::string, Defs>;
+
+    // Labels, the jumps to each of them, the definitions of each name and
+    // the operands naming it in one body, collected in a single scan so
+    // that the loop passes do not rescan the body for every label they
+    // look at
+    struct BodyIndex {
+        std::unordered_map<std::string, long> labels;
+        std::unordered_map<std::string, std::vector<long>> jumps;  // ascending positions
+        DefTable defs;
+        std::unordered_map<std::string, int> mentions;  // as forEachOperand sees them
+
+        explicit BodyIndex(const std::vector<Instruction>& body) {
+            for(size_t i = 0; i < body.size(); i++) {
+                const Instruction& instr = body[i];
+                long at = static_cast<long>(i);
+                if(instr.type == InstrType::LABEL) labels[instr.label] = at;
+                if(isJump(instr)) jumps[instr.label].push_back(at);
+                if(writes(instr, instr.result.name)) defs[instr.result.name].add(instr, at);
+                forEachOperand(instr, [&](const Operand& op) {
+                    if(!op.isConst()) mentions[op.name]++;
+                });
+            }
+        }
+
+        int mentionCount(const std::string& name) const {
+            auto it = mentions.find(name);
+            return (it != mentions.end()) ? it->second : 0;
+        }
+
+        long position(const std::string& label) const {
+            auto it = labels.find(label);
+            return (it != labels.end()) ? it->second : -1;
+        }
+
+        const std::vector<long>& jumpsTo(const std::string& label) const {
+            static const std::vector<long> none;
+            auto it = jumps.find(label);
+            return (it != jumps.end()) ? it->second : none;
+        }
+
+        int defCount(const std::string& name) const {
+            auto it = defs.find(name);
+            return (it != defs.end()) ? it->second.count : 0;
+        }
+
+        // Position of the first definition, -1 if there is none
+        long firstDef(const std::string& name) const {
+            auto it = defs.find(name);
+            return (it != defs.end()) ? it->second.first : -1;
+        }
+    };
+
+    // Definitions of globals: in top-level code and in every function
+    // that does not shadow them
+    static DefTable globalDefs(const IRProgram& program) {
+        DefTable defs;
+        auto scan = [&](const std::vector<Instruction>& body, const IRFunction* func) {
+            for(size_t i = 0; i < body.size(); i++) {
+                const Instruction& instr = body[i];
+                if(!writes(instr, instr.result.name)) continue;
+                if(func && func->slots.count(instr.result.name)) continue;
+                defs[instr.result.name].add(instr, static_cast<long>(i));
+            }
+        };
+        scan(program.instructions, nullptr);
+        for(const auto& func : program.functions) scan(func.instructions, &func);
+        return defs;
+    }
+
+    // True if `name` has exactly one definition in its scope and it
+    // assigns a constant (a read before it sees 0, so both are possible).
+    // `index` is of func's body, `globals` from globalDefs().
+    static bool effectivelyConstant(const IRFunction* func, const BodyIndex& index,
+                                    const DefTable& globals, const std::string& name, int& value) {
+        const DefTable* defs = &globals;
+        if(func && func->slots.count(name)) {
+            if(std::find(func->params.begin(), func->params.end(), name) != func->params.end()) {
+                return false;
+            }
+            defs = &index.defs;
+        }
+        auto it = defs->find(name);
+        if(it == defs->end() || it->second.count != 1 || !it->second.constant) return false;
+        value = it->second.value;
+        return true;
+    }
+
+    // Clears boundsCheck on LOAD_IDX/STORE_IDX whose index is provably in
+    // range. Recognized shape (what `for` and counted `while` loops lower to):
+    //       i = c0                 c0 >= 0
+    //   L:  t = i < K              or i <= K; K constant or effectively constant
+    //       ifz t goto Lexit       Lexit outside the loop
+    //       ...                    i written only as i = i + c, c >= 0
+    //       goto L
+    // An access a[i + c] (directly or via a single-def temp) that comes
+    // before the first write of i has i in [c0, K - 1] and is safe when
+    // c0 + c >= 0 and K - 1 + c < size(a).
+    void eliminateBoundsChecks(IRProgram& program) {
+        DefTable globals = globalDefs(program);
+        eliminateConstantIndexChecks(program, nullptr, program.instructions);
+        eliminateBoundsChecks(program, nullptr, program.instructions, globals);
+        for(auto& func : program.functions) {
+            eliminateConstantIndexChecks(program, &func, func.instructions);
+            eliminateBoundsChecks(program, &func, func.instructions, globals);
+        }
+
+        auto report = [&](const std::string& owner, const std::vector<Instruction>& body) {
+            for(size_t i = 0; i < body.size(); i++) {
+                if((body[i].type == InstrType::LOAD_IDX || body[i].type == InstrType::STORE_IDX) &&
+                   body[i].boundsCheck) {
+                    stats.keptBoundsChecks.push_back(owner + ":" + std::to_string(i) + ": " +
+                                                     body[i].toString());
+                }
+            }
+        };
+        report("main", program.instructions);
+        for(const auto& func : program.functions) report(func.name, func.instructions);
+    }
+
+    void eliminateConstantIndexChecks(const IRProgram& program, const IRFunction* func,
+                                      std::vector<Instruction>& body) {
+        for(auto& access : body) {
+            if(access.type != InstrType::LOAD_IDX && access.type != InstrType::STORE_IDX) continue;
+            const Operand& index = (access.type == InstrType::LOAD_IDX) ? access.op2 : access.op1;
+            const std::string& array = (access.type == InstrType::LOAD_IDX)
+                                       ? access.op1.name : access.result.name;
+            int size = (func && func->slots.count(array)) ? slotWidth(func->arraySizes, array)
+                                                          : slotWidth(program.arraySizes, array);
+            if(index.isConst() && index.value >= 0 && index.value < size) {
+                access.boundsCheck = false;
+                stats.boundsChecksRemoved++;
+            }
+        }
+    }
+
+    void eliminateBoundsChecks(const IRProgram& program, const IRFunction* func,
+                               std::vector<Instruction>& body, const DefTable& globals) {
+        const BodyIndex index(body);  // only boundsCheck flags change below
+        auto arraySize = [&](const std::string& name) {
+            if(func && func->slots.count(name)) return slotWidth(func->arraySizes, name);
+            return slotWidth(program.arraySizes, name);
+        };
+        auto isLocal = [&](const std::string& name) {
+            return func && func->slots.count(name);
+        };
+
+        // parallel for i in [c0, K): the body never writes i
+        for(size_t h = 1; h < body.size(); h++) {
+            const Instruction& par = body[h];
+            const Instruction& init = body[h - 1];
+            if(par.type != InstrType::PAR_BEGIN || init.type != InstrType::ASSIGN ||
+               init.result.name != par.result.name || !init.op1.isConst() || init.op1.value < 0) continue;
+            int limit = 0;
+            if(par.op2.isConst()) limit = par.op2.value;
+            else if(!effectivelyConstant(func, index, globals, par.op2.name, limit)) continue;
+
+            for(size_t p = h + 1; p < body.size() && body[p].type != InstrType::PAR_END; p++) {
+                Instruction& access = body[p];
+                if((access.type != InstrType::LOAD_IDX && access.type != InstrType::STORE_IDX) ||
+                   !access.boundsCheck) continue;
+                const Operand& at = (access.type == InstrType::LOAD_IDX) ? access.op2 : access.op1;
+                long offset;
+                if(!indexOffset(body, index, at, par.result.name, h + 1, p, offset)) continue;
+                const std::string& array = (access.type == InstrType::LOAD_IDX)
+                                           ? access.op1.name : access.result.name;
+                if(init.op1.value + offset >= 0 && limit - 1 + offset < arraySize(array)) {
+                    access.boundsCheck = false;
+                    stats.boundsChecksRemoved++;
+                }
+            }
+        }
+
+        for(size_t h = 0; h < body.size(); h++) {
+            if(body[h].type != InstrType::LABEL || h == 0 || h + 2 >= body.size()) continue;
+
+            // Loop extent: the last back edge to L; L must not be entered
+            // by a jump from outside the loop
+            const auto& backEdges = index.jumpsTo(body[h].label);
+            if(backEdges.empty() || backEdges.front() < static_cast<long>(h)) continue;
+            long j = backEdges.back();
+
+            // Header: t = i < K; ifz t goto Lexit
+            const Instruction& cmp = body[h + 1];
+            const Instruction& branch = body[h + 2];
+            if(cmp.type != InstrType::BIN_OP || (cmp.binOp != BinOp::LT && cmp.binOp != BinOp::LE) ||
+               cmp.op1.isConst() || branch.type != InstrType::IF_GOTO ||
+               branch.op1.isConst() || branch.op1.name != cmp.result.name) continue;
+            long exitPos = index.position(branch.label);
+            if(exitPos < 0 || (exitPos > static_cast<long>(h) && exitPos <= j)) continue;
+
+            const std::string iv = cmp.op1.name;
+            long limit;  // exclusive upper bound of iv inside the body
+            if(cmp.op2.isConst()) {
+                limit = cmp.op2.value;
+            } else {
+                int value = 0;
+                if(!effectivelyConstant(func, index, globals, cmp.op2.name, value)) continue;
+                limit = std::max(value, 0);
+            }
+            if(cmp.binOp == BinOp::LE) limit++;
+
+            // Entry value
+            const Instruction& init = body[h - 1];
+            if(init.type != InstrType::ASSIGN || init.result.name != iv ||
+               !init.op1.isConst() || init.op1.value < 0) continue;
+            long start = init.op1.value;
+
+            // No jumps from outside the loop into its body
+            bool enteredBody = false;
+            for(long y = h + 1; y <= j && !enteredBody; y++) {
+                if(body[y].type != InstrType::LABEL) continue;
+                const auto& from = index.jumpsTo(body[y].label);
+                enteredBody = !from.empty() && (from.front() <= static_cast<long>(h) || from.back() > j);
+            }
+            if(enteredBody) continue;
+
+            // iv grows by one constant step per iteration that cannot wrap
+            // past INT_MAX: a single write, which no jump inside the loop
+            // reaches twice without passing the header. Calls must not be
+            // able to change iv.
+            bool monotonic = true;
+            long firstWrite = j + 1;
+            long step = 0;
+            for(long x = h + 1; x <= j && monotonic; x++) {
+                const Instruction& instr = body[x];
+                if(instr.type == InstrType::CALL && !isLocal(iv)) {
+                    const IRFunction* callee = program.findFunction(instr.funcName);
+                    monotonic = callee && callee->pure;
+                }
+                if(!writes(instr, iv)) continue;
+                monotonic = firstWrite > j && isIncrement(body, index, instr, iv, step);
+                firstWrite = std::min(firstWrite, x);
+            }
+            if(!monotonic || firstWrite <= static_cast<long>(h) + 2 || limit - 1 + step > INT_MAX) continue;
+            // This also keeps a jump back into the checked region from
+            // reaching an access with iv already incremented
+            for(long x = firstWrite; x <= j && monotonic; x++) {
+                if(!isJump(body[x])) continue;
+                long y = index.position(body[x].label);
+                monotonic = y == static_cast<long>(h) || y > firstWrite;
+            }
+            if(!monotonic) continue;
+
+            for(long p = h + 3; p < firstWrite; p++) {
+                Instruction& access = body[p];
+                if((access.type != InstrType::LOAD_IDX && access.type != InstrType::STORE_IDX) ||
+                   !access.boundsCheck) continue;
+
+                const Operand& at = (access.type == InstrType::LOAD_IDX) ? access.op2 : access.op1;
+                long offset;
+                if(!indexOffset(body, index, at, iv, h + 3, p, offset)) continue;
+
+                const std::string& array = (access.type == InstrType::LOAD_IDX)
+                                           ? access.op1.name : access.result.name;
+                if(start + offset >= 0 && limit - 1 + offset < arraySize(array)) {
+                    access.boundsCheck = false;
+                    stats.boundsChecksRemoved++;
+                }
+            }
+        }
+    }
+
+    // `iv = iv + c` or `iv = t` with single-def `t = iv + c`, c >= 0,
+    // which is stored in `step`
+    static bool isIncrement(const std::vector<Instruction>& body, const BodyIndex& index,
+                            const Instruction& instr, const std::string& iv, long& step) {
+        auto addsNonNegative = [&](const Instruction& def) {
+            if(def.type != InstrType::BIN_OP || def.binOp != BinOp::ADD) return false;
+            if(def.op1.name == iv && !def.op1.isConst() && def.op2.isConst() && def.op2.value >= 0) {
+                step = def.op2.value;
+                return true;
+            }
+            if(def.op2.name == iv && !def.op2.isConst() && def.op1.isConst() && def.op1.value >= 0) {
+                step = def.op1.value;
+                return true;
+            }
+            return false;
+        };
+        if(addsNonNegative(instr)) return true;
+        if(instr.type != InstrType::ASSIGN || !instr.op1.isTemp() || index.defCount(instr.op1.name) != 1) {
+            return false;
+        }
+        return addsNonNegative(body[index.firstDef(instr.op1.name)]);
+    }
+
+    // Index `at` as iv + offset: iv itself, or a single-def temp iv +/- c
+    // defined inside [from, to)
+    static bool indexOffset(const std::vector<Instruction>& body, const BodyIndex& index,
+                            const Operand& at, const std::string& iv, long from, long to,
+                            long& offset) {
+        if(at.isConst()) return false;
+        if(at.name == iv) {
+            offset = 0;
+            return true;
+        }
+        if(!at.isTemp() || index.defCount(at.name) != 1) return false;
+        long d = index.firstDef(at.name);
+        if(d < from || d >= to) return false;
+        const Instruction& def = body[d];
+        if(def.type == InstrType::ASSIGN && !def.op1.isConst() && def.op1.name == iv) {
+            offset = 0;
+            return true;
+        }
+        if(def.type != InstrType::BIN_OP || def.op1.isConst() || def.op1.name != iv ||
+           !def.op2.isConst()) return false;
+        if(def.binOp == BinOp::ADD) offset = def.op2.value;
+        else if(def.binOp == BinOp::SUB) offset = -static_cast<long>(def.op2.value);
+        else return false;
+        return true;
+    }
+
+    // Counted loop as the vectorizer and the parallelizer see it:
+    //   L:  t = i < K              or i <= K
+    //       ifz t goto Lexit
+    //       ...                    statement body [from, to)
+    //       i = i + 1              or tn = i + 1; i = tn
+    //       goto L                 the only jump to L
+    struct CountedLoop {
+        long backEdge = 0;
+        long from = 0, to = 0;
+        std::string iv;
+    };
+
+    static bool matchCountedLoop(const std::vector<Instruction>& body, const BodyIndex& index,
+                                 size_t h, CountedLoop& loop) {
+        if(body[h].type != InstrType::LABEL || h + 2 >= body.size()) return false;
+
+        const auto& jumps = index.jumpsTo(body[h].label);
+        if(jumps.size() != 1 || jumps[0] <= static_cast<long>(h) || body[jumps[0]].type != InstrType::GOTO) {
+            return false;
+        }
+        long j = jumps[0];
+
+        const Instruction& cmp = body[h + 1];
+        const Instruction& branch = body[h + 2];
+        if(cmp.type != InstrType::BIN_OP || (cmp.binOp != BinOp::LT && cmp.binOp != BinOp::LE) ||
+           cmp.op1.isConst() || branch.type != InstrType::IF_GOTO ||
+           branch.op1.isConst() || branch.op1.name != cmp.result.name) return false;
+        const std::string& iv = cmp.op1.name;
+
+        long inc = j - 1;
+        auto addsOne = [&](const Instruction& def) {
+            return def.type == InstrType::BIN_OP && def.binOp == BinOp::ADD &&
+                   !def.op1.isConst() && def.op1.name == iv &&
+                   def.op2.isConst() && def.op2.value == 1;
+        };
+        if(inc <= static_cast<long>(h) + 2 || !writes(body[inc], iv)) return false;
+        if(!addsOne(body[inc])) {
+            if(body[inc].type != InstrType::ASSIGN || !body[inc].op1.isTemp() ||
+               inc - 1 <= static_cast<long>(h) + 2 || !addsOne(body[inc - 1]) ||
+               body[inc - 1].result.name != body[inc].op1.name) return false;
+            inc--;
+        }
+
+        loop.backEdge = j;
+        loop.from = static_cast<long>(h) + 3;
+        loop.to = inc;
+        loop.iv = iv;
+        return true;
+    }
+
+    // ---------- Loop vectorization ----------
+
+    // Element expression of a vectorizable loop body
+    struct VecTerm {
+        enum Kind { INDEX, LOAD, SCALAR, BINARY } kind = SCALAR;
+        Operand operand;        // LOAD: array, SCALAR: the value
+        long offset = 0;        // INDEX/LOAD: k + offset
+        BinOp op = BinOp::ADD;  // BINARY
+        Operand left, right;    // BINARY: LOAD or SCALAR leaves
+        long leftOffset = 0, rightOffset = 0;
+        bool leftArray = false, rightArray = false;
+    };
+
+    // Turns counted loops whose body is one element-wise statement into a
+    // single vector kernel. Recognized shape:
+    //   L:  t = i < K              or i <= K with constant K
+    //       ifz t goto Lexit
+    //       c[i] = x op y          or s = s + (x op y)
+    //       i = i + 1
+    //       goto L
+    // where x, y are a[i + d] or loop-invariant scalars and op is +, - or
+    // *. The body becomes `vec for k in [i, K): ...; i = K`; the header
+    // still runs first, so an empty range skips the kernel and leaves i
+    // as it was. A read c[i + d] of the stored array with d < 0 is a
+    // loop-carried dependence of distance -d and blocks the rewrite;
+    // d >= 0 is safe since every vector chunk is loaded before it is stored.
+    void vectorizeLoops(IRProgram& program) {
+        vectorizeLoops(program, nullptr, program.instructions, "main");
+        for(auto& func : program.functions) {
+            vectorizeLoops(program, &func, func.instructions, func.name);
+        }
+    }
+
+    void vectorizeLoops(const IRProgram& program, const IRFunction* func,
+                        std::vector<Instruction>& body, const std::string& owner) {
+        auto isArray = [&](const Operand& op) {
+            if(op.isConst()) return false;
+            if(func && func->slots.count(op.name)) return func->arraySizes.count(op.name) > 0;
+            return program.arraySizes.count(op.name) > 0;
+        };
+
+        // Loops are matched against the body as it was; the rewrites are
+        // spliced in afterwards, and `shift` keeps reported positions those
+        // of the rewritten body
+        const BodyIndex index(body);
+        std::vector<std::pair<long, long>> replaced;  // [from, backEdge) of each rewrite
+        std::vector<Instruction> replacements;        // two per rewrite
+        long shift = 0;
+
+        for(size_t h = 0; h + 2 < body.size(); h++) {
+            CountedLoop loop;
+            if(!matchCountedLoop(body, index, h, loop)) continue;
+            const Instruction& cmp = body[h + 1];
+            const std::string& iv = loop.iv;
+            if(isArray(cmp.op1) || isArray(cmp.op2)) continue;
+
+            // Upper bound (exclusive) operand
+            Operand hi = cmp.op2;
+            if(cmp.binOp == BinOp::LE) {
+                if(!cmp.op2.isConst() || cmp.op2.value == INT_MAX) continue;  // i <= INT_MAX never ends
+                hi = Operand(cmp.op2.value + 1);
+            }
+
+            long j = loop.backEdge, from = loop.from, to = loop.to;
+            bool touchesArrays = false;
+            for(long x = from; x < to; x++) {
+                touchesArrays = touchesArrays || body[x].type == InstrType::LOAD_IDX ||
+                                body[x].type == InstrType::STORE_IDX;
+            }
+            if(!touchesArrays) continue;
+
+            std::string reason;
+            Instruction kernel;
+            if(matchVectorBody(body, from, to, iv, cmp.op2, isArray, reason, kernel)) {
+                // Temps computed by the scalar body must be dead after it
+                std::unordered_map<std::string, int> bodyTemps;  // mentions inside
+                for(long x = from; x < j; x++) {
+                    if(body[x].result.isTemp()) bodyTemps.emplace(body[x].result.name, 0);
+                }
+                for(long x = from; x < j; x++) {
+                    forEachOperand(body[x], [&](const Operand& op) {
+                        auto it = bodyTemps.find(op.name);
+                        if(it != bodyTemps.end()) it->second++;
+                    });
+                }
+                bool usedOutside = std::any_of(bodyTemps.begin(), bodyTemps.end(), [&](const auto& temp) {
+                    return index.mentionCount(temp.first) > temp.second;
+                });
+                // Rare: find the first outside use for the report
+                for(size_t x = 0; usedOutside && x < body.size() && reason.empty(); x++) {
+                    if(static_cast<long>(x) >= from && static_cast<long>(x) < j) continue;
+                    forEachOperand(body[x], [&](const Operand& op) {
+                        if(bodyTemps.count(op.name)) reason = "temporary " + op.name + " used outside the loop";
+                    });
+                }
+            }
+            if(!reason.empty()) {
+                stats.vectorReport.push_back(owner + ":" + std::to_string(h + shift) + ": " +
+                                             body[h].label + ": " + reason);
+                continue;
+            }
+
+            kernel.args[0] = Operand(iv, cmp.op1.type);
+            kernel.args[1] = hi;
+            replacements.push_back(kernel.at(body[from]));
+            replacements.push_back(Instruction::createAssign(Operand(iv, cmp.op1.type), hi).at(cmp));
+            replaced.push_back({from, j});
+            shift += 2 - (j - from);
+            stats.vectorizedLoops++;
+            h = j;  // the rewritten body holds no loop headers
+        }
+
+        if(replaced.empty()) return;
+        std::vector<Instruction> out;
+        out.reserve(body.size() + shift);
+        size_t next = 0;
+        for(long x = 0; x < static_cast<long>(body.size()); x++) {
+            if(next < replaced.size() && x == replaced[next].first) {
+                out.push_back(std::move(replacements[2 * next]));
+                out.push_back(std::move(replacements[2 * next + 1]));
+                x = replaced[next].second - 1;
+                next++;
+                continue;
+            }
+            out.push_back(std::move(body[x]));
+        }
+        body = std::move(out);
+    }
+
+    // Matches the statement body [from, to) and builds its kernel, or
+    // explains in `reason` why it cannot be vectorized
+    template<typename IsArray>
+    static bool matchVectorBody(const std::vector<Instruction>& body, long from, long to,
+                                const std::string& iv, const Operand& bound,
+                                IsArray isArray, std::string& reason, Instruction& kernel) {
+        std::unordered_map<std::string, VecTerm> terms;  // body temp -> its value
+        std::unordered_set<std::string> written = {iv};
+        for(long x = from; x < to; x++) {
+            if(body[x].type != InstrType::STORE_IDX && !body[x].result.name.empty()) {
+                written.insert(body[x].result.name);
+            }
+        }
+
+        // Operand as a term: a body temp, the induction variable or an
+        // invariant scalar
+        auto term = [&](const Operand& op, VecTerm& out) {
+            if(!op.isConst()) {
+                auto it = terms.find(op.name);
+                if(it != terms.end()) {
+                    out = it->second;
+                    return true;
+                }
+                if(op.name == iv) {
+                    out = VecTerm();
+                    out.kind = VecTerm::INDEX;
+                    return true;
+                }
+                if(written.count(op.name) || isArray(op)) return false;
+            }
+            out = VecTerm();
+            out.operand = op;
+            return true;
+        };
+        auto leaf = [](const VecTerm& t) {
+            return t.kind == VecTerm::LOAD || t.kind == VecTerm::SCALAR;
+        };
+        auto element = [&](const VecTerm& t, VecTerm& out) {
+            if(t.kind == VecTerm::BINARY) {
+                out = t;
+                return true;
+            }
+            if(!leaf(t)) return false;
+            out = VecTerm();
+            out.kind = VecTerm::BINARY;
+            out.left = t.operand;
+            out.leftOffset = t.offset;
+            out.leftArray = t.kind == VecTerm::LOAD;
+            out.right = Operand(0);
+            return true;
+        };
+        auto build = [&](InstrType kind, const Operand& result, const VecTerm& e) {
+            kernel = Instruction::createVector(
+                kind, result, e.op,
+                e.left, e.leftArray ? Operand(static_cast<int>(e.leftOffset)) : Operand(),
+                e.right, e.rightArray ? Operand(static_cast<int>(e.rightOffset)) : Operand(),
+                Operand(), Operand());
+        };
+        auto unsupported = [&](const Instruction& instr) {
+            reason = "unsupported statement: " + instr.toString();
+            return false;
+        };
+
+        for(long x = from; x < to; x++) {
+            const Instruction& instr = body[x];
+            bool last = (x + 1 == to);
+            VecTerm a, b, t;
+            switch(instr.type) {
+                case InstrType::LOAD_IDX:
+                    if(!instr.result.isTemp() || !isArray(instr.op1) || !term(instr.op2, a) ||
+                       a.kind != VecTerm::INDEX) return unsupported(instr);
+                    t.kind = VecTerm::LOAD;
+                    t.operand = instr.op1;
+                    t.offset = a.offset;
+                    terms[instr.result.name] = t;
+                    break;
+
+                case InstrType::BIN_OP: {
+                    if(!instr.result.isTemp() || !term(instr.op1, a) || !term(instr.op2, b)) {
+                        // s = s + v closes a reduction
+                        if(x + 2 == to && body[to - 1].type == InstrType::ASSIGN &&
+                           body[to - 1].op1.name == instr.result.name) break;
+                        return unsupported(instr);
+                    }
+                    if(a.kind == VecTerm::INDEX && b.kind == VecTerm::SCALAR && b.operand.isConst() &&
+                       (instr.binOp == BinOp::ADD || instr.binOp == BinOp::SUB)) {
+                        t.kind = VecTerm::INDEX;
+                        t.offset = a.offset + (instr.binOp == BinOp::ADD ? b.operand.value
+                                                                         : -static_cast<long>(b.operand.value));
+                    } else if(leaf(a) && leaf(b) && (instr.binOp == BinOp::ADD ||
+                              instr.binOp == BinOp::SUB || instr.binOp == BinOp::MUL)) {
+                        t.kind = VecTerm::BINARY;
+                        t.op = instr.binOp;
+                        t.left = a.operand;
+                        t.leftOffset = a.offset;
+                        t.leftArray = a.kind == VecTerm::LOAD;
+                        t.right = b.operand;
+                        t.rightOffset = b.offset;
+                        t.rightArray = b.kind == VecTerm::LOAD;
+                    } else {
+                        return unsupported(instr);
+                    }
+                    terms[instr.result.name] = t;
+                    break;
+                }
+
+                case InstrType::STORE_IDX: {
+                    VecTerm value;
+                    if(!last || !isArray(instr.result) || !term(instr.op1, a) ||
+                       a.kind != VecTerm::INDEX || a.offset != 0 || !term(instr.op2, b) ||
+                       !element(b, value)) return unsupported(instr);
+                    const std::string& dst = instr.result.name;
+                    for(const auto& [name, loaded] : terms) {
+                        if(loaded.kind != VecTerm::LOAD || loaded.operand.name != dst ||
+                           loaded.offset >= 0) continue;
+                        reason = "loop-carried dependence distance " +
+                                 std::to_string(-loaded.offset) + " on " + dst;
+                        return false;
+                    }
+                    build(InstrType::VEC_MAP, instr.result, value);
+                    return true;
+                }
+
+                case InstrType::ASSIGN: {
+                    // s = tn where tn = s + v
+                    if(!last || x == from || instr.result.isConst() || isArray(instr.result) ||
+                       instr.result.name == iv || instr.result.name == bound.name) {
+                        return unsupported(instr);
+                    }
+                    const Instruction& add = body[x - 1];
+                    const std::string& acc = instr.result.name;
+                    if(add.type != InstrType::BIN_OP || add.binOp != BinOp::ADD ||
+                       add.result.name != instr.op1.name) return unsupported(instr);
+                    const Operand& other = (add.op1.name == acc && !add.op1.isConst()) ? add.op2
+                                         : (add.op2.name == acc && !add.op2.isConst()) ? add.op1
+                                         : Operand("");
+                    VecTerm value;
+                    bool ok = !other.name.empty() && term(other, a) && element(a, value);
+                    if(!ok || (value.left.name == acc && !value.left.isConst()) ||
+                       (value.right.name == acc && !value.right.isConst())) {
+                        return unsupported(add);
+                    }
+                    build(InstrType::VEC_REDUCE, instr.result, value);
+                    return true;
+                }
+
+                default:
+                    return unsupported(instr);
+            }
+        }
+        reason = "no store or reduction in the loop body";
+        return false;
+    }
+
+    // ---------- Automatic parallelization ----------
+
+    // Trip counts below which a parallelized loop stays on the calling
+    // thread: splitting a range costs a pool wake-up, which pays off after
+    // a few thousand simple iterations or a few dozen calls / inner loops
+    static constexpr int AUTO_PARALLEL_MIN_ITERATIONS = 8192;
+    static constexpr int AUTO_PARALLEL_MIN_HEAVY_ITERATIONS = 64;
+
+    // Turns counted loops (see CountedLoop) with independent iterations
+    // into parallel regions, as if written with `parallel for`:
+    //   parallel for i in [i, K)   (auto, min N iterations)
+    //   reduction(+: s)
+    //   ...                        the statement body
+    //   end parallel
+    // Every scalar the body writes must be an accumulator (see
+    // isAccumulator) or private: written before it is read on every path
+    // through the body and unused outside the loop. Arrays may be stored
+    // only at a[i] and, once stored, loaded only at a[i]. The body may not
+    // print, return, call impure functions or jump out. Only outermost
+    // candidates are rewritten; loops inside a region stay serial.
+    void parallelizeLoops(IRProgram& program) {
+        const auto globals = globalMentions(program);
+        const DefTable defs = globalDefs(program);
+        parallelizeLoops(program, nullptr, program.instructions, "main", globals, defs);
+        for(auto& func : program.functions) {
+            parallelizeLoops(program, &func, func.instructions, func.name, globals, defs);
+        }
+    }
+
+    // Operands naming each global in top-level code and in every function
+    // that does not shadow it
+    static std::unordered_map<std::string, int> globalMentions(const IRProgram& program) {
+        std::unordered_map<std::string, int> mentions;
+        auto scan = [&](const std::vector<Instruction>& body, const IRFunction* func) {
+            for(const auto& instr : body) {
+                forEachOperand(instr, [&](const Operand& op) {
+                    if(!op.isConst() && !(func && func->slots.count(op.name))) mentions[op.name]++;
+                });
+            }
+        };
+        scan(program.instructions, nullptr);
+        for(const auto& func : program.functions) scan(func.instructions, &func);
+        return mentions;
+    }
+
+    // Like vectorizeLoops, loops are matched against the body as it was
+    // and the regions spliced in at the end
+    void parallelizeLoops(const IRProgram& program, const IRFunction* func,
+                          std::vector<Instruction>& body, const std::string& owner,
+                          const std::unordered_map<std::string, int>& globals, const DefTable& defs) {
+        const BodyIndex index(body);
+        std::vector<std::pair<long, long>> replaced;  // [header, backEdge] of each region
+        std::vector<std::vector<Instruction>> regions;
+        long shift = 0;
+
+        for(size_t h = 0; h + 2 < body.size(); h++) {
+            if(body[h].type == InstrType::PAR_BEGIN) {
+                while(h + 1 < body.size() && body[h].type != InstrType::PAR_END) h++;
+                continue;
+            }
+            CountedLoop loop;
+            if(!matchCountedLoop(body, index, h, loop)) continue;
+
+            std::vector<std::pair<Operand, BinOp>> reductions;
+            std::string reason;
+            // An inclusive bound b becomes b + 1, which wraps for
+            // b = INT_MAX, where the loop never ends
+            const Instruction& bound = body[h + 1];
+            int value = 0;
+            if(bound.binOp == BinOp::LE &&
+               !(bound.op2.isConst() ? bound.op2.value < INT_MAX
+                                     : effectivelyConstant(func, index, defs, bound.op2.name, value) &&
+                                       value < INT_MAX)) {
+                reason = "inclusive bound may be INT_MAX";
+            }
+            if(!reason.empty() ||
+               !matchParallelBody(program, func, body, index, globals, h, loop, reductions, reason)) {
+                stats.parallelReport.push_back(owner + ":" + std::to_string(h + shift) + ": " +
+                                               body[h].label + ": " + reason);
+                continue;
+            }
+
+            const Instruction cmp = body[h + 1];
+            std::vector<Instruction> region;
+            Operand hi = cmp.op2;
+            if(cmp.binOp == BinOp::LE && cmp.op2.isConst()) {
+                hi = Operand(cmp.op2.value + 1);
+            } else if(cmp.binOp == BinOp::LE) {
+                hi = Operand("tpar" + std::to_string(parallelCounter++), Operand::Type::TEMP);
+                region.push_back(Instruction::createBinOp(hi, BinOp::ADD, cmp.op2, Operand(1)));
+            }
+
+            // Calls and inner loops make iterations expensive enough to
+            // split small ranges too
+            bool heavy = false;
+            for(long x = loop.from; x < loop.to && !heavy; x++) {
+                heavy = body[x].type == InstrType::CALL || body[x].type == InstrType::VEC_REDUCE;
+                for(long y = loop.from; y < x && isJump(body[x]) && !heavy; y++) {
+                    heavy = body[y].type == InstrType::LABEL && body[y].label == body[x].label;
+                }
+            }
+
+            Instruction begin = Instruction::createParBegin(cmp.op1, hi);
+            begin.args = {Operand(heavy ? AUTO_PARALLEL_MIN_HEAVY_ITERATIONS : AUTO_PARALLEL_MIN_ITERATIONS)};
+            region.push_back(begin);
+            for(const auto& [var, op] : reductions) {
+                region.push_back(Instruction::createParReduce(var, op));
+            }
+            region.insert(region.end(), body.begin() + loop.from, body.begin() + loop.to);
+            region.push_back(Instruction::createParEnd());
+            for(auto& instr : region) {
+                if(instr.line == 0) instr.at(cmp);
+            }
+
+            shift += static_cast<long>(region.size()) - (loop.backEdge + 1 - static_cast<long>(h));
+            replaced.push_back({static_cast<long>(h), loop.backEdge});
+            regions.push_back(std::move(region));
+            h = loop.backEdge;  // continue after the loop
+            stats.parallelizedLoops++;
+        }
+
+        if(replaced.empty()) return;
+        std::vector<Instruction> out;
+        out.reserve(body.size() + shift);
+        size_t next = 0;
+        for(long x = 0; x < static_cast<long>(body.size()); x++) {
+            if(next < replaced.size() && x == replaced[next].first) {
+                out.insert(out.end(), regions[next].begin(), regions[next].end());
+                x = replaced[next].second;
+                next++;
+                continue;
+            }
+            out.push_back(std::move(body[x]));
+        }
+        body = std::move(out);
+    }
+
+    // Checks that the iterations of a counted loop are independent and
+    // collects its accumulators, or explains in `reason` why not
+    static bool matchParallelBody(const IRProgram& program, const IRFunction* func,
+                                  const std::vector<Instruction>& body, const BodyIndex& index,
+                                  const std::unordered_map<std::string, int>& globals, size_t h,
+                                  const CountedLoop& loop,
+                                  std::vector<std::pair<Operand, BinOp>>& reductions,
+                                  std::string& reason) {
+        const long from = loop.from, to = loop.to;
+        const std::string& iv = loop.iv;
+        const Instruction& cmp = body[h + 1];
+        // Control flow stays inside the body: no jump from it to a label
+        // elsewhere and none from elsewhere to one of its labels. The
+        // first such jump in the body decides the reason.
+        std::unordered_map<std::string, long> labels;  // body label -> position
+        for(long x = from; x < to; x++) {
+            if(body[x].type == InstrType::LABEL) labels[body[x].label] = x;
+        }
+        long escape = -1;
+        auto note = [&](long x) {
+            if(escape < 0 || x < escape) escape = x;
+        };
+        for(long x = from; x < to; x++) {
+            if(isJump(body[x]) && !labels.count(body[x].label)) note(x);
+        }
+        for(const auto& entry : labels) {
+            for(long x : index.jumpsTo(entry.first)) {
+                if(x < from || x >= to) note(x);
+            }
+        }
+        if(escape >= 0) {
+            reason = (escape >= from) ? "jumps out of the loop body" : "loop body entered from outside";
+            return false;
+        }
+
+        std::unordered_map<std::string, Operand> written;       // scalars
+        std::unordered_set<std::string> stored;
+        std::vector<std::pair<std::string, bool>> loads;        // array, loaded at a[i]
+        for(long x = from; x < to; x++) {
+            const Instruction& instr = body[x];
+            switch(instr.type) {
+                case InstrType::PRINT:
+                    reason = "prints";
+                    return false;
+                case InstrType::INPUT:
+                    reason = "reads input";
+                    return false;
+                case InstrType::RETURN:
+                    reason = "returns from the function";
+                    return false;
+                case InstrType::PAR_BEGIN:
+                case InstrType::PAR_REDUCE:
+                case InstrType::PAR_END:
+                    reason = "contains a parallel loop";
+                    return false;
+                case InstrType::VEC_MAP:
+                    reason = "contains a vector store";
+                    return false;
+                case InstrType::CALL: {
+                    const IRFunction* callee = program.findFunction(instr.funcName);
+                    if(!callee || !callee->pure) {
+                        reason = "calls impure function " + instr.funcName;
+                        return false;
+                    }
+                    break;
+                }
+                case InstrType::STORE_IDX: {
+                    long offset;
+                    if(!indexOffset(body, index, instr.op1, iv, from, x, offset) || offset != 0) {
+                        reason = "stores " + instr.result.name + "[" + instr.op1.str() + "] not at " + iv;
+                        return false;
+                    }
+                    stored.insert(instr.result.name);
+                    break;
+                }
+                case InstrType::LOAD_IDX: {
+                    long offset = 1;
+                    bool atIv = indexOffset(body, index, instr.op2, iv, from, x, offset) && offset == 0;
+                    loads.push_back({instr.op1.name, atIv});
+                    break;
+                }
+                case InstrType::VEC_REDUCE:
+                    if(!instr.args[2].name.empty()) loads.push_back({instr.op1.name, false});
+                    if(!instr.args[3].name.empty()) loads.push_back({instr.op2.name, false});
+                    break;
+                default:
+                    break;
+            }
+            if(writes(instr, iv)) {
+                reason = "writes " + iv + " in the body";
+                return false;
+            }
+            if(instr.type != InstrType::STORE_IDX && !instr.result.name.empty() &&
+               writes(instr, instr.result.name)) {
+                written.emplace(instr.result.name, instr.result);
+            }
+        }
+        for(const auto& [array, atIv] : loads) {
+            if(stored.count(array) && !atIv) {
+                reason = "cross-iteration dependence on " + array;
+                return false;
+            }
+        }
+        if(!cmp.op2.isConst() && written.count(cmp.op2.name)) {
+            reason = "bound " + cmp.op2.name + " changes in the loop";
+            return false;
+        }
+
+        // Basic blocks of the body for the must-write analysis; a jump
+        // always ends its block
+        std::vector<long> blockStart;
+        for(long x = from; x < to; x++) {
+            if(x == from || body[x].type == InstrType::LABEL || isJump(body[x - 1])) blockStart.push_back(x);
+        }
+        size_t blockCount = blockStart.size();
+        auto blockEnd = [&](size_t b) { return (b + 1 < blockCount) ? blockStart[b + 1] : to; };
+        auto blockOf = [&](long x) {
+            return static_cast<size_t>(std::upper_bound(blockStart.begin(), blockStart.end(), x) -
+                                       blockStart.begin() - 1);
+        };
+        std::vector<std::vector<size_t>> preds(blockCount);
+        for(size_t b = 0; b < blockCount; b++) {
+            const Instruction& last = body[blockEnd(b) - 1];
+            if(b + 1 < blockCount && last.type != InstrType::GOTO) preds[b + 1].push_back(b);
+            if(isJump(last)) preds[blockOf(labels[last.label])].push_back(b);
+        }
+
+        // Every read of name comes after a write on all paths from the
+        // start of the body
+        auto writtenBeforeRead = [&](const std::string& name) {
+            std::vector<char> in(blockCount, 1), out(blockCount, 1);
+            for(bool changed = true; changed;) {
+                changed = false;
+                for(size_t b = 0; b < blockCount; b++) {
+                    char entry = (b > 0);
+                    for(size_t p : preds[b]) entry = entry && out[p];
+                    char exit = entry;
+                    for(long x = blockStart[b]; x < blockEnd(b) && !exit; x++) exit = writes(body[x], name);
+                    changed = changed || in[b] != entry || out[b] != exit;
+                    in[b] = entry;
+                    out[b] = exit;
+                }
+            }
+            for(size_t b = 0; b < blockCount; b++) {
+                bool done = in[b];
+                for(long x = blockStart[b]; x < blockEnd(b); x++) {
+                    if(!done && readCount(body[x], name) > 0) return false;
+                    done = done || writes(body[x], name);
+                }
+            }
+            return true;
+        };
+
+        // Mentions outside the loop: in this body, or for a global in main
+        // and every function that does not shadow it (this body included)
+        std::unordered_map<std::string, int> inside;
+        for(long x = static_cast<long>(h); x <= loop.backEdge; x++) {
+            forEachOperand(body[x], [&](const Operand& op) {
+                if(!op.isConst()) inside[op.name]++;
+            });
+        }
+        auto usedOutside = [&](const std::string& name) {
+            int all = index.mentionCount(name);
+            if(!func || !func->slots.count(name)) {
+                auto it = globals.find(name);
+                all = (it != globals.end()) ? it->second : 0;
+            }
+            return all > inside[name];
+        };
+
+        std::vector<std::string> names;
+        for(const auto& entry : written) names.push_back(entry.first);
+        std::sort(names.begin(), names.end());
+        for(const auto& name : names) {
+            BinOp op;
+            if(isAccumulator(body, index, from, to, written[name], op)) {
+                reductions.push_back({written[name], op});
+            } else if(!writtenBeforeRead(name) || usedOutside(name)) {
+                reason = name + " carries a value between iterations";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Accumulator: a variable written in [from, to) only as `v = t` after
+    // `t = v op e` (op + or *, the same for every update, t used once) and
+    // read nowhere else there. Updates may be conditional.
+    static bool isAccumulator(const std::vector<Instruction>& body, const BodyIndex& index,
+                              long from, long to, const Operand& var, BinOp& op) {
+        if(!var.isVar()) return false;
+        std::unordered_set<long> updates;  // positions of `t = v op e`
+        for(long x = from; x < to; x++) {
+            const Instruction& assign = body[x];
+            if(!writes(assign, var.name)) continue;
+            if(assign.type != InstrType::ASSIGN || !assign.op1.isTemp()) return false;
+
+            if(index.defCount(assign.op1.name) != 1) return false;
+            long def = index.firstDef(assign.op1.name);
+            // Reads of the temp: its operands minus the one its definition writes
+            int uses = index.mentionCount(assign.op1.name) - (body[def].type != InstrType::VEC_REDUCE ? 1 : 0);
+            if(def < from || def >= x || uses != 1) return false;
+            for(long y = def + 1; y < x; y++) {
+                if(writes(body[y], var.name)) return false;
+            }
+
+            const Instruction& update = body[def];
+            if(update.type != InstrType::BIN_OP ||
+               (update.binOp != BinOp::ADD && update.binOp != BinOp::MUL)) return false;
+            bool left = update.op1.isVar() && update.op1.name == var.name;
+            bool right = update.op2.isVar() && update.op2.name == var.name;
+            if(left == right || (!updates.empty() && update.binOp != op)) return false;
+            op = update.binOp;
+            updates.insert(def);
+        }
+        if(updates.empty()) return false;
+        for(long x = from; x < to; x++) {
+            if(readCount(body[x], var.name) > 0 && !updates.count(x)) return false;
+        }
+        return true;
+    }
+
+    // Number of operands of `instr` that read `name`
+    static int readCount(const Instruction& instr, const std::string& name) {
+        int count = 0;
+        forEachOperand(instr, [&](const Operand& op) {
+            if(!op.isConst() && op.name == name) count++;
+        });
+        // VEC_REDUCE also reads its accumulator
+        if(writes(instr, name) && instr.type != InstrType::VEC_REDUCE) count--;
+        return count;
+    }
+
+    // ---------- Inlining ----------
+
+    static int codeSize(const std::vector<Instruction>& body) {
+        int size = 0;
+        for(const auto& instr : body) {
+            if(instr.type != InstrType::LABEL && instr.type != InstrType::NOP) size++;
+        }
+        return size;
+    }
+
+    static int programSize(const IRProgram& program) {
+        int size = codeSize(program.instructions);
+        for(const auto& func : program.functions) size += codeSize(func.instructions);
+        return size;
+    }
+
+    // Loop nesting depth of every instruction; a loop is the range between
+    // a label and a later jump back to it
+    static std::vector<int> loopDepths(const std::vector<Instruction>& body) {
+        std::vector<int> depth(body.size(), 0);
+        std::unordered_map<std::string, size_t> labels;
+        for(size_t i = 0; i < body.size(); i++) {
+            if(body[i].type == InstrType::LABEL) labels[body[i].label] = i;
+        }
+        for(size_t j = 0; j < body.size(); j++) {
+            if(body[j].type != InstrType::GOTO && body[j].type != InstrType::IF_GOTO) continue;
+            auto it = labels.find(body[j].label);
+            if(it == labels.end() || it->second > j) continue;
+            for(size_t i = it->second; i <= j; i++) depth[i]++;
+        }
+        return depth;
+    }
+
+    // Functions that can reach themselves through the call graph
+    static std::unordered_set<std::string> recursiveFunctions(const IRProgram& program) {
+        std::unordered_map<std::string, std::vector<std::string>> callees;
+        for(const auto& func : program.functions) {
+            for(const auto& instr : func.instructions) {
+                if(instr.type == InstrType::CALL) callees[func.name].push_back(instr.funcName);
+            }
+        }
+
+        std::unordered_set<std::string> recursive;
+        for(const auto& func : program.functions) {
+            std::unordered_set<std::string> seen;
+            std::vector<std::string> work = callees[func.name];
+            while(!work.empty()) {
+                std::string name = work.back();
+                work.pop_back();
+                if(name == func.name) {
+                    recursive.insert(func.name);
+                    break;
+                }
+                if(!seen.insert(name).second) continue;
+                for(const auto& next : callees[name]) work.push_back(next);
+            }
+        }
+        return recursive;
+    }
+
+    IRProgram inlineCalls(const IRProgram& input) {
+        IRProgram result = input;
+        if(result.functions.empty()) return result;
+        result.layoutFrames();
+
+        auto recursive = recursiveFunctions(result);
+        int budget = std::max(inlineConfig.minGrowth,
+                              static_cast<int>(programSize(result) * inlineConfig.growthBudget));
+
+        // Bodies are inlined as they were before this pass, so the result
+        // does not depend on the order callers are visited in
+        std::unordered_map<std::string, IRFunction> originals;
+        for(const auto& func : result.functions) originals[func.name] = func;
+
+        struct Site {
+            IRFunction* caller;  // nullptr for top-level code
+            size_t index;
+            double priority;
+        };
+
+        auto collectSites = [&](std::vector<Instruction>& body, IRFunction* caller,
+                                std::vector<Site>& sites) {
+            auto depth = loopDepths(body);
+            for(size_t i = 0; i < body.size(); i++) {
+                const auto& instr = body[i];
+                if(instr.type != InstrType::CALL) continue;
+                auto it = originals.find(instr.funcName);
+                if(it == originals.end() || recursive.count(instr.funcName)) continue;
+                if(!it->second.arraySizes.empty()) continue;  // local arrays stay in a frame
+                if(hasParallelLoop(it->second)) continue;     // no nested parallel regions
+
+                const IRFunction& callee = it->second;
+                int size = codeSize(callee.instructions);
+                int threshold = inlineConfig.baseThreshold *
+                                (1 + inlineConfig.loopDepthBonus * depth[i]);
+                auto prof = inlineConfig.profile.find(callee.name);
+                long count = (prof != inlineConfig.profile.end()) ? prof->second : -1;
+                if(count >= inlineConfig.hotCallCount) threshold *= 2;
+                if(count == 0) continue;  // never executed
+                if(size > threshold) continue;
+
+                double frequency = (count >= 0) ? static_cast<double>(count)
+                                                : static_cast<double>(1 << (3 * std::min(depth[i], 8)));
+                sites.push_back({caller, i, frequency / size});
+            }
+        };
+
+        std::vector<Site> sites;
+        collectSites(result.instructions, nullptr, sites);
+        for(auto& func : result.functions) {
+            collectSites(func.instructions, &func, sites);
+        }
+        std::stable_sort(sites.begin(), sites.end(),
+                         [](const Site& a, const Site& b) { return a.priority > b.priority; });
+
+        // Pick sites within the growth budget, then rebuild each body in
+        // one pass with the expansions spliced in
+        std::unordered_map<IRFunction*, std::vector<size_t>> chosen;
+        for(const auto& site : sites) {
+            auto& body = site.caller ? site.caller->instructions : result.instructions;
+            const IRFunction& callee = originals[body[site.index].funcName];
+            if(site.caller && capturesGlobal(callee, *site.caller)) continue;
+
+            int growth = codeSize(callee.instructions) + static_cast<int>(callee.params.size());
+            if(stats.inlineGrowth + growth > budget) continue;
+
+            stats.inlineGrowth += growth;
+            chosen[site.caller].push_back(site.index);
+        }
+
+        for(auto& [caller, indices] : chosen) {
+            auto& body = caller ? caller->instructions : result.instructions;
+            std::sort(indices.begin(), indices.end());
+
+            // Expanded back to front, as the suffixes have always been numbered
+            std::vector<std::vector<Instruction>> expansions(indices.size());
+            size_t added = 0;
+            for(size_t k = indices.size(); k-- > 0;) {
+                const Instruction& call = body[indices[k]];
+                expansions[k] = expandCall(call, originals[call.funcName]);
+                added += expansions[k].size();
+                stats.inlinedCalls++;
+            }
+
+            std::vector<Instruction> out;
+            out.reserve(body.size() + added);
+            size_t next = 0;
+            for(size_t i = 0; i < body.size(); i++) {
+                if(next < indices.size() && indices[next] == i) {
+                    out.insert(out.end(), expansions[next].begin(), expansions[next].end());
+                    next++;
+                } else {
+                    out.push_back(std::move(body[i]));
+                }
+            }
+            body = std::move(out);
+        }
+
+        removeUncalledFunctions(result);
+        return result;
+    }
+
+    static bool hasParallelLoop(const IRFunction& func) {
+        return std::any_of(func.instructions.begin(), func.instructions.end(),
+                           [](const Instruction& instr) { return instr.type == InstrType::PAR_BEGIN; });
+    }
+
+    // A callee global that the caller shadows with a local cannot be inlined
+    static bool capturesGlobal(const IRFunction& callee, const IRFunction& caller) {
+        bool captured = false;
+        for(const auto& instr : callee.instructions) {
+            forEachOperand(instr, [&](const Operand& op) {
+                if(!op.isConst() && !callee.slots.count(op.name) && caller.slots.count(op.name)) {
+                    captured = true;
+                }
+            });
+        }
+        return captured;
+    }
+
+    // Copies the callee body in place of `call`. Params, locals and temps
+    // become fresh temps of the caller, labels get the same suffix, and
+    // every return turns into an assignment plus a jump to the exit label.
+    // Declared locals are set to 0 first, as in a fresh frame: inside a
+    // loop the temps would otherwise keep the previous call's values.
+    std::vector<Instruction> expandCall(const Instruction& call, const IRFunction& callee) {
+        std::string suffix = "_i" + std::to_string(inlineCounter++);
+        std::string exitLabel = "Lret" + suffix;
+
+        auto rename = [&](Operand op) {
+            if(!op.isConst() && callee.slots.count(op.name)) {
+                op = Operand(op.name + suffix, Operand::Type::TEMP);
+            }
+            return op;
+        };
+
+        std::vector<Instruction> out;
+        for(size_t i = 0; i < callee.params.size(); i++) {
+            out.push_back(Instruction::createAssign(
+                Operand(callee.params[i] + suffix, Operand::Type::TEMP), call.args[i]).at(call));
+        }
+        std::vector<std::string> locals;
+        for(const auto& [var, type] : callee.variableTypes) {
+            if(std::find(callee.params.begin(), callee.params.end(), var) == callee.params.end()) {
+                locals.push_back(var);
+            }
+        }
+        std::sort(locals.begin(), locals.end());
+        for(const auto& local : locals) {
+            out.push_back(Instruction::createAssign(
+                Operand(local + suffix, Operand::Type::TEMP), Operand(0)).at(call));
+        }
+
+        for(size_t i = 0; i < callee.instructions.size(); i++) {
+            Instruction instr = callee.instructions[i];
+            if(!instr.label.empty()) instr.label += suffix;
+
+            if(instr.type == InstrType::RETURN) {
+                out.push_back(Instruction::createAssign(call.result, rename(instr.op1)).at(instr));
+                if(i + 1 < callee.instructions.size()) {
+                    out.push_back(Instruction::createGoto(exitLabel).at(instr));
+                }
+                continue;
+            }
+
+            instr.result = rename(instr.result);
+            instr.op1 = rename(instr.op1);
+            instr.op2 = rename(instr.op2);
+            for(auto& arg : instr.args) arg = rename(arg);
+            out.push_back(instr);
+        }
+        out.push_back(Instruction::createLabel(exitLabel));
+        return out;
+    }
+
+    // Drops functions no longer reachable from top-level code
+    void removeUncalledFunctions(IRProgram& program) {
+        std::unordered_set<std::string> live;
+        std::vector<const std::vector<Instruction>*> work = {&program.instructions};
+        while(!work.empty()) {
+            const auto* body = work.back();
+            work.pop_back();
+            for(const auto& instr : *body) {
+                if(instr.type != InstrType::CALL || live.count(instr.funcName)) continue;
+                live.insert(instr.funcName);
+                if(const IRFunction* func = program.findFunction(instr.funcName)) {
+                    work.push_back(&func->instructions);
+                }
+            }
+        }
+
+        size_t before = program.functions.size();
+        program.functions.erase(
+            std::remove_if(program.functions.begin(), program.functions.end(),
+                           [&](const IRFunction& f) { return !live.count(f.name); }),
+            program.functions.end());
+        stats.removedFunctions += static_cast<int>(before - program.functions.size());
+    }
+
+    // ---------- Constant propagation ----------
+
+    // Replaces reads of names holding a known constant within a basic
+    // block, folds conditional jumps on constants and drops code that
+    // follows an unconditional jump up to the next label. Returns true
+    // if anything changed.
+    bool propagateConstants(IRProgram& program) {
+        bool changed = propagateConstants(program.instructions);
+        for(auto& func : program.functions) {
+            changed = propagateConstants(func.instructions) || changed;
+        }
+        return changed;
+    }
+
+    bool propagateConstants(std::vector<Instruction>& instructions) {
+        bool changed = false;
+        std::unordered_map<std::string, int> known;
+
+        auto substitute = [&](Operand& op) {
+            if(op.isConst()) return;
+            auto it = known.find(op.name);
+            if(it != known.end()) {
+                op = Operand(it->second);
+                changed = true;
+            }
+        };
+
+        std::vector<Instruction> out;
+        out.reserve(instructions.size());
+        bool unreachable = false;
+        for(auto instr : instructions) {
+            if(unreachable && instr.type != InstrType::LABEL) {
+                changed = true;
+                continue;
+            }
+            switch(instr.type) {
+                case InstrType::LABEL:
+                    known.clear();
+                    unreachable = false;
+                    break;
+                case InstrType::BIN_OP:
+                    substitute(instr.op1);
+                    substitute(instr.op2);
+                    known.erase(instr.result.name);
+                    break;
+                case InstrType::UN_OP:
+                    substitute(instr.op1);
+                    known.erase(instr.result.name);
+                    break;
+                case InstrType::ASSIGN:
+                    substitute(instr.op1);
+                    if(instr.op1.isConst()) known[instr.result.name] = instr.op1.value;
+                    else known.erase(instr.result.name);
+                    break;
+                case InstrType::PRINT:
+                case InstrType::RETURN:
+                    substitute(instr.op1);
+                    break;
+                case InstrType::LOAD_IDX:
+                    substitute(instr.op2);
+                    known.erase(instr.result.name);
+                    break;
+                case InstrType::INPUT:
+                    known.erase(instr.result.name);
+                    break;
+                case InstrType::STORE_IDX:
+                    substitute(instr.op1);
+                    substitute(instr.op2);
+                    break;
+                case InstrType::IF_GOTO:
+                    substitute(instr.op1);
+                    if(instr.op1.isConst()) {
+                        changed = true;
+                        if(instr.op1.value != 0) continue;  // never taken
+                        instr = Instruction::createGoto(instr.label).at(instr);
+                    }
+                    break;
+                case InstrType::CALL:
+                    for(auto& arg : instr.args) substitute(arg);
+                    known.clear();  // the callee may write globals
+                    break;
+                case InstrType::PAR_BEGIN:
+                    substitute(instr.op2);
+                    known.clear();  // the body runs with its own induction variable
+                    break;
+                case InstrType::PAR_END:
+                    known.clear();
+                    break;
+                default:
+                    break;
+            }
+            out.push_back(instr);
+            if(instr.type == InstrType::GOTO || instr.type == InstrType::RETURN) {
+                unreachable = true;
+            }
+        }
+
+        instructions = std::move(out);
+        return changed;
+    }
+
 private:
     IRProgram foldConstants(const IRProgram& input) {
         IRProgram result = input;
 
-        for(auto& instr : result.instructions) {
+        foldConstants(result.instructions);
+        for(auto& func : result.functions) {
+            foldConstants(func.instructions);
+        }
+
+        return result;
+    }
+
+    void foldConstants(std::vector<Instruction>& instructions) {
+        for(auto& instr : instructions) {
             if(instr.type == InstrType::BIN_OP) {
                 if(instr.op1.isConst() && instr.op2.isConst()) {
                     int val1 = instr.op1.value;
@@ -38,8 +1663,8 @@ private:
                         case BinOp::ADD: foldedValue = val1 + val2; break;
                         case BinOp::SUB: foldedValue = val1 - val2; break;
                         case BinOp::MUL: foldedValue = val1 * val2; break;
-                        case BinOp::DIV: foldedValue = (val2 != 0) ? val1 / val2 : 0; break;
-                        case BinOp::MOD: foldedValue = (val2 != 0) ? val1 % val2 : 0; break;
+                        case BinOp::DIV: foldedValue = (val2 != 0) ? simd::divide(val1, val2) : 0; break;
+                        case BinOp::MOD: foldedValue = (val2 != 0) ? simd::remainder(val1, val2) : 0; break;
                         case BinOp::EQ: foldedValue = (val1 == val2) ? 1 : 0; break;
                         case BinOp::NE: foldedValue = (val1 != val2) ? 1 : 0; break;
                         case BinOp::LT: foldedValue = (val1 < val2) ? 1 : 0; break;
@@ -70,19 +1695,34 @@ private:
                 }
             }
         }
-
-        return result;
     }
 
     IRProgram eliminateDeadCode(const IRProgram& input) {
         IRProgram result = input;
 
-        // Find all variables that are used
+        // Find all variables that are used. Globals may be read from any
+        // function, so uses are collected over the whole program.
         std::unordered_set<std::string> usedVars;
         std::unordered_set<std::string> assignedVars;
 
+        collectUses(result.instructions, usedVars, assignedVars);
+        for(const auto& func : result.functions) {
+            collectUses(func.instructions, usedVars, assignedVars);
+        }
+
+        removeDeadAssignments(result.instructions, usedVars, assignedVars);
+        for(auto& func : result.functions) {
+            removeDeadAssignments(func.instructions, usedVars, assignedVars);
+        }
+
+        return result;
+    }
+
+    void collectUses(const std::vector<Instruction>& instructions,
+                     std::unordered_set<std::string>& usedVars,
+                     std::unordered_set<std::string>& assignedVars) {
         // First pass: find all uses and assignments
-        for(const auto& instr : result.instructions) {
+        for(const auto& instr : instructions) {
             // Mark assignments
             if(instr.type == InstrType::ASSIGN ||
                instr.type == InstrType::BIN_OP ||
@@ -108,13 +1748,28 @@ private:
                 for(const auto& arg : instr.args) {
                     usedVars.insert(arg.str());
                 }
+            } else if(instr.type == InstrType::LOAD_IDX) {
+                usedVars.insert(instr.op1.str());
+                usedVars.insert(instr.op2.str());
+            } else if(instr.type == InstrType::STORE_IDX) {
+                usedVars.insert(instr.op1.str());
+                usedVars.insert(instr.op2.str());
+            } else if(instr.type == InstrType::PAR_BEGIN) {
+                usedVars.insert(instr.op1.str());
+                usedVars.insert(instr.op2.str());
+            } else if(instr.type == InstrType::PAR_REDUCE) {
+                usedVars.insert(instr.result.str());
             }
         }
+    }
 
+    void removeDeadAssignments(std::vector<Instruction>& instructions,
+                               const std::unordered_set<std::string>& usedVars,
+                               const std::unordered_set<std::string>& assignedVars) {
         // Second pass: remove dead assignments
         // (assignments to variables that are never used)
         std::vector<Instruction> filtered;
-        for(const auto& instr : result.instructions) {
+        for(const auto& instr : instructions) {
             bool isDead = false;
 
             // Check if this is an assignment to an unused variable
@@ -131,7 +1786,6 @@ private:
             }
         }
 
-        result.instructions = filtered;
-        return result;
+        instructions = filtered;
     }
 };
@@ -23,8 +23,8 @@ using ExpressionPtr = std::shared_ptr<Expression>;
 
 enum class ASTNodeType {
     PROGRAM, DECL, ASSIGN, IF_STMT, WHILE_STMT, FOR_STMT, 
-    BLOCK, RETURN_STMT, PRINT_STMT,
-    BIN_EXPR, UN_EXPR, VAR_EXPR, CONST_EXPR, CALL_EXPR
+    BLOCK, RETURN_STMT, PRINT_STMT, EXPR_STMT, FUNC_DECL,
+    BIN_EXPR, UN_EXPR, VAR_EXPR, CONST_EXPR, CALL_EXPR, INDEX_EXPR
 };
 
 struct ASTNode {
@@ -47,40 +47,48 @@ struct BinExpr : public Expression {
     ExpressionPtr left, right;
     BinOp op;
     
-    BinExpr(ExpressionPtr l, BinOp o, ExpressionPtr r, int line = 0)
-    : Expression(ASTNodeType::BIN_EXPR, line), left(l), right(r), op(o) {}
+    BinExpr(ExpressionPtr l, BinOp o, ExpressionPtr r, int line = 0, int column = 0)
+    : Expression(ASTNodeType::BIN_EXPR, line, column), left(l), right(r), op(o) {}
 };
 
 struct UnExpr : public Expression {
     ExpressionPtr operand;
     UnOp op;
     
-    UnExpr(UnOp o, ExpressionPtr e, int line = 0)
-    : Expression(ASTNodeType::UN_EXPR, line), operand(e), op(o) {}
+    UnExpr(UnOp o, ExpressionPtr e, int line = 0, int column = 0)
+    : Expression(ASTNodeType::UN_EXPR, line, column), operand(e), op(o) {}
 };
 
 struct VarExpr : public Expression {
     std::string name;
     
-    VarExpr(const std::string& n, int line = 0)
-        : Expression(ASTNodeType::VAR_EXPR, line), name(n) {}
+    VarExpr(const std::string& n, int line = 0, int column = 0)
+        : Expression(ASTNodeType::VAR_EXPR, line, column), name(n) {}
 };
 
 struct ConstExpr : public Expression {
     std::variant<int, bool> value;
     
-    ConstExpr(int v, int line = 0)
-        : Expression(ASTNodeType::CONST_EXPR, line), value(v) {}
-    ConstExpr(bool v, int line = 0)
-        : Expression(ASTNodeType::CONST_EXPR, line), value(v) { dataType = "bool"; }
+    ConstExpr(int v, int line = 0, int column = 0)
+        : Expression(ASTNodeType::CONST_EXPR, line, column), value(v) {}
+    ConstExpr(bool v, int line = 0, int column = 0)
+        : Expression(ASTNodeType::CONST_EXPR, line, column), value(v) { dataType = "bool"; }
+};
+
+struct IndexExpr : public Expression {
+    std::string arrayName;
+    ExpressionPtr index;
+    
+    IndexExpr(const std::string& name, ExpressionPtr idx, int line = 0, int column = 0)
+        : Expression(ASTNodeType::INDEX_EXPR, line, column), arrayName(name), index(idx) {}
 };
 
 struct CallExpr : public Expression {
     std::string funcName;
     std::vector<ExpressionPtr> args;
     
-    CallExpr(const std::string& fn, int line = 0)
-        : Expression(ASTNodeType::CALL_EXPR, line), funcName(fn) {}
+    CallExpr(const std::string& fn, int line = 0, int column = 0)
+        : Expression(ASTNodeType::CALL_EXPR, line, column), funcName(fn) {}
 };
 
 struct Statement : public ASTNode {
@@ -91,17 +99,19 @@ struct DeclStmt : public Statement {
     std::string varName;
     std::string dataType;  // "int" or "bool"
     ExpressionPtr initializer;
+    int arraySize = 0;     // > 0 for `int a[N];`
     
-    DeclStmt(const std::string& name, const std::string& type, int line = 0)
-        : Statement(ASTNodeType::DECL, line), varName(name), dataType(type) {}
+    DeclStmt(const std::string& name, const std::string& type, int line = 0, int column = 0)
+        : Statement(ASTNodeType::DECL, line, column), varName(name), dataType(type) {}
 };
 
 struct AssignStmt : public Statement {
     std::string varName;
+    ExpressionPtr index;   // set for `a[i] = value;`
     ExpressionPtr value;
     
-    AssignStmt(const std::string& name, ExpressionPtr expr, int line = 0)
-        : Statement(ASTNodeType::ASSIGN, line), varName(name), value(expr) {}
+    AssignStmt(const std::string& name, ExpressionPtr expr, int line = 0, int column = 0)
+        : Statement(ASTNodeType::ASSIGN, line, column), varName(name), value(expr) {}
 };
 
 struct IfStmt : public Statement {
@@ -109,47 +119,70 @@ struct IfStmt : public Statement {
     std::vector<StatementPtr> thenBranch;
     std::vector<StatementPtr> elseBranch;
     
-    IfStmt(ExpressionPtr cond, int line = 0)
-        : Statement(ASTNodeType::IF_STMT, line), condition(cond) {}
+    IfStmt(ExpressionPtr cond, int line = 0, int column = 0)
+        : Statement(ASTNodeType::IF_STMT, line, column), condition(cond) {}
 };
 
 struct WhileStmt : public Statement {
     ExpressionPtr condition;
     std::vector<StatementPtr> body;
     
-    WhileStmt(ExpressionPtr cond, int line = 0)
-        : Statement(ASTNodeType::WHILE_STMT, line), condition(cond) {}
+    WhileStmt(ExpressionPtr cond, int line = 0, int column = 0)
+        : Statement(ASTNodeType::WHILE_STMT, line, column), condition(cond) {}
 };
 
 struct ForStmt : public Statement {
     StatementPtr init;
     ExpressionPtr condition;
-    ExpressionPtr update;
+    StatementPtr update;
     std::vector<StatementPtr> body;
+    bool parallel = false;  // `parallel for`: iterations may run concurrently
     
-    ForStmt(int line = 0)
-        : Statement(ASTNodeType::FOR_STMT, line), init(nullptr),
+    ForStmt(int line = 0, int column = 0)
+        : Statement(ASTNodeType::FOR_STMT, line, column), init(nullptr),
           condition(nullptr), update(nullptr) {}
 };
 
 struct BlockStmt : public Statement {
     std::vector<StatementPtr> statements;
     
-    BlockStmt(int line = 0) : Statement(ASTNodeType::BLOCK, line) {}
+    BlockStmt(int line = 0, int column = 0) : Statement(ASTNodeType::BLOCK, line, column) {}
 };
 
 struct ReturnStmt : public Statement {
     ExpressionPtr value;
     
-    ReturnStmt(ExpressionPtr v = nullptr, int line = 0)
-        : Statement(ASTNodeType::RETURN_STMT, line), value(v) {}
+    ReturnStmt(ExpressionPtr v = nullptr, int line = 0, int column = 0)
+        : Statement(ASTNodeType::RETURN_STMT, line, column), value(v) {}
 };
 
 struct PrintStmt : public Statement {
     ExpressionPtr value;
     
-    PrintStmt(ExpressionPtr v, int line = 0)
-        : Statement(ASTNodeType::PRINT_STMT, line), value(v) {}
+    PrintStmt(ExpressionPtr v, int line = 0, int column = 0)
+        : Statement(ASTNodeType::PRINT_STMT, line, column), value(v) {}
+};
+
+struct ExprStmt : public Statement {
+    ExpressionPtr expr;
+    
+    ExprStmt(ExpressionPtr e, int line = 0, int column = 0)
+        : Statement(ASTNodeType::EXPR_STMT, line, column), expr(e) {}
+};
+
+struct Param {
+    std::string name;
+    std::string dataType;  // "int" or "bool"
+};
+
+struct FuncDecl : public Statement {
+    std::string name;
+    std::string returnType;
+    std::vector<Param> params;
+    std::vector<StatementPtr> body;
+    
+    FuncDecl(const std::string& n, const std::string& ret, int line = 0, int column = 0)
+        : Statement(ASTNodeType::FUNC_DECL, line, column), name(n), returnType(ret) {}
 };
 
 struct Program : public ASTNode {
@@ -216,6 +249,12 @@ private:
         if(match(TokenType::IF)) return ifStatement();
         if(match(TokenType::WHILE)) return whileStatement();
         if(match(TokenType::FOR)) return forStatement();
+        if(match(TokenType::PARALLEL)) {
+            consume(TokenType::FOR, "Expected 'for' after 'parallel'");
+            auto loop = std::dynamic_pointer_cast<ForStmt>(forStatement());
+            loop->parallel = true;
+            return loop;
+        }
         if(match(TokenType::RETURN)) return returnStatement();
         if(match(TokenType::PRINT)) return printStatement();
         if(match(TokenType::LBRACE)) return blockStatement();
@@ -225,11 +264,20 @@ private:
 
     StatementPtr declaration() {
         std::string typeStr = previous().lexeme;
-        std::string varName = consume(TokenType::IDENT, "Expected variable name").lexeme;
+        Token name = consume(TokenType::IDENT, "Expected variable name");
+        std::string varName = name.lexeme;
         
-        auto decl = std::make_shared<DeclStmt>(varName, typeStr, previous().line);
+        if(match(TokenType::LPAREN)) {
+            return functionDefinition(varName, typeStr);
+        }
         
-        if(match(TokenType::ASSIGN)) {
+        auto decl = std::make_shared<DeclStmt>(varName, typeStr, name.line, name.column);
+        
+        if(match(TokenType::LBRACKET)) {
+            decl->arraySize = consume(TokenType::INT_LIT, "Expected array size").intValue;
+            if(decl->arraySize <= 0) throw std::runtime_error("Array size must be positive");
+            consume(TokenType::RBRACKET, "Expected ']' after array size");
+        } else if(match(TokenType::ASSIGN)) {
             decl->initializer = expression();
         }
         
@@ -237,12 +285,38 @@ private:
         return decl;
     }
 
+    StatementPtr functionDefinition(const std::string& name, const std::string& returnType) {
+        auto func = std::make_shared<FuncDecl>(name, returnType, previous().line, previous().column);
+        
+        if(!check(TokenType::RPAREN)) {
+            do {
+                if(!match(TokenType::INT_KW) && !match(TokenType::BOOL_KW)) {
+                    throw std::runtime_error("Expected parameter type");
+                }
+                Param param;
+                param.dataType = previous().lexeme;
+                param.name = consume(TokenType::IDENT, "Expected parameter name").lexeme;
+                func->params.push_back(param);
+            } while(match(TokenType::COMMA));
+        }
+        consume(TokenType::RPAREN, "Expected ')' after parameters");
+        
+        consume(TokenType::LBRACE, "Expected '{' before function body");
+        while(!check(TokenType::RBRACE) && !isAtEnd()) {
+            func->body.push_back(statement());
+        }
+        consume(TokenType::RBRACE, "Expected '}' after function body");
+        
+        return func;
+    }
+
     StatementPtr ifStatement() {
+        Token keyword = previous();
         consume(TokenType::LPAREN, "Expected '(' after 'if'");
         auto condition = expression();
         consume(TokenType::RPAREN, "Expected ')' after if condition");
         
-        auto ifStmt = std::make_shared<IfStmt>(condition, previous().line);
+        auto ifStmt = std::make_shared<IfStmt>(condition, keyword.line, keyword.column);
         
         if(match(TokenType::LBRACE)) {
             do {
@@ -270,11 +344,12 @@ private:
     }
 
     StatementPtr whileStatement() {
+        Token keyword = previous();
         consume(TokenType::LPAREN, "Expected '(' after 'while'");
         auto condition = expression();
         consume(TokenType::RPAREN, "Expected ')' after while condition");
         
-        auto whileStmt = std::make_shared<WhileStmt>(condition, previous().line);
+        auto whileStmt = std::make_shared<WhileStmt>(condition, keyword.line, keyword.column);
         
         if(match(TokenType::LBRACE)) {
             do {
@@ -290,24 +365,25 @@ private:
     }
 
     StatementPtr forStatement() {
+        Token keyword = previous();
         consume(TokenType::LPAREN, "Expected '(' after 'for'");
         
-        auto forStmt = std::make_shared<ForStmt>(previous().line);
+        auto forStmt = std::make_shared<ForStmt>(keyword.line, keyword.column);
         
         // Init
         if(!check(TokenType::SEMICOLON)) {
             if(check(TokenType::INT_KW) || check(TokenType::BOOL_KW)) {
                 advance();
                 std::string type = previous().lexeme;
-                std::string name = consume(TokenType::IDENT, "Expected variable name").lexeme;
-                forStmt->init = std::make_shared<DeclStmt>(name, type);
+                Token name = consume(TokenType::IDENT, "Expected variable name");
+                forStmt->init = std::make_shared<DeclStmt>(name.lexeme, type, name.line, name.column);
                 
                 if(match(TokenType::ASSIGN)) {
                     auto decl = std::dynamic_pointer_cast<DeclStmt>(forStmt->init);
                     decl->initializer = expression();
                 }
             } else {
-                forStmt->init = expressionStatement();
+                forStmt->init = simpleStatement();
             }
         }
         consume(TokenType::SEMICOLON, "Expected ';' after for init");
@@ -320,7 +396,7 @@ private:
         
         // Update
         if(!check(TokenType::RPAREN)) {
-            forStmt->update = expression();
+            forStmt->update = simpleStatement();
         }
         consume(TokenType::RPAREN, "Expected ')' after for clauses");
         
@@ -339,24 +415,26 @@ private:
     }
 
     StatementPtr returnStatement() {
+        Token keyword = previous();
         ExpressionPtr value = nullptr;
         if(!check(TokenType::SEMICOLON)) {
             value = expression();
         }
         consume(TokenType::SEMICOLON, "Expected ';' after return");
-        return std::make_shared<ReturnStmt>(value, previous().line);
+        return std::make_shared<ReturnStmt>(value, keyword.line, keyword.column);
     }
 
     StatementPtr printStatement() {
+        Token keyword = previous();
         consume(TokenType::LPAREN, "Expected '(' after 'print'");
         auto expr = expression();
         consume(TokenType::RPAREN, "Expected ')' after print argument");
         consume(TokenType::SEMICOLON, "Expected ';' after print");
-        return std::make_shared<PrintStmt>(expr, previous().line);
+        return std::make_shared<PrintStmt>(expr, keyword.line, keyword.column);
     }
 
     StatementPtr blockStatement() {
-        auto block = std::make_shared<BlockStmt>(previous().line);
+        auto block = std::make_shared<BlockStmt>(previous().line, previous().column);
         
         while(!check(TokenType::RBRACE) && !isAtEnd()) {
             block->statements.push_back(statement());
@@ -367,22 +445,42 @@ private:
     }
 
     StatementPtr expressionStatement() {
+        auto stmt = simpleStatement();
+        if(stmt->type == ASTNodeType::ASSIGN) {
+            consume(TokenType::SEMICOLON, "Expected ';' after assignment");
+        } else {
+            consume(TokenType::SEMICOLON, "Expected ';' after expression");
+        }
+        return stmt;
+    }
+
+    // Assignment or expression without the trailing ';' (also used by
+    // the init and update clauses of `for`)
+    StatementPtr simpleStatement() {
         if(check(TokenType::IDENT)) {
+            size_t start = current;
             Token ident = advance();
             
+            ExpressionPtr index = nullptr;
+            if(match(TokenType::LBRACKET)) {
+                index = expression();
+                consume(TokenType::RBRACKET, "Expected ']' after index");
+            }
+            
             if(match(TokenType::ASSIGN)) {
                 auto expr = expression();
-                consume(TokenType::SEMICOLON, "Expected ';' after assignment");
-                return std::make_shared<AssignStmt>(ident.lexeme, expr, ident.line);
+                auto assign = std::make_shared<AssignStmt>(ident.lexeme, expr, ident.line, ident.column);
+                assign->index = index;
+                return assign;
             }
+            
+            current = start;  // Back up
         }
         
-        current--;  // Back up
+        int line = peek().line;
+        int column = peek().column;
         auto expr = expression();
-        consume(TokenType::SEMICOLON, "Expected ';' after expression");
-        
-        // Create dummy statement if needed
-        return std::make_shared<Statement>(ASTNodeType::BLOCK);
+        return std::make_shared<ExprStmt>(expr, line, column);
     }
 
     ExpressionPtr expression() {
@@ -393,8 +491,9 @@ private:
         auto expr = andExpression();
         
         while(match(TokenType::OR)) {
+            Token op = previous();
             auto right = andExpression();
-            expr = std::make_shared<BinExpr>(expr, BinOp::OR, right, previous().line);
+            expr = std::make_shared<BinExpr>(expr, BinOp::OR, right, op.line, op.column);
         }
         
         return expr;
@@ -404,8 +503,9 @@ private:
         auto expr = equalityExpression();
         
         while(match(TokenType::AND)) {
+            Token op = previous();
             auto right = equalityExpression();
-            expr = std::make_shared<BinExpr>(expr, BinOp::AND, right, previous().line);
+            expr = std::make_shared<BinExpr>(expr, BinOp::AND, right, op.line, op.column);
         }
         
         return expr;
@@ -416,11 +516,13 @@ private:
         
         while(true) {
             if(match(TokenType::EQ)) {
+                Token op = previous();
                 auto right = relationalExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::EQ, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::EQ, right, op.line, op.column);
             } else if(match(TokenType::NE)) {
+                Token op = previous();
                 auto right = relationalExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::NE, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::NE, right, op.line, op.column);
             } else {
                 break;
             }
@@ -434,17 +536,21 @@ private:
         
         while(true) {
             if(match(TokenType::LT)) {
+                Token op = previous();
                 auto right = additiveExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::LT, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::LT, right, op.line, op.column);
             } else if(match(TokenType::GT)) {
+                Token op = previous();
                 auto right = additiveExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::GT, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::GT, right, op.line, op.column);
             } else if(match(TokenType::LE)) {
+                Token op = previous();
                 auto right = additiveExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::LE, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::LE, right, op.line, op.column);
             } else if(match(TokenType::GE)) {
+                Token op = previous();
                 auto right = additiveExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::GE, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::GE, right, op.line, op.column);
             } else {
                 break;
             }
@@ -458,11 +564,13 @@ private:
         
         while(true) {
             if(match(TokenType::PLUS)) {
+                Token op = previous();
                 auto right = multiplicativeExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::ADD, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::ADD, right, op.line, op.column);
             } else if(match(TokenType::MINUS)) {
+                Token op = previous();
                 auto right = multiplicativeExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::SUB, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::SUB, right, op.line, op.column);
             } else {
                 break;
             }
@@ -476,14 +584,17 @@ private:
         
         while(true) {
             if(match(TokenType::STAR)) {
+                Token op = previous();
                 auto right = unaryExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::MUL, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::MUL, right, op.line, op.column);
             } else if(match(TokenType::SLASH)) {
+                Token op = previous();
                 auto right = unaryExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::DIV, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::DIV, right, op.line, op.column);
             } else if(match(TokenType::PERCENT)) {
+                Token op = previous();
                 auto right = unaryExpression();
-                expr = std::make_shared<BinExpr>(expr, BinOp::MOD, right, previous().line);
+                expr = std::make_shared<BinExpr>(expr, BinOp::MOD, right, op.line, op.column);
             } else {
                 break;
             }
@@ -494,13 +605,15 @@ private:
 
     ExpressionPtr unaryExpression() {
         if(match(TokenType::MINUS)) {
+            Token op = previous();
             auto expr = unaryExpression();
-            return std::make_shared<UnExpr>(UnOp::NEG, expr, previous().line);
+            return std::make_shared<UnExpr>(UnOp::NEG, expr, op.line, op.column);
         }
         
         if(match(TokenType::NOT)) {
+            Token op = previous();
             auto expr = unaryExpression();
-            return std::make_shared<UnExpr>(UnOp::NOT, expr, previous().line);
+            return std::make_shared<UnExpr>(UnOp::NOT, expr, op.line, op.column);
         }
         
         return primaryExpression();
@@ -508,19 +621,20 @@ private:
 
     ExpressionPtr primaryExpression() {
         if(match(TokenType::INT_LIT)) {
-            return std::make_shared<ConstExpr>(previous().intValue, previous().line);
+            return std::make_shared<ConstExpr>(previous().intValue, previous().line, previous().column);
         }
         
         if(match(TokenType::BOOL_LIT)) {
-            return std::make_shared<ConstExpr>(previous().boolValue, previous().line);
+            return std::make_shared<ConstExpr>(previous().boolValue, previous().line, previous().column);
         }
         
         if(match(TokenType::IDENT)) {
             std::string name = previous().lexeme;
             int line = previous().line;
+            int column = previous().column;
             
             if(match(TokenType::LPAREN)) {
-                auto call = std::make_shared<CallExpr>(name, line);
+                auto call = std::make_shared<CallExpr>(name, line, column);
                 if(!check(TokenType::RPAREN)) {
                     do {
                         call->args.push_back(expression());
@@ -530,7 +644,13 @@ private:
                 return call;
             }
             
-            return std::make_shared<VarExpr>(name, line);
+            if(match(TokenType::LBRACKET)) {
+                auto index = expression();
+                consume(TokenType::RBRACKET, "Expected ']' after index");
+                return std::make_shared<IndexExpr>(name, index, line, column);
+            }
+            
+            return std::make_shared<VarExpr>(name, line, column);
         }
         
         if(match(TokenType::LPAREN)) {
@@ -0,0 +1,154 @@
+/**
+ * @file perfcounters.h
+ * @brief Hardware performance counters per compiler phase
+ *
+ * PerfCounters opens one perf_event_open counter per event for this
+ * process and the threads it starts later (parallel loops, instances),
+ * user space only, so perf_event_paranoid up to 2 allows them. Counters
+ * run for the whole program; a phase is the difference of two readings,
+ * scaled by enabled/running time when the kernel multiplexes counters.
+ *
+ * Each event is opened on its own: virtual machines and older CPUs often
+ * lack some of them (LLC misses, or every hardware event), and the
+ * others still count. task-clock is a software event and always there.
+ * Counters exist on Linux only (LAB3_PERF_COUNTERS).
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#define LAB3_PERF_COUNTERS 1
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounters {
+public:
+    enum Event { TASK_CLOCK, CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, EVENTS };
+
+    static const char* name(Event event) {
+        static const char* const names[] = {"task-clock", "cycles", "instructions", "branch-misses",
+                                            "L1d-misses", "LLC-misses"};
+        return names[event];
+    }
+
+    struct Phase {
+        std::string name;
+        double values[EVENTS] = {};  // task-clock in nanoseconds
+        long units = 0;              // tokens, IR instructions or executed ops
+        const char* unit = "";
+    };
+
+private:
+    int fds[EVENTS];
+    uint64_t start[EVENTS][3];  // value, time enabled, time running at enter()
+    std::vector<Phase> phases;
+    bool running = false;
+    std::string error;
+
+public:
+    PerfCounters() {
+        for(int& fd : fds) fd = -1;
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#ifdef LAB3_PERF_COUNTERS
+        for(int fd : fds) {
+            if(fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    // Opens every event the kernel offers; false if there are no hardware
+    // counters at all, with the reason in getError()
+    bool open() {
+#ifdef LAB3_PERF_COUNTERS
+        static const uint32_t types[EVENTS] = {PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                               PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+        static const uint64_t configs[EVENTS] = {
+            PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+        bool hardware = false;
+        for(int e = 0; e < EVENTS; e++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[e];
+            attr.config = configs[e];
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if(fds[e] >= 0) {
+                hardware = hardware || e != TASK_CLOCK;
+            } else if(error.empty() && e != TASK_CLOCK) {
+                error = std::string(name(static_cast<Event>(e))) + ": " + strerror(errno);
+            }
+        }
+        if(!hardware && error.empty()) error = "no hardware events";
+        return hardware;
+#else
+        error = "perf_event_open is Linux only";
+        return false;
+#endif
+    }
+
+    bool supported(Event event) const { return fds[event] >= 0; }
+    const std::string& getError() const { return error; }
+
+    // Ends the running phase, if any, and starts `phase`
+    void enter(const char* phase) {
+        stop();
+        phases.push_back({phase});
+        for(int e = 0; e < EVENTS; e++) read(e, start[e]);
+        running = true;
+    }
+
+    // Ends the running phase
+    void stop() {
+        if(!running) return;
+        running = false;
+        Phase& phase = phases.back();
+        for(int e = 0; e < EVENTS; e++) {
+            uint64_t now[3];
+            if(!read(e, now)) continue;
+            uint64_t ran = now[2] - start[e][2];
+            if(ran == 0) continue;
+            double scale = double(now[1] - start[e][1]) / ran;
+            phase.values[e] = double(now[0] - start[e][0]) * scale;
+        }
+    }
+
+    // What the running phase processed, for the per-unit figures
+    void count(long units, const char* unit) {
+        if(!running) return;
+        phases.back().units = units;
+        phases.back().unit = unit;
+    }
+
+    const std::vector<Phase>& getPhases() const { return phases; }
+
+private:
+    bool read(int event, uint64_t (&value)[3]) {
+        value[0] = value[1] = value[2] = 0;
+#ifdef LAB3_PERF_COUNTERS
+        if(fds[event] < 0) return false;
+        return ::read(fds[event], value, sizeof(value)) == static_cast<ssize_t>(sizeof(value));
+#else
+        (void)event;
+        return false;
+#endif
+    }
+};
@@ -0,0 +1,183 @@
+/**
+ * @file perfmap.h
+ * @brief Symbols of native trace code for Linux perf
+ *
+ * Samples in JIT-generated code show up in perf as anonymous addresses.
+ * Two formats name them:
+ *  - a perf map, /tmp/perf-<pid>.map: one "start size name" line per
+ *    block of code, read by perf report for the process;
+ *  - a jitdump file, <dir>/jit-<pid>.dump: a JIT_CODE_LOAD record per
+ *    block with a copy of its bytes, preceded by JIT_CODE_DEBUG_INFO that
+ *    maps code addresses to source lines. The file is mapped executable
+ *    once, so `perf record -k mono` notes it, and `perf inject --jit`
+ *    turns the records into ELF images for perf report and perf annotate.
+ * Both are written on Linux only (LAB3_PERF_MAP).
+ */
+
+#pragma once
+
+#include "jit.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#define LAB3_PERF_MAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace jit {
+
+class PerfMap {
+public:
+    // The code of a source line starts at `offset` of its block
+    struct Line {
+        size_t offset;
+        int line;
+    };
+
+private:
+    FILE* map = nullptr;
+    FILE* dump = nullptr;
+    void* marker = nullptr;  // executable mapping of the dump file
+    size_t markerSize = 0;
+    std::string mapFile, dumpFile;
+    std::string source = "lab3";  // file name in debug info
+    long blocks = 0;
+
+    // jitdump records, as in tools/perf/Documentation/jitdump-specification.txt
+    enum Record : uint32_t { CODE_LOAD = 0, CODE_DEBUG_INFO = 2, CODE_CLOSE = 3 };
+    static constexpr uint32_t DUMP_MAGIC = 0x4A695444;  // "JiTD"
+    static constexpr uint32_t DUMP_VERSION = 1;
+    static constexpr uint32_t EM_X86_64 = 62;
+
+    struct DumpHeader {
+        uint32_t magic, version, size, machine, pad, pid;
+        uint64_t timestamp, flags;
+    };
+    struct RecordHeader {
+        uint32_t id, size;
+        uint64_t timestamp;
+    };
+    struct CodeLoad {
+        uint32_t pid, tid;
+        uint64_t vma, address, size, index;
+    };
+    struct DebugInfo {
+        uint64_t address, entries;
+    };
+    struct DebugEntry {
+        uint64_t address;
+        uint32_t line, discriminator;
+    };
+
+public:
+    PerfMap() = default;
+    PerfMap(const PerfMap&) = delete;
+    PerfMap& operator=(const PerfMap&) = delete;
+
+    ~PerfMap() {
+        if(map) fclose(map);
+#ifdef LAB3_PERF_MAP
+        if(dump) {
+            put(RecordHeader{CODE_CLOSE, sizeof(RecordHeader), now()});
+            if(marker) munmap(marker, markerSize);
+            fclose(dump);
+        }
+#endif
+    }
+
+    // Appends to /tmp/perf-<pid>.map; false where perf maps are not used
+    bool openMap() {
+#ifdef LAB3_PERF_MAP
+        mapFile = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        map = fopen(mapFile.c_str(), "a");
+#endif
+        return map != nullptr;
+    }
+
+    // Creates <dir>/jit-<pid>.dump; false if it cannot be written
+    bool openDump(const std::string& dir) {
+#ifdef LAB3_PERF_MAP
+        dumpFile = dir + "/jit-" + std::to_string(getpid()) + ".dump";
+        int fd = open(dumpFile.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if(fd < 0) return false;
+        dump = fdopen(fd, "w+");
+        if(!dump) {
+            close(fd);
+            return false;
+        }
+        DumpHeader header{DUMP_MAGIC, DUMP_VERSION, sizeof(DumpHeader), EM_X86_64, 0,
+                          static_cast<uint32_t>(getpid()), now(), 0};
+        put(header);
+        fflush(dump);
+        markerSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        marker = mmap(nullptr, markerSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+        if(marker == MAP_FAILED) marker = nullptr;
+#else
+        (void)dir;
+#endif
+        return dump != nullptr;
+    }
+
+    // Source file named by the jitdump line records
+    void setSource(std::string file) { source = std::move(file); }
+
+    // Names a block of code just loaded; `lines` in increasing offset order
+    void add(const std::string& name, const Code& code, const std::vector<Line>& lines = {}) {
+        uint64_t address = reinterpret_cast<uint64_t>(code.address());
+        if(map) {
+            fprintf(map, "%llx %zx %s\n", static_cast<unsigned long long>(address), code.bytes(), name.c_str());
+            fflush(map);
+        }
+#ifdef LAB3_PERF_MAP
+        if(dump) {
+            std::vector<Line> changes;
+            for(const auto& l : lines) {
+                if(changes.empty() || changes.back().line != l.line) changes.push_back(l);
+            }
+            if(!changes.empty()) {
+                uint32_t size = sizeof(RecordHeader) + sizeof(DebugInfo);
+                for(size_t i = 0; i < changes.size(); i++) size += sizeof(DebugEntry) + source.size() + 1;
+                put(RecordHeader{CODE_DEBUG_INFO, size, now()});
+                put(DebugInfo{address, changes.size()});
+                for(const auto& l : changes) {
+                    put(DebugEntry{address + l.offset, static_cast<uint32_t>(l.line), 0});
+                    fwrite(source.c_str(), 1, source.size() + 1, dump);
+                }
+            }
+            uint32_t size = sizeof(RecordHeader) + sizeof(CodeLoad) + name.size() + 1 + code.bytes();
+            put(RecordHeader{CODE_LOAD, size, now()});
+            put(CodeLoad{static_cast<uint32_t>(getpid()), static_cast<uint32_t>(syscall(SYS_gettid)),
+                         address, address, code.bytes(), static_cast<uint64_t>(blocks)});
+            fwrite(name.c_str(), 1, name.size() + 1, dump);
+            fwrite(code.address(), 1, code.bytes(), dump);
+            fflush(dump);
+        }
+#endif
+        blocks++;
+    }
+
+    const std::string& getMapFile() const { return mapFile; }
+    const std::string& getDumpFile() const { return dumpFile; }
+    long getBlocks() const { return blocks; }
+
+private:
+    template<typename T>
+    void put(const T& record) { fwrite(&record, sizeof(T), 1, dump); }
+
+#ifdef LAB3_PERF_MAP
+    // perf record -k mono stamps its samples with CLOCK_MONOTONIC
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+#endif
+};
+
+}  // namespace jit
@@ -0,0 +1,102 @@
+/**
+ * @file sampler.h
+ * @brief SIGPROF timer for the sampling profiler
+ *
+ * setitimer(ITIMER_PROF) raises SIGPROF at a fixed rate of consumed CPU
+ * time. The interpreter keeps its pc in a register, so the handler cannot
+ * read it; instead it marks a sample as pending and zeroes the step count
+ * of the next budget check, which makes the interpreter take the slow path
+ * at its next block entry and record the sample there. The handler only
+ * stores to two lock-free words, so it is async-signal-safe and costs the
+ * dispatch loop nothing. ITIMER_PROF counts the CPU time of the whole
+ * process and the kernel may deliver the tick to a parallel-loop worker;
+ * the handler then forwards it to the thread that armed the timer, so
+ * only that thread ever writes its checkpoint. Sampling is available on
+ * POSIX systems (LAB3_SAMPLER); elsewhere the timer never fires.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LAB3_SAMPLER 1
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+class SampleTimer {
+    static inline std::atomic<bool> pending{false};
+    static inline std::atomic<volatile long*> safepoint{nullptr};
+#ifdef LAB3_SAMPLER
+    static inline pthread_t owner;
+    static inline thread_local bool ownerThread = false;
+    struct sigaction previous {};
+#endif
+    bool armed = false;
+
+#ifdef LAB3_SAMPLER
+    static void onSignal(int) {
+        if(!ownerThread) {
+            pthread_kill(owner, SIGPROF);  // async-signal-safe
+            return;
+        }
+        pending.store(true, std::memory_order_relaxed);
+        if(volatile long* checkAt = safepoint.load(std::memory_order_relaxed)) *checkAt = 0;
+    }
+#endif
+
+public:
+    SampleTimer(const SampleTimer&) = delete;
+    SampleTimer& operator=(const SampleTimer&) = delete;
+
+    // Ticks `hz` times per second of CPU time; every tick zeroes *checkAt,
+    // which belongs to the calling thread. One timer per process.
+    SampleTimer(int hz, volatile long* checkAt) {
+        pending.store(false, std::memory_order_relaxed);
+        safepoint.store(checkAt, std::memory_order_relaxed);
+#ifdef LAB3_SAMPLER
+        owner = pthread_self();
+        ownerThread = true;
+        struct sigaction action {};
+        action.sa_handler = onSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if(hz <= 0 || sigaction(SIGPROF, &action, &previous) != 0) return;
+        armed = true;
+        long period = (hz >= 1000000) ? 1 : 1000000 / hz;
+        struct itimerval timer {};
+        timer.it_interval.tv_sec = period / 1000000;
+        timer.it_interval.tv_usec = period % 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+#else
+        (void)hz;
+#endif
+    }
+
+    // Stops the timer and restores the previous handler
+    ~SampleTimer() {
+#ifdef LAB3_SAMPLER
+        if(armed) {
+            struct itimerval off {};
+            setitimer(ITIMER_PROF, &off, nullptr);
+            sigaction(SIGPROF, &previous, nullptr);
+        }
+        ownerThread = false;
+#endif
+        safepoint.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // True once per tick since the last call
+    static bool take() { return pending.exchange(false, std::memory_order_relaxed); }
+
+    static bool available() {
+#ifdef LAB3_SAMPLER
+        return true;
+#else
+        return false;
+#endif
+    }
+};
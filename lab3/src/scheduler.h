@@ -0,0 +1,165 @@
+/**
+ * @file scheduler.h
+ * @brief Green-thread scheduler - many program instances on a few threads
+ *
+ * Every program is linked once (Interpreter::prepare) and spawned as any
+ * number of Interpreter::Instances: each owns its globals, a small value
+ * stack, call records and output, and shares the linked code. Runnable
+ * instances wait in one FIFO queue; each OS thread takes the oldest,
+ * resumes it for a slice of steps and queues it again unless it has
+ * finished, so instances get equal slices in turn. A runtime error or an
+ * exceeded limit ends only the instance that raised it.
+ */
+
+#pragma once
+
+#include "ir.h"
+#include "interpreter.h"
+#include "threadpool.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+struct SchedulerStats {
+    int threads = 1;
+    long instances = 0;
+    long slices = 0;            // resume() calls
+    long failed = 0;
+    long steps = 0;             // all instances
+    size_t instanceBytes = 0;   // largest instance state
+};
+
+class Scheduler {
+public:
+    static constexpr long DEFAULT_SLICE = 10000;
+
+    struct Result {
+        int program = 0;
+        bool ok = true;
+        std::string error;
+        std::vector<std::string> output;
+        long steps = 0;
+        long slices = 0;
+    };
+
+private:
+    struct Task {
+        int program = 0;
+        std::vector<int> input;  // read by the instance
+        std::unique_ptr<Interpreter::Instance> instance;
+        Result result;
+    };
+
+    std::vector<std::unique_ptr<Interpreter>> programs;
+    std::vector<std::unique_ptr<Task>> tasks;
+    int threads = 1;
+    long slice = DEFAULT_SLICE;
+    int stackSlots = Interpreter::INSTANCE_STACK_SLOTS;
+    SchedulerStats stats;
+
+public:
+    // OS threads running instances; 0 means one per hardware thread
+    void setThreads(int count) {
+        threads = (count > 0) ? count : ThreadPool::defaultThreads();
+    }
+
+    // Steps an instance runs before the next one gets its turn
+    void setSlice(long steps) { slice = std::max(steps, 1L); }
+
+    // Value stack of every instance spawned afterwards
+    void setStackSlots(int slots) { stackSlots = slots; }
+
+    // Links `program` for its instances and returns its index; linking
+    // errors throw
+    int addProgram(const IRProgram& program, const ExecutionLimits& limits = ExecutionLimits()) {
+        auto image = std::make_unique<Interpreter>();
+        image->setQuiet(true);
+        image->setLimits(limits);
+        image->prepare(program, 0);
+        programs.push_back(std::move(image));
+        return static_cast<int>(programs.size()) - 1;
+    }
+
+    // Queues a run of `program` whose input() reads `input`; returns its index
+    int spawn(int program, std::vector<int> input = {}) {
+        auto task = std::make_unique<Task>();
+        task->program = program;
+        task->input = std::move(input);
+        task->instance = programs[program]->spawn(task->input.data(), task->input.size(), stackSlots);
+        task->result.program = program;
+        stats.instanceBytes = std::max(stats.instanceBytes, task->instance->memoryBytes());
+        tasks.push_back(std::move(task));
+        return static_cast<int>(tasks.size()) - 1;
+    }
+
+    // Runs every queued instance to completion
+    void run() {
+        std::deque<Task*> queue;
+        for(auto& task : tasks) {
+            if(task->instance) queue.push_back(task.get());
+        }
+        std::mutex mutex;
+        std::condition_variable ready;
+        size_t running = queue.size();  // instances not finished yet
+
+        // One scheduling loop per thread; a thread with an empty queue
+        // waits for the instances others are running to come back
+        auto loop = [&](int, int) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true) {
+                ready.wait(lock, [&] { return !queue.empty() || running == 0; });
+                if(queue.empty()) return;
+                Task* task = queue.front();
+                queue.pop_front();
+                lock.unlock();
+
+                bool finished = true;
+                try {
+                    finished = programs[task->program]->resume(*task->instance, slice);
+                } catch(const std::exception& e) {
+                    task->result.ok = false;
+                    task->result.error = e.what();
+                }
+                task->result.slices++;
+                if(finished) finish(*task);
+
+                lock.lock();
+                if(finished) {
+                    running--;
+                    if(running == 0) ready.notify_all();
+                } else {
+                    queue.push_back(task);
+                    ready.notify_one();
+                }
+            }
+        };
+
+        stats.threads = threads;
+        if(threads <= 1) {
+            loop(0, 0);
+        } else {
+            ThreadPool pool(threads);
+            pool.run(threads, loop);
+        }
+
+        stats.slices = stats.steps = stats.failed = 0;
+        for(const auto& task : tasks) {
+            stats.slices += task->result.slices;
+            stats.steps += task->result.steps;
+            if(!task->result.ok) stats.failed++;
+        }
+        stats.instances = static_cast<long>(tasks.size());
+    }
+
+    const Result& result(int instance) const { return tasks[instance]->result; }
+
+    const SchedulerStats& getStats() const { return stats; }
+
+private:
+    // Keeps the output and frees the instance state
+    void finish(Task& task) {
+        task.result.output = task.instance->getOutput();
+        task.result.steps = task.instance->getSteps();
+        task.instance.reset();
+    }
+};
@@ -6,8 +6,18 @@
 #pragma once
 
 #include "parser.h"
+#include <climits>
 #include <unordered_map>
 #include <set>
+#include <map>
+#include <algorithm>
+
+// Shared scalar of a `parallel for` that the body only updates as
+// `s = s op expr` (op is + or *); each worker accumulates privately
+struct Reduction {
+    std::string name;
+    BinOp op;
+};
 
 class SemanticAnalyzer {
 private:
@@ -16,9 +26,43 @@ private:
         std::string type;  // "int", "bool", "func"
         int definedLine;
         bool initialized = false;
+        int arraySize = 0;  // > 0 for arrays
+    };
+
+    // A function is pure when it neither prints nor touches globals and
+    // only calls pure functions; its result then depends on its
+    // arguments alone. Global reads also count, since another statement
+    // could change the global between two calls with equal arguments.
+    struct FunctionInfo {
+        std::string name;
+        std::string returnType;
+        std::vector<std::string> paramTypes;
+        int definedLine;
+        bool pure = true;
+        std::set<std::string> callees;
     };
 
-    std::unordered_map<std::string, Symbol> symbolTable;
+    std::unordered_map<std::string, Symbol> symbolTable;      // globals
+    std::unordered_map<std::string, Symbol> localTable;       // current function
+    std::unordered_map<std::string, FunctionInfo> functions;
+    FunctionInfo* currentFunction = nullptr;
+
+    // Body of the `parallel for` being checked. Iterations may run in any
+    // order, so the body may write only variables declared inside it,
+    // arrays at the loop index, and reductions.
+    struct ParallelLoop {
+        std::string inductionVar;
+        std::set<std::string> privates;                      // declared in the body
+        std::map<std::string, std::vector<BinOp>> updates;   // s = s op expr
+        std::map<std::string, int> sharedReads;              // shared scalar -> reads
+        std::set<std::string> writtenArrays;
+        std::set<std::string> shiftedReads;                  // arrays read at another index
+        std::vector<std::string> calls;
+    };
+    ParallelLoop* parallel = nullptr;
+    std::map<const ForStmt*, std::vector<Reduction>> reductions;
+    std::vector<std::pair<std::string, int>> parallelCalls;  // callee, line
+
     std::vector<std::string> errors;
     std::vector<std::string> warnings;
 
@@ -27,9 +71,24 @@ public:
         if(!program) return false;
         
         try {
+            // Collect signatures first so functions may call each other
+            // regardless of definition order
+            for(const auto& stmt : program->statements) {
+                if(auto func = std::dynamic_pointer_cast<FuncDecl>(stmt)) {
+                    declareFunction(func);
+                }
+            }
+
             for(const auto& stmt : program->statements) {
                 visitStatement(stmt);
             }
+            propagatePurity();
+            for(const auto& [callee, line] : parallelCalls) {
+                if(!isFunctionPure(callee)) {
+                    errors.push_back("Function '" + callee + "' called in parallel loop at line " +
+                        std::to_string(line) + " must be pure");
+                }
+            }
         } catch(const std::exception& e) {
             errors.push_back(std::string(e.what()));
             return false;
@@ -50,7 +109,103 @@ public:
         return (it != symbolTable.end()) ? it->second.type : "";
     }
 
+    bool isFunctionDefined(const std::string& name) const {
+        return functions.count(name) > 0;
+    }
+
+    bool isFunctionPure(const std::string& name) const {
+        auto it = functions.find(name);
+        return it != functions.end() && it->second.pure;
+    }
+
+    // Reductions of a checked `parallel for`
+    const std::vector<Reduction>& getReductions(const ForStmt* loop) const {
+        static const std::vector<Reduction> none;
+        auto it = reductions.find(loop);
+        return (it != reductions.end()) ? it->second : none;
+    }
+
 private:
+    Symbol* lookup(const std::string& name) {
+        if(currentFunction) {
+            auto it = localTable.find(name);
+            if(it != localTable.end()) return &it->second;
+        }
+        auto it = symbolTable.find(name);
+        if(it == symbolTable.end()) return nullptr;
+        if(currentFunction) currentFunction->pure = false;  // global access
+        return &it->second;
+    }
+
+    // A call to an impure function makes the caller impure as well
+    void propagatePurity() {
+        bool changed = true;
+        while(changed) {
+            changed = false;
+            for(auto& [name, info] : functions) {
+                if(!info.pure) continue;
+                for(const auto& callee : info.callees) {
+                    if(!isFunctionPure(callee)) {
+                        info.pure = false;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void declareFunction(const std::shared_ptr<FuncDecl>& func) {
+        if(func->name == "input") {
+            errors.push_back("Function 'input' is built in");
+            return;
+        }
+        if(functions.count(func->name)) {
+            errors.push_back("Function '" + func->name + "' already defined");
+            return;
+        }
+
+        FunctionInfo info;
+        info.name = func->name;
+        info.returnType = func->returnType;
+        info.definedLine = func->line;
+        for(const auto& param : func->params) {
+            info.paramTypes.push_back(param.dataType);
+        }
+        functions[func->name] = info;
+    }
+
+    void visitFunction(const std::shared_ptr<FuncDecl>& func) {
+        if(currentFunction) {
+            errors.push_back("Function '" + func->name + "' must be defined at top level");
+            return;
+        }
+
+        currentFunction = &functions[func->name];
+        localTable.clear();
+
+        for(const auto& param : func->params) {
+            if(localTable.count(param.name)) {
+                errors.push_back("Duplicate parameter '" + param.name + 
+                    "' in function '" + func->name + "'");
+                continue;
+            }
+            Symbol sym;
+            sym.name = param.name;
+            sym.type = param.dataType;
+            sym.definedLine = func->line;
+            sym.initialized = true;
+            localTable[param.name] = sym;
+        }
+
+        for(const auto& stmt : func->body) {
+            visitStatement(stmt);
+        }
+
+        currentFunction = nullptr;
+        localTable.clear();
+    }
+
     void visitStatement(const StatementPtr& stmt) {
         if(!stmt) return;
 
@@ -69,14 +224,36 @@ private:
                 visitStatement(s);
             }
         } else if(auto printStmt = std::dynamic_pointer_cast<PrintStmt>(stmt)) {
+            if(currentFunction) currentFunction->pure = false;
+            if(parallel) {
+                errors.push_back("print is not allowed inside a parallel loop (line " +
+                    std::to_string(stmt->line) + ")");
+            }
             visitExpression(printStmt->value);
         } else if(auto retStmt = std::dynamic_pointer_cast<ReturnStmt>(stmt)) {
-            if(retStmt->value) visitExpression(retStmt->value);
+            visitReturn(retStmt);
+        } else if(auto exprStmt = std::dynamic_pointer_cast<ExprStmt>(stmt)) {
+            visitExpression(exprStmt->expr);
+        } else if(auto func = std::dynamic_pointer_cast<FuncDecl>(stmt)) {
+            visitFunction(func);
+        }
+    }
+
+    void visitReturn(const std::shared_ptr<ReturnStmt>& retStmt) {
+        if(parallel) {
+            errors.push_back("return is not allowed inside a parallel loop (line " +
+                std::to_string(retStmt->line) + ")");
+        }
+        std::string valueType = retStmt->value ? visitExpression(retStmt->value) : "int";
+        if(currentFunction && valueType != currentFunction->returnType) {
+            warnings.push_back("Type mismatch in return from '" + currentFunction->name +
+                "': expected " + currentFunction->returnType + ", got " + valueType);
         }
     }
 
     void visitDecl(const std::shared_ptr<DeclStmt>& decl) {
-        if(symbolTable.count(decl->varName)) {
+        auto& table = currentFunction ? localTable : symbolTable;
+        if(table.count(decl->varName)) {
             errors.push_back("Variable '" + decl->varName + "' already defined");
             return;
         }
@@ -85,7 +262,17 @@ private:
         sym.name = decl->varName;
         sym.type = decl->dataType;
         sym.definedLine = decl->line;
-        sym.initialized = (decl->initializer != nullptr);
+        sym.arraySize = decl->arraySize;
+        // Array elements start out as zero
+        sym.initialized = (decl->initializer != nullptr) || decl->arraySize > 0;
+
+        if(parallel) {
+            if(decl->arraySize > 0) {
+                errors.push_back("Array '" + decl->varName +
+                    "' cannot be declared inside a parallel loop");
+            }
+            parallel->privates.insert(decl->varName);
+        }
 
         if(decl->initializer) {
             auto exprType = visitExpression(decl->initializer);
@@ -96,24 +283,39 @@ private:
             }
         }
 
-        symbolTable[decl->varName] = sym;
+        table[decl->varName] = sym;
     }
 
     void visitAssign(const std::shared_ptr<AssignStmt>& assign) {
-        if(!symbolTable.count(assign->varName)) {
+        Symbol* sym = lookup(assign->varName);
+        if(!sym) {
             errors.push_back("Variable '" + assign->varName + "' is not defined");
             return;
         }
 
+        if(parallel) checkParallelWrite(assign);
+
+        if(assign->index) {
+            if(!sym->arraySize) {
+                errors.push_back("Variable '" + assign->varName + "' is not an array");
+                return;
+            }
+            checkIndex(*sym, assign->index);
+        } else if(sym->arraySize) {
+            errors.push_back("Cannot assign to array '" + assign->varName + "' without index");
+            return;
+        }
+
         auto exprType = visitExpression(assign->value);
-        const auto& varType = symbolTable[assign->varName].type;
+        sym = lookup(assign->varName);
+        const auto& varType = sym->type;
         
         if(exprType != varType) {
             warnings.push_back("Type mismatch in assignment to '" + 
                 assign->varName + "': expected " + varType + ", got " + exprType);
         }
 
-        symbolTable[assign->varName].initialized = true;
+        sym->initialized = true;
     }
 
     void visitIfStatement(const std::shared_ptr<IfStmt>& ifStmt) {
@@ -142,6 +344,11 @@ private:
     }
 
     void visitForStatement(const std::shared_ptr<ForStmt>& forStmt) {
+        if(forStmt->parallel) {
+            visitParallelFor(forStmt);
+            return;
+        }
+
         if(forStmt->init) visitStatement(forStmt->init);
         
         if(forStmt->condition) {
@@ -151,13 +358,153 @@ private:
             }
         }
         
-        if(forStmt->update) visitExpression(forStmt->update);
+        if(forStmt->update) visitStatement(forStmt->update);
         
         for(const auto& stmt : forStmt->body) {
             visitStatement(stmt);
         }
     }
 
+    // parallel for (i = a; i < b; i = i + 1), also i <= b and `int i = a`
+    static std::string parallelInductionVar(const ForStmt& loop) {
+        std::string iv;
+        if(auto decl = std::dynamic_pointer_cast<DeclStmt>(loop.init)) {
+            if(decl->initializer && decl->arraySize == 0) iv = decl->varName;
+        } else if(auto assign = std::dynamic_pointer_cast<AssignStmt>(loop.init)) {
+            if(!assign->index) iv = assign->varName;
+        }
+        if(iv.empty()) return "";
+
+        auto cond = std::dynamic_pointer_cast<BinExpr>(loop.condition);
+        auto condVar = cond ? std::dynamic_pointer_cast<VarExpr>(cond->left) : nullptr;
+        if(!condVar || condVar->name != iv || (cond->op != BinOp::LT && cond->op != BinOp::LE)) {
+            return "";
+        }
+
+        auto update = std::dynamic_pointer_cast<AssignStmt>(loop.update);
+        auto step = update ? std::dynamic_pointer_cast<BinExpr>(update->value) : nullptr;
+        auto stepVar = step ? std::dynamic_pointer_cast<VarExpr>(step->left) : nullptr;
+        auto stepConst = step ? std::dynamic_pointer_cast<ConstExpr>(step->right) : nullptr;
+        if(!update || update->index || update->varName != iv || !step || step->op != BinOp::ADD ||
+           !stepVar || stepVar->name != iv || !stepConst ||
+           !std::holds_alternative<int>(stepConst->value) || std::get<int>(stepConst->value) != 1) {
+            return "";
+        }
+        return iv;
+    }
+
+    void visitParallelFor(const std::shared_ptr<ForStmt>& forStmt) {
+        if(parallel) {
+            errors.push_back("Nested parallel loops are not supported (line " +
+                std::to_string(forStmt->line) + ")");
+            return;
+        }
+        std::string iv = parallelInductionVar(*forStmt);
+        if(iv.empty()) {
+            errors.push_back("parallel for at line " + std::to_string(forStmt->line) +
+                " must have the form 'for (i = a; i < b; i = i + 1)'");
+            return;
+        }
+
+        auto cond = std::dynamic_pointer_cast<BinExpr>(forStmt->condition);
+        auto bound = std::dynamic_pointer_cast<ConstExpr>(cond->right);
+        if(cond->op == BinOp::LE && bound && std::holds_alternative<int>(bound->value) &&
+           std::get<int>(bound->value) == INT_MAX) {
+            errors.push_back("parallel for at line " + std::to_string(forStmt->line) +
+                " never ends: '" + iv + " <= 2147483647' is always true");
+            return;
+        }
+
+        visitStatement(forStmt->init);
+        auto condType = visitExpression(forStmt->condition);
+        if(condType != "bool") {
+            warnings.push_back("For condition should be boolean, got " + condType);
+        }
+
+        ParallelLoop loop;
+        loop.inductionVar = iv;
+        parallel = &loop;
+        for(const auto& stmt : forStmt->body) {
+            visitStatement(stmt);
+        }
+        parallel = nullptr;
+
+        std::string where = " in parallel loop at line " + std::to_string(forStmt->line);
+        auto& found = reductions[forStmt.get()];
+        for(const auto& [name, ops] : loop.updates) {
+            bool sameOp = std::all_of(ops.begin(), ops.end(), [&](BinOp op) { return op == ops[0]; });
+            if(!sameOp) {
+                errors.push_back("Reduction '" + name + "' mixes + and *" + where);
+            } else if(loop.sharedReads[name] != static_cast<int>(ops.size())) {
+                errors.push_back("Reduction variable '" + name + "' is read" + where);
+            } else {
+                found.push_back({name, ops[0]});
+            }
+        }
+        for(const auto& array : loop.shiftedReads) {
+            if(loop.writtenArrays.count(array)) {
+                errors.push_back("Array '" + array + "' is written at '" + iv +
+                    "' and read at another index" + where);
+            }
+        }
+        for(const auto& callee : loop.calls) {
+            parallelCalls.push_back({callee, forStmt->line});
+        }
+    }
+
+    static bool refersTo(const ExpressionPtr& expr, const std::string& name) {
+        if(!expr) return false;
+        if(auto var = std::dynamic_pointer_cast<VarExpr>(expr)) return var->name == name;
+        if(auto bin = std::dynamic_pointer_cast<BinExpr>(expr)) {
+            return refersTo(bin->left, name) || refersTo(bin->right, name);
+        }
+        if(auto un = std::dynamic_pointer_cast<UnExpr>(expr)) return refersTo(un->operand, name);
+        if(auto index = std::dynamic_pointer_cast<IndexExpr>(expr)) return refersTo(index->index, name);
+        if(auto call = std::dynamic_pointer_cast<CallExpr>(expr)) {
+            for(const auto& arg : call->args) {
+                if(refersTo(arg, name)) return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isVar(const ExpressionPtr& expr, const std::string& name) {
+        auto var = std::dynamic_pointer_cast<VarExpr>(expr);
+        return var && var->name == name;
+    }
+
+    // Writes inside a parallel body: arrays only at the loop index, shared
+    // scalars only as `s = s + e` / `s = s * e` with e free of s
+    void checkParallelWrite(const std::shared_ptr<AssignStmt>& assign) {
+        const std::string& name = assign->varName;
+        std::string where = " in parallel loop (line " + std::to_string(assign->line) + ")";
+        if(name == parallel->inductionVar) {
+            errors.push_back("Loop variable '" + name + "' is assigned" + where);
+            return;
+        }
+        if(assign->index) {
+            parallel->writtenArrays.insert(name);
+            if(!isVar(assign->index, parallel->inductionVar)) {
+                errors.push_back("Array '" + name + "' is written at an index other than '" +
+                    parallel->inductionVar + "'" + where);
+            }
+            return;
+        }
+        if(parallel->privates.count(name)) return;
+
+        auto value = std::dynamic_pointer_cast<BinExpr>(assign->value);
+        if(value && (value->op == BinOp::ADD || value->op == BinOp::MUL)) {
+            const ExpressionPtr* other = isVar(value->left, name) ? &value->right
+                                       : isVar(value->right, name) ? &value->left : nullptr;
+            if(other && !refersTo(*other, name)) {
+                parallel->updates[name].push_back(value->op);
+                return;
+            }
+        }
+        errors.push_back("Shared variable '" + name + "' is written" + where +
+            "; only 's = s + e' and 's = s * e' reductions are allowed");
+    }
+
     auto visitExpression(const ExpressionPtr& expr) -> std::string {
         if(!expr) return "int";
 
@@ -171,11 +518,49 @@ private:
             return constExpr->dataType;
         } else if(auto callExpr = std::dynamic_pointer_cast<CallExpr>(expr)) {
             return visitCallExpr(callExpr);
+        } else if(auto indexExpr = std::dynamic_pointer_cast<IndexExpr>(expr)) {
+            return visitIndexExpr(indexExpr);
         }
 
         return "int";
     }
 
+    std::string visitIndexExpr(const std::shared_ptr<IndexExpr>& expr) {
+        Symbol* sym = lookup(expr->arrayName);
+        if(!sym) {
+            errors.push_back("Undefined variable '" + expr->arrayName + "'");
+            return "int";
+        }
+        if(!sym->arraySize) {
+            errors.push_back("Variable '" + expr->arrayName + "' is not an array");
+            return sym->type;
+        }
+        std::string type = sym->type;
+        if(parallel && !isVar(expr->index, parallel->inductionVar)) {
+            parallel->shiftedReads.insert(expr->arrayName);
+        }
+        checkIndex(*sym, expr->index);
+        return type;
+    }
+
+    // Index must be int; a constant index is checked against the size here
+    void checkIndex(const Symbol& sym, const ExpressionPtr& index) {
+        int size = sym.arraySize;
+        std::string name = sym.name;
+        auto indexType = visitExpression(index);
+        if(indexType != "int") {
+            warnings.push_back("Array index of '" + name + "' should be int, got " + indexType);
+        }
+        if(auto constIndex = std::dynamic_pointer_cast<ConstExpr>(index)) {
+            int value = std::holds_alternative<int>(constIndex->value)
+                        ? std::get<int>(constIndex->value) : 0;
+            if(value < 0 || value >= size) {
+                errors.push_back("Index " + std::to_string(value) + " out of bounds for array '" +
+                    name + "' of size " + std::to_string(size));
+            }
+        }
+    }
+
     std::string visitBinExpr(const std::shared_ptr<BinExpr>& expr) {
         auto leftType = visitExpression(expr->left);
         auto rightType = visitExpression(expr->right);
@@ -225,23 +610,68 @@ private:
     }
 
     std::string visitVarExpr(const std::shared_ptr<VarExpr>& expr) {
-        if(!symbolTable.count(expr->name)) {
+        if(parallel && !parallel->privates.count(expr->name)) {
+            parallel->sharedReads[expr->name]++;
+        }
+        Symbol* sym = lookup(expr->name);
+        if(!sym) {
             errors.push_back("Undefined variable '" + expr->name + "'");
             return "int";
         }
 
-        if(!symbolTable[expr->name].initialized) {
+        if(sym->arraySize) {
+            errors.push_back("Array '" + expr->name + "' used without index");
+            return sym->type;
+        }
+
+        if(!sym->initialized) {
             warnings.push_back("Variable '" + expr->name + "' may be uninitialized");
         }
 
-        return symbolTable[expr->name].type;
+        return sym->type;
     }
 
     std::string visitCallExpr(const std::shared_ptr<CallExpr>& expr) {
         // Built-in functions
         if(expr->funcName == "print") return "int";  // print returns nothing effectively
+        if(expr->funcName == "input") {
+            // Next integer of the input record: a side effect, like print
+            if(!expr->args.empty()) {
+                errors.push_back("input() takes no arguments (line " + std::to_string(expr->line) + ")");
+            }
+            if(currentFunction) currentFunction->pure = false;
+            if(parallel) {
+                errors.push_back("input() is not allowed inside a parallel loop (line " +
+                    std::to_string(expr->line) + ")");
+            }
+            return "int";
+        }
         
-        // User-defined functions (simplified)
-        return "int";
+        auto it = functions.find(expr->funcName);
+        if(it == functions.end()) {
+            errors.push_back("Undefined function '" + expr->funcName + "'");
+            for(const auto& arg : expr->args) visitExpression(arg);
+            return "int";
+        }
+
+        const auto& info = it->second;
+        if(currentFunction) currentFunction->callees.insert(expr->funcName);
+        if(parallel) parallel->calls.push_back(expr->funcName);
+        if(expr->args.size() != info.paramTypes.size()) {
+            errors.push_back("Function '" + expr->funcName + "' expects " +
+                std::to_string(info.paramTypes.size()) + " argument(s), got " +
+                std::to_string(expr->args.size()));
+        }
+
+        for(size_t i = 0; i < expr->args.size(); i++) {
+            auto argType = visitExpression(expr->args[i]);
+            if(i < info.paramTypes.size() && argType != info.paramTypes[i]) {
+                warnings.push_back("Type mismatch in argument " + std::to_string(i + 1) +
+                    " of '" + expr->funcName + "': expected " + info.paramTypes[i] +
+                    ", got " + argType);
+            }
+        }
+
+        return info.returnType;
     }
 };
@@ -0,0 +1,157 @@
+/**
+ * @file simd.h
+ * @brief SIMD kernels for vectorized loops (VEC_MAP / VEC_REDUCE)
+ *
+ * Each kernel processes 8 lanes with AVX2 when the CPU supports it, then
+ * 4 lanes with SSE2, and finishes with a scalar epilogue. Arithmetic wraps
+ * like the scalar interpreter. Other targets use the scalar loop only.
+ */
+
+#pragma once
+
+#include "ir.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAB3_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+// Kernel operand: an array chunk, or a scalar broadcast when ptr is null
+struct Source {
+    const int* ptr = nullptr;
+    int scalar = 0;
+
+    int at(int i) const { return ptr ? ptr[i] : scalar; }
+};
+
+inline int scalarOp(BinOp op, int a, int b) {
+    switch(op) {
+        case BinOp::SUB: return static_cast<int>(static_cast<unsigned>(a) - static_cast<unsigned>(b));
+        case BinOp::MUL: return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b));
+        default:         return static_cast<int>(static_cast<unsigned>(a) + static_cast<unsigned>(b));
+    }
+}
+
+// Quotient and remainder for b != 0. INT_MIN / -1 wraps to INT_MIN like
+// the other operations instead of trapping, and INT_MIN % -1 is 0.
+inline int divide(int a, int b) {
+    return (b == -1) ? scalarOp(BinOp::SUB, 0, a) : a / b;
+}
+inline int remainder(int a, int b) {
+    return (b == -1) ? 0 : a % b;
+}
+
+#ifdef LAB3_X86_SIMD
+
+// ---------- SSE2 (4 lanes) ----------
+
+inline __m128i load4(const Source& s, int i) {
+    return s.ptr ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.ptr + i))
+                 : _mm_set1_epi32(s.scalar);
+}
+
+// SSE2 has no 32-bit mullo; multiply even and odd lanes separately
+inline __m128i mullo4(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i op4(BinOp op, __m128i a, __m128i b) {
+    switch(op) {
+        case BinOp::SUB: return _mm_sub_epi32(a, b);
+        case BinOp::MUL: return mullo4(a, b);
+        default:         return _mm_add_epi32(a, b);
+    }
+}
+
+inline int hsum4(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// ---------- AVX2 (8 lanes) ----------
+
+__attribute__((target("avx2")))
+inline int map8(BinOp op, int* dst, Source a, Source b, int n) {
+    __m256i sa = _mm256_set1_epi32(a.scalar), sb = _mm256_set1_epi32(b.scalar);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i va = a.ptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.ptr + i)) : sa;
+        __m256i vb = b.ptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.ptr + i)) : sb;
+        __m256i r = (op == BinOp::SUB) ? _mm256_sub_epi32(va, vb)
+                  : (op == BinOp::MUL) ? _mm256_mullo_epi32(va, vb)
+                                       : _mm256_add_epi32(va, vb);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline int reduce8(BinOp op, Source a, Source b, int n, int& total) {
+    __m256i sa = _mm256_set1_epi32(a.scalar), sb = _mm256_set1_epi32(b.scalar);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i va = a.ptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.ptr + i)) : sa;
+        __m256i vb = b.ptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.ptr + i)) : sb;
+        __m256i r = (op == BinOp::SUB) ? _mm256_sub_epi32(va, vb)
+                  : (op == BinOp::MUL) ? _mm256_mullo_epi32(va, vb)
+                                       : _mm256_add_epi32(va, vb);
+        acc = _mm256_add_epi32(acc, r);
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    total = hsum4(half);
+    return i;
+}
+
+inline bool hasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif  // LAB3_X86_SIMD
+
+// dst[i] = a[i] op b[i] for i in [0, n)
+inline void map(BinOp op, int* dst, Source a, Source b, int n) {
+    int i = 0;
+#ifdef LAB3_X86_SIMD
+    if(hasAVX2()) {
+        i = map8(op, dst, a, b, n);
+    }
+    for(; i + 4 <= n; i += 4) {
+        Source ca{a.ptr ? a.ptr + i : nullptr, a.scalar}, cb{b.ptr ? b.ptr + i : nullptr, b.scalar};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), op4(op, load4(ca, 0), load4(cb, 0)));
+    }
+#endif
+    for(; i < n; i++) {
+        dst[i] = scalarOp(op, a.at(i), b.at(i));
+    }
+}
+
+// Sum over i in [0, n) of a[i] op b[i]
+inline int reduce(BinOp op, Source a, Source b, int n) {
+    int total = 0;
+    int i = 0;
+#ifdef LAB3_X86_SIMD
+    if(hasAVX2()) {
+        i = reduce8(op, a, b, n, total);
+    }
+    __m128i acc = _mm_setzero_si128();
+    for(; i + 4 <= n; i += 4) {
+        Source ca{a.ptr ? a.ptr + i : nullptr, a.scalar}, cb{b.ptr ? b.ptr + i : nullptr, b.scalar};
+        acc = _mm_add_epi32(acc, op4(op, load4(ca, 0), load4(cb, 0)));
+    }
+    total = scalarOp(BinOp::ADD, total, hsum4(acc));
+#endif
+    for(; i < n; i++) {
+        total = scalarOp(BinOp::ADD, total, scalarOp(op, a.at(i), b.at(i)));
+    }
+    return total;
+}
+
+}  // namespace simd
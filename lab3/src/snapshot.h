@@ -0,0 +1,69 @@
+/**
+ * @file snapshot.h
+ * @brief Snapshot files - checkpoints of a running program
+ *
+ * A long run executes as an Interpreter::Instance in slices of steps;
+ * between slices its state is written to a snapshot file, and a later
+ * process (possibly on another machine) links the same program and
+ * continues from it. The file starts with a text header naming the
+ * program: a hash of the compiler version and the canonical optimized IR
+ * (ResultCache::canonical), so a snapshot only resumes the program it was
+ * taken from. The rest is Interpreter::saveInstance() data in zigzag
+ * LEB128 numbers, which do not depend on word size or byte order.
+ *
+ * There is no build stamp in the key: snapshots are meant to move between
+ * builds of the same version. Bump LAB3_COMPILER_VERSION whenever linking
+ * or the op layout changes.
+ */
+
+#pragma once
+
+#include "ir.h"
+#include "interpreter.h"
+#include "cache.h"
+#include <filesystem>
+#include <fstream>
+
+class SnapshotFile {
+    static constexpr const char* MAGIC = "lab3-snapshot 1";
+
+public:
+    // Identity of a linked program across processes and machines
+    static std::string programKey(const IRProgram& program) {
+        return ResultCache::hash(std::string(LAB3_COMPILER_VERSION) + "\n" + ResultCache::canonical(program));
+    }
+
+    // Writes a temporary file and renames it over `path`, so a crash
+    // mid-write leaves the previous checkpoint intact; returns its size
+    static long save(const std::string& path, const std::string& key,
+                     const Interpreter& interpreter, const Interpreter::Instance& instance) {
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary);
+            if(!out) throw std::runtime_error("Snapshot: cannot write '" + temp + "'");
+            out << MAGIC << "\n" << key << "\n";
+            interpreter.saveInstance(instance, out);
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        if(ec) throw std::runtime_error("Snapshot: cannot replace '" + path + "': " + ec.message());
+        return static_cast<long>(std::filesystem::file_size(path, ec));
+    }
+
+    // The instance saved in `path`; throws unless it was taken from the
+    // program with `key`
+    static std::unique_ptr<Interpreter::Instance> load(const std::string& path, const std::string& key,
+                                                       Interpreter& interpreter,
+                                                       int stackSlots = Interpreter::STACK_SLOTS) {
+        std::ifstream in(path, std::ios::binary);
+        if(!in) throw std::runtime_error("Snapshot: cannot open '" + path + "'");
+        std::string magic, written;
+        if(!std::getline(in, magic) || magic != MAGIC) {
+            throw std::runtime_error("Snapshot: '" + path + "' is not a snapshot file");
+        }
+        if(!std::getline(in, written) || written != key) {
+            throw std::runtime_error("Snapshot: '" + path + "' was taken from a different program");
+        }
+        return interpreter.restoreInstance(in, stackSlots);
+    }
+};
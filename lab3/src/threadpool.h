@@ -0,0 +1,163 @@
+/**
+ * @file threadpool.h
+ * @brief Work-stealing thread pool for `parallel for` loops
+ *
+ * A parallel loop is split into chunks of consecutive iterations. Each
+ * worker starts with a contiguous block of chunks, kept as a packed
+ * [begin, end) pair in one atomic word: the owner takes chunks from the
+ * front, idle workers steal the back half of a victim's block. The calling
+ * thread works as worker 0, so a pool of N threads starts N - 1 of them.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // task(worker, chunk); must not throw
+    using Task = std::function<void(int, int)>;
+
+    explicit ThreadPool(int threads) {
+        int count = std::max(threads, 1);
+        queues = std::make_unique<Queue[]>(count);
+        workerCount = count;
+        for(int id = 1; id < count; id++) {
+            threads_.emplace_back([this, id] { workerLoop(id); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& thread : threads_) thread.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return workerCount; }
+    long steals() const { return stealCount.load(std::memory_order_relaxed); }
+
+    // Runs task for every chunk in [0, chunks) and returns when all are done
+    void run(int chunks, const Task& work) {
+        for(int w = 0; w < workerCount; w++) {
+            uint32_t begin = static_cast<uint32_t>(static_cast<long>(chunks) * w / workerCount);
+            uint32_t end = static_cast<uint32_t>(static_cast<long>(chunks) * (w + 1) / workerCount);
+            queues[w].range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &work;
+            running = workerCount - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return running == 0; });
+        task = nullptr;
+    }
+
+    static int defaultThreads() {
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw ? static_cast<int>(hw) : 1;
+    }
+
+private:
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> range{0};  // begin << 32 | end
+    };
+
+    static uint64_t pack(uint32_t begin, uint32_t end) {
+        return (static_cast<uint64_t>(begin) << 32) | end;
+    }
+    static uint32_t beginOf(uint64_t range) { return static_cast<uint32_t>(range >> 32); }
+    static uint32_t endOf(uint64_t range) { return static_cast<uint32_t>(range); }
+
+    std::unique_ptr<Queue[]> queues;
+    int workerCount = 1;
+    std::vector<std::thread> threads_;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const Task* task = nullptr;
+    long generation = 0;
+    int running = 0;
+    bool stopping = false;
+    std::atomic<long> stealCount{0};
+
+    void workerLoop(int id) {
+        long seen = 0;
+        while(true) {
+            const Task* current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+                current = task;
+            }
+            drain(id, current);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--running == 0) finished.notify_all();
+            }
+        }
+    }
+
+    void drain(int id) { drain(id, task); }
+
+    void drain(int id, const Task* work) {
+        while(true) {
+            int chunk = takeOwn(id);
+            if(chunk < 0 && steal(id)) continue;
+            if(chunk < 0) return;
+            (*work)(id, chunk);
+        }
+    }
+
+    int takeOwn(int id) {
+        auto& range = queues[id].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+        while(beginOf(current) < endOf(current)) {
+            uint64_t next = pack(beginOf(current) + 1, endOf(current));
+            if(range.compare_exchange_weak(current, next, std::memory_order_acq_rel)) {
+                return static_cast<int>(beginOf(current));
+            }
+        }
+        return -1;
+    }
+
+    // Moves the back half of some other worker's block into ours
+    bool steal(int id) {
+        for(int k = 1; k < workerCount; k++) {
+            auto& victim = queues[(id + k) % workerCount].range;
+            uint64_t current = victim.load(std::memory_order_acquire);
+            while(beginOf(current) < endOf(current)) {
+                uint32_t begin = beginOf(current), end = endOf(current);
+                uint32_t split = begin + (end - begin) / 2;
+                if(victim.compare_exchange_weak(current, pack(begin, split),
+                                                std::memory_order_acq_rel)) {
+                    queues[id].range.store(pack(split, end), std::memory_order_release);
+                    stealCount.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};